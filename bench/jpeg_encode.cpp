@@ -0,0 +1,131 @@
+// JPEG encode throughput, size and fidelity for save_as_jpg against
+// stb_image_write at a few qualities and thread counts. Prints a markdown table
+// (see jpeg_encode.md for results).
+//
+// Build from the repository root:
+//   g++ -std=c++17 -O2 -pthread -Iinclude bench/jpeg_encode.cpp $(ls src/*.cpp | grep -v main.cpp) -x c src/helpers.c -o jpeg_encode_bench
+// Run:
+//   ./jpeg_encode_bench [images...]    (defaults to the images/ corpus)
+
+#include "../include/image_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../stb_image/stb_image.h"
+#include "../stb_image/stb_image_write.h"
+
+namespace {
+
+const char* kScratchFile = "jpeg_encode_bench.tmp.jpg";
+constexpr int kRepeats = 5;
+
+long file_size(const char* path) {
+    FILE* file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        return -1;
+    }
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fclose(file);
+    return size;
+}
+
+// Best of kRepeats, in seconds
+double time_best(const std::function<void()>& fn) {
+    double best = 1e30;
+    for (int i = 0; i < kRepeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Squared error summed over the colour channels of image and the decoded
+// kScratchFile, and the number of samples compared
+void add_error(const Image& image, double& error, double& samples) {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    unsigned char* decoded = stbi_load(kScratchFile, &width, &height, &channels, 0);
+    if (decoded == nullptr) {
+        return;
+    }
+    const int compared = std::min(std::min(image.channels, 3), channels);
+    for (size_t i = 0; i < static_cast<size_t>(width) * height; ++i) {
+        for (int c = 0; c < compared; ++c) {
+            double diff = static_cast<double>(image.data[i * image.channels + c]) - decoded[i * channels + c];
+            error += diff * diff;
+        }
+    }
+    samples += static_cast<double>(width) * height * compared;
+    stbi_image_free(decoded);
+}
+
+struct Setting {
+    std::string encoder;
+    int quality = 0;
+    std::string threads;
+    std::function<void(const Image&)> save;
+    double seconds = 0;
+    long bytes = 0;
+    double error = 0;
+    double samples = 0;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths(argv + 1, argv + argc);
+    if (paths.empty()) {
+        paths = {"images/airplane.png", "images/test_image1.png", "images/test_image2.png"};
+    }
+
+    std::vector<Image> images;
+    double pixels = 0;
+    for (const std::string& path : paths) {
+        images.emplace_back(path);
+        pixels += static_cast<double>(images.back().width) * images.back().height;
+        std::printf("%s: %dx%d, %d channels\n", path.c_str(), images.back().width, images.back().height,
+                    images.back().channels);
+    }
+
+    std::vector<Setting> settings;
+    for (int quality : {50, 90, 100}) {
+        settings.push_back({"stb_image_write", quality, "1", [quality](const Image& image) {
+            stbi_write_jpg(kScratchFile, image.width, image.height, image.channels, image.data, quality);
+        }});
+        for (int threads : {1, 2, 4}) {
+            JpegSaveOptions options;
+            options.quality = quality;
+            options.threads = threads;
+            settings.push_back({"save_as_jpg", quality, std::to_string(threads),
+                                [options](const Image& image) { image.save_as_jpg(kScratchFile, options); }});
+        }
+    }
+
+    for (Setting& setting : settings) {
+        for (const Image& image : images) {
+            setting.seconds += time_best([&] { setting.save(image); });
+            setting.bytes += file_size(kScratchFile);
+            add_error(image, setting.error, setting.samples);
+        }
+    }
+    std::remove(kScratchFile);
+
+    std::printf("\n| encoder | quality | threads | MP/s | output bytes | PSNR dB |\n");
+    std::printf("|---|---:|---:|---:|---:|---:|\n");
+    for (const Setting& setting : settings) {
+        const double mse = setting.error / setting.samples;
+        std::printf("| %s | %d | %s | %.1f | %ld | %.2f |\n", setting.encoder.c_str(), setting.quality,
+                    setting.threads.c_str(), pixels / setting.seconds / 1e6, setting.bytes,
+                    10 * std::log10(255.0 * 255.0 / mse));
+    }
+    return 0;
+}
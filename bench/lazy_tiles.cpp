@@ -0,0 +1,117 @@
+// Tile-fused against whole-image execution of LazyImage filter chains on 4K and
+// 8K images, with a model (not a measurement) of the DRAM traffic each plan
+// implies. Prints a markdown table (see lazy_tiles.md for results).
+//
+// Build from the repository root:
+//   g++ -std=c++17 -O2 -pthread -Iinclude bench/lazy_tiles.cpp $(ls src/*.cpp | grep -v main.cpp) -x c src/helpers.c -o lazy_tiles_bench
+// Run:
+//   ./lazy_tiles_bench [tile size]    (default: sized for L2)
+
+#include "../include/lazy_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kRepeats = 3;
+
+// Best of kRepeats, in seconds
+double time_best(const std::function<void()>& fn) {
+    double best = 1e30;
+    for (int i = 0; i < kRepeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Smooth gradients plus noise, so thresholds and edges have something to find
+Image test_image(int width, int height) {
+    Image image = Image::uninitialized(width, height, 3);
+    std::mt19937 random(1);
+    for (int y = 0; y < height; ++y) {
+        unsigned char* row = image.view().row(y);
+        for (int x = 0; x < width; ++x) {
+            const int noise = static_cast<int>(random() % 32);
+            row[3 * x] = static_cast<unsigned char>((x * 255 / width + noise) & 255);
+            row[3 * x + 1] = static_cast<unsigned char>((y * 255 / height + noise) & 255);
+            row[3 * x + 2] = static_cast<unsigned char>(((x + y) / 8 + noise) & 255);
+        }
+    }
+    return image;
+}
+
+// Modelled, not measured: every step of a plan is assumed to read its input and
+// write its output once through DRAM, and a tiled chain's intermediates to stay
+// in cache
+double traffic_bytes(const std::string& plan, const Image& image) {
+    const long steps = std::count(plan.begin(), plan.end(), '\n');
+    return 2.0 * steps * image.size();
+}
+
+struct Chain {
+    const char* name;
+    std::function<LazyImage(const LazyImage&)> build;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    TileOptions tiled;
+    tiled.tile_size = argc > 1 ? std::atoi(argv[1]) : 0;
+    TileOptions untiled;
+    untiled.enabled = false;
+
+    const Chain chains[] = {
+        {"blur 5, high-pass 3, threshold",
+         [](const LazyImage& image) { return image.blur(5).high_pass(3).threshold(128); }},
+        {"grayscale, blur 5, high-pass 3, invert",
+         [](const LazyImage& image) { return image.grayscale().blur(5).high_pass(3).invert(); }},
+        {"blur 3, grayscale, blur 3, contrast",
+         [](const LazyImage& image) { return image.blur(3).grayscale().blur(3).contrast(1.5f); }},
+        {"blur 3, local contrast 7, adaptive threshold 15",
+         [](const LazyImage& image) { return image.blur(3).enhance_local_contrast(7, 1.5f).adaptive_threshold(15, 4); }},
+    };
+    const struct {
+        const char* name;
+        int width;
+        int height;
+    } sizes[] = {{"4K", 3840, 2160}, {"8K", 7680, 4320}};
+
+    std::printf("| image | chain | execution | ms | MP/s | DRAM MB (model) | same result |\n");
+    std::printf("|---|---|---|---:|---:|---:|---|\n");
+    for (const auto& size : sizes) {
+        const Image source = test_image(size.width, size.height);
+        const LazyImage input(source);
+        const double megapixels = static_cast<double>(size.width) * size.height / 1e6;
+        for (const Chain& chain : chains) {
+            const LazyImage graph = chain.build(input);
+            const Image reference = graph.evaluate(nullptr, untiled);
+            const Image result = graph.evaluate(nullptr, tiled);
+            const bool same = std::memcmp(reference.data, result.data, reference.size()) == 0;
+
+            const struct {
+                const char* name;
+                const TileOptions& options;
+            } modes[] = {{"whole image", untiled}, {"tiled", tiled}};
+            for (const auto& mode : modes) {
+                const double seconds = time_best([&] { graph.evaluate(nullptr, mode.options); });
+                std::printf("| %s | %s | %s | %.1f | %.1f | %.0f | %s |\n", size.name, chain.name, mode.name,
+                            seconds * 1e3, megapixels / seconds, traffic_bytes(graph.plan(mode.options), source) / 1e6,
+                            same ? "yes" : "NO");
+            }
+        }
+    }
+    std::printf("\nTiled plan of the first chain at 8K:\n%s\n",
+                chains[0].build(LazyImage(test_image(7680, 4320))).plan(tiled).c_str());
+    return 0;
+}
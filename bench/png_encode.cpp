@@ -0,0 +1,134 @@
+// PNG encode throughput against file size for every compression level and
+// filter setting, with stb_image_write as the baseline, then parallel encoding at
+// a few thread counts. Prints a markdown table (see png_encode.md for results).
+//
+// Build from the repository root:
+//   g++ -std=c++17 -O2 -pthread -Iinclude bench/png_encode.cpp $(ls src/*.cpp | grep -v main.cpp) -x c src/helpers.c -o png_encode_bench
+// Run:
+//   ./png_encode_bench [images...]    (defaults to the images/ corpus)
+
+#include "../include/image_utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../stb_image/stb_image_write.h"
+
+namespace {
+
+const char* kScratchFile = "png_encode_bench.tmp.png";
+constexpr int kRepeats = 3;
+
+long file_size(const char* path) {
+    FILE* file = std::fopen(path, "rb");
+    if (file == nullptr) {
+        return -1;
+    }
+    std::fseek(file, 0, SEEK_END);
+    long size = std::ftell(file);
+    std::fclose(file);
+    return size;
+}
+
+// Best of kRepeats, in seconds
+double time_best(const std::function<void()>& fn) {
+    double best = 1e30;
+    for (int i = 0; i < kRepeats; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+const char* filter_name(PngFilter filter) {
+    switch (filter) {
+    case PngFilter::None: return "none";
+    case PngFilter::Sub: return "sub";
+    case PngFilter::Up: return "up";
+    case PngFilter::Average: return "average";
+    case PngFilter::Paeth: return "paeth";
+    case PngFilter::Adaptive: return "adaptive";
+    }
+    return "?";
+}
+
+struct Setting {
+    std::string encoder;
+    std::string level;
+    std::string filter;
+    std::function<void(const Image&)> save;
+    double seconds = 0;
+    long bytes = 0;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::vector<std::string> paths(argv + 1, argv + argc);
+    if (paths.empty()) {
+        paths = {"images/airplane.png", "images/test_image1.png", "images/test_image2.png"};
+    }
+
+    std::vector<Image> images;
+    double raw_bytes = 0;
+    for (const std::string& path : paths) {
+        images.emplace_back(path);
+        raw_bytes += static_cast<double>(images.back().size());
+        std::printf("%s: %dx%d, %d channels\n", path.c_str(), images.back().width, images.back().height,
+                    images.back().channels);
+    }
+
+    std::vector<Setting> settings;
+    settings.push_back({"stb_image_write", "default", "adaptive", [](const Image& image) {
+        stbi_write_png(kScratchFile, image.width, image.height, image.channels, image.data,
+                       image.width * image.channels);
+    }});
+    const PngFilter filters[] = {PngFilter::None, PngFilter::Sub, PngFilter::Up,
+                                 PngFilter::Average, PngFilter::Paeth, PngFilter::Adaptive};
+    for (int level : {0, 1, 3, 6, 9}) {
+        for (PngFilter filter : filters) {
+            if (level == 0 && filter != PngFilter::None) {
+                continue;  // stored data does not care about filtering
+            }
+            PngSaveOptions options;
+            options.compression_level = level;
+            options.filter = filter;
+            options.threads = 1;
+            settings.push_back({"save_as_png", std::to_string(level), filter_name(filter),
+                                [options](const Image& image) { image.save_as_png(kScratchFile, options); }});
+        }
+    }
+
+    // Chunked parallel encoding at the default filter, for scaling
+    for (int level : {3, 6}) {
+        for (int threads : {2, 4, 8}) {
+            PngSaveOptions options;
+            options.compression_level = level;
+            options.threads = threads;
+            settings.push_back({"save_as_png, " + std::to_string(threads) + " threads", std::to_string(level),
+                                "adaptive", [options](const Image& image) { image.save_as_png(kScratchFile, options); }});
+        }
+    }
+
+    for (Setting& setting : settings) {
+        for (const Image& image : images) {
+            setting.seconds += time_best([&] { setting.save(image); });
+            setting.bytes += file_size(kScratchFile);
+        }
+    }
+    std::remove(kScratchFile);
+
+    std::printf("\n| encoder | level | filter | MB/s | output bytes | %% of raw |\n");
+    std::printf("|---|---|---|---:|---:|---:|\n");
+    for (const Setting& setting : settings) {
+        std::printf("| %s | %s | %s | %.1f | %ld | %.1f |\n", setting.encoder.c_str(), setting.level.c_str(),
+                    setting.filter.c_str(), raw_bytes / setting.seconds / 1e6, setting.bytes,
+                    100.0 * setting.bytes / raw_bytes);
+    }
+    return 0;
+}
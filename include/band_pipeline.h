@@ -0,0 +1,74 @@
+#ifndef BAND_PIPELINE_H
+#define BAND_PIPELINE_H
+
+#include "image_view.h"
+#include "png_stream.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Streams an image through a chain of operations a band of rows at a time, so
+// decode, processing and encode overlap and memory holds a few bands instead of
+// whole images. Decoding runs on a reader thread and encoding on a writer thread,
+// both connected to the processing thread by bounded queues; the operations
+// themselves still spread each band over the default thread pool.
+//
+// Neighbourhood operations declare a halo: the rows above and below an output
+// row that they read. Each band is processed together with the chain's total
+// halo of surrounding rows, and only its own rows are kept, so results match
+// running the chain over the whole image for operations whose output depends on
+// nothing further away than their halo (edges of the band that are edges of the
+// image are treated exactly as before).
+//
+//   BandPipeline pipeline;  // image: any Image, the operations only use their arguments
+//   pipeline.map([&](ImageView band) { image.adjust_brightness(band, 20); })
+//           .filter(2, [&](ConstImageView in, ImageView out) { image.low_pass_filter(in, out, 5); });
+//   pipeline.run("in.png", "out.png");
+class BandPipeline {
+public:
+    // Decode up to max_rows rows into dst, rows stride bytes apart; return the
+    // number decoded (PngReader::read_rows fits directly)
+    using Source = std::function<int(unsigned char* dst, std::ptrdiff_t stride, int max_rows)>;
+    // Take finished rows in order; y is the index of the first one
+    using Sink = std::function<void(ConstImageView rows, int y)>;
+
+    // Add an operation that rewrites each pixel from itself alone, in place
+    BandPipeline& map(std::function<void(ImageView band)> fn);
+    // Add an operation from in to out (same size) that reads up to halo rows
+    // above and below each output row
+    BandPipeline& filter(int halo, std::function<void(ConstImageView in, ImageView out)> fn);
+
+    // Context rows the whole chain needs on each side of a band
+    int halo() const;
+    size_t stages() const { return stages_.size(); }
+
+    // Rows per band; 0 (the default) picks about 4 MiB of pixels per band
+    void set_band_rows(int rows);
+    int band_rows() const { return band_rows_; }
+
+    // Pull a width x height image with channels channels from source, run the
+    // chain, and hand the result to sink. Exceptions from the source, the
+    // operations or the sink stop the pipeline and are rethrown here.
+    void run(const Source& source, int width, int height, int channels, const Sink& sink) const;
+    // PNG file to PNG file
+    void run(const std::string& input_png, const std::string& output_png,
+             const PngSaveOptions& options = PngSaveOptions()) const;
+    // In memory; dst may be src itself
+    void run(ConstImageView src, ImageView dst) const;
+
+private:
+    struct Stage {
+        int halo = 0;
+        std::function<void(ImageView)> map;
+        std::function<void(ConstImageView, ImageView)> filter;
+    };
+
+    std::vector<Stage> stages_;
+    int band_rows_ = 0;
+
+    int rows_per_band(size_t row_bytes, int height) const;
+};
+
+#endif // BAND_PIPELINE_H
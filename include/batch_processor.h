@@ -0,0 +1,84 @@
+#ifndef BATCH_PROCESSOR_H
+#define BATCH_PROCESSOR_H
+
+#include "image_utils.h"
+#include "profiler.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs one operation over many image files as a three-stage pipeline: decoder
+// threads load inputs, processor threads run the operation and encoder threads
+// save the results, with bounded queues between the stages. Every stage works
+// on a different image at once, so the slowest stage sets the pace while the
+// others keep its queue full, and memory holds at most a few images per queue.
+// Operations still spread each image over the default thread pool.
+//
+//   BatchOptions options;
+//   options.output_extension = ".jpg";
+//   BatchReport report = process_batch(list_image_files("in"), "out", [](Image image) {
+//       image.convert_to_grayscale();
+//       return image;
+//   }, options);
+
+// Files in directory whose extension Image can load, sorted by name
+std::vector<std::string> list_image_files(const std::string& directory);
+// Paths listed one per line in a text file; blank lines and lines starting
+// with # are skipped
+std::vector<std::string> read_file_list(const std::string& list_path);
+// list_image_files() for a directory, path itself for an image file, and
+// read_file_list() for anything else
+std::vector<std::string> collect_inputs(const std::string& path);
+
+struct BatchOptions {
+    int decode_threads = 2;
+    int process_threads = 2;
+    int encode_threads = 2;
+    // Images waiting between two stages
+    size_t queue_depth = 4;
+    // Extension of the outputs, which picks their format: .png, .jpg/.jpeg,
+    // .pgm/.ppm or .raw. Empty keeps each input's extension where it can be
+    // written and uses .png otherwise.
+    std::string output_extension;
+    PngSaveOptions png;
+    JpegSaveOptions jpeg;
+    // Profile every operation of the batch into BatchReport::profile (see
+    // profiler.h). This turns profiling on for the whole process while the batch
+    // runs and clears totals collected before it.
+    bool profile = false;
+};
+
+struct BatchFailure {
+    std::string path;
+    std::string error;
+};
+
+struct BatchReport {
+    size_t succeeded = 0;
+    // Inputs that could not be decoded, processed or saved, in input order. One
+    // bad file does not stop the batch.
+    std::vector<BatchFailure> failures;
+    double seconds = 0;
+    // Time each stage's threads spent working rather than waiting on a queue,
+    // summed over the threads: the stage with the most per thread is the one to
+    // give more threads
+    double decode_seconds = 0;
+    double process_seconds = 0;
+    double encode_seconds = 0;
+    // Per-operation totals, with BatchOptions::profile
+    std::vector<ProfileEntry> profile;
+};
+
+// Takes a decoded input and returns the image to save
+using BatchOperation = std::function<Image(Image image)>;
+
+// Run operation over inputs and save each result to output_dir (created if
+// missing) under the input's file name, with the output extension. Throws
+// std::invalid_argument for bad options or two inputs that would be saved to the
+// same file.
+BatchReport process_batch(const std::vector<std::string>& inputs, const std::string& output_dir,
+                          const BatchOperation& operation, const BatchOptions& options = BatchOptions());
+
+#endif // BATCH_PROCESSOR_H
@@ -0,0 +1,14 @@
+#ifndef BOX_BLUR_H
+#define BOX_BLUR_H
+
+#include <cstddef>
+
+// Box blur with edge-clamped averaging: each output sample is the mean of the
+// (2 * radius + 1)^2 window around it, counting only the pixels that lie inside
+// the image. Runs a horizontal then a vertical running sum, so the cost per pixel
+// does not depend on the radius. Strides are in bytes; src and dst must not overlap.
+void box_blur(const unsigned char* src, std::ptrdiff_t src_stride,
+              unsigned char* dst, std::ptrdiff_t dst_stride,
+              int width, int height, int channels, int radius);
+
+#endif // BOX_BLUR_H
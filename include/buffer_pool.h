@@ -0,0 +1,64 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include "image_allocator.h"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Recycling allocator for pixel buffers. Requests are rounded up to a size class
+// (four classes per power of two, so at most 25% slack) and released buffers
+// are kept on a per-class free list for the next request of that class. Once a
+// batch loop has seen each image size once, it stops hitting the heap.
+//
+// Buffers are 64-byte aligned. At most max_retained_bytes sit idle in the pool;
+// buffers released beyond that are freed straight away. Thread-safe.
+//
+//     auto pool = std::make_shared<BufferPool>();
+//     Image result(width, height, channels, pool);
+class BufferPool : public ImageAllocator {
+public:
+    struct Stats {
+        size_t hits = 0;               // allocations served from the free lists
+        size_t misses = 0;             // allocations that went to the heap
+        size_t evictions = 0;          // releases freed because the pool was full
+        size_t retained_bytes = 0;     // idle bytes held on the free lists
+        size_t outstanding_bytes = 0;  // bytes currently handed out
+        size_t peak_outstanding_bytes = 0;
+    };
+
+    static constexpr size_t kAlignment = 64;
+
+    explicit BufferPool(size_t max_retained_bytes = size_t(256) << 20);
+    ~BufferPool() override;
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    unsigned char* allocate(size_t bytes) override;
+    void deallocate(unsigned char* data, size_t bytes) override;
+
+    // Size actually reserved for a request of bytes
+    static size_t size_class(size_t bytes);
+
+    Stats stats() const;
+    void set_max_retained_bytes(size_t bytes);
+    // Free idle buffers until at most max_bytes are retained
+    void trim(size_t max_bytes = 0);
+
+private:
+    mutable std::mutex mutex_;
+    std::map<size_t, std::vector<unsigned char*>> free_;  // size class -> idle buffers
+    size_t max_retained_ = 0;
+    Stats stats_;
+
+    void trim_locked(size_t max_bytes);
+};
+
+// Process-wide pool for intermediate results
+std::shared_ptr<BufferPool> default_buffer_pool();
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,21 @@
+#ifndef CROP_H
+#define CROP_H
+
+#include "image_view.h"
+
+#include <vector>
+
+// Materialised crops. A region view (ImageView::region) is free; these copy
+// the region out into its own buffer, whole rows at a time. Copies much larger
+// than the cache go through non-temporal stores so they do not evict the source.
+
+// Copy rect of src into dst, which must be rect.width x rect.height with the
+// same channel count. Throws std::invalid_argument if rect leaves src.
+void crop(ConstImageView src, const Rect& rect, ImageView dst);
+
+// Copy many rects of src into dsts[i] in one top-to-bottom sweep of the source:
+// each source row is read once, while it is in cache, for every rect covering it.
+// Rects may overlap.
+void crop_many(ConstImageView src, const std::vector<Rect>& rects, const std::vector<ImageView>& dsts);
+
+#endif // CROP_H
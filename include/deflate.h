@@ -0,0 +1,103 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Running checksums: pass the previous value to continue over more data
+// (start from 0 for crc32, 1 for adler32)
+uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size);
+uint32_t adler32(uint32_t adler, const unsigned char* data, size_t size);
+// adler32 of A followed by B, from the adler32 of each and B's length
+uint32_t adler32_combine(uint32_t adler_a, uint32_t adler_b, size_t size_b);
+
+// The two-byte zlib header Deflater writes for level, for zlib streams stitched
+// together from raw pieces
+void zlib_header(int level, unsigned char header[2]);
+
+// Streaming zlib / raw DEFLATE encoder. Input is compressed as it is written,
+// matching against a 32 KiB sliding window, and output is handed to a sink
+// callback in pieces, so memory stays bounded no matter how long the stream is.
+//
+// Levels follow zlib: 0 stores without compression, 1-3 match greedily, 4-9 use
+// lazy matching with longer hash chains. Each block is sent as dynamic Huffman,
+// fixed Huffman or stored, whichever comes out smallest.
+class Deflater {
+public:
+    // Receives compressed bytes; the pointer is only valid during the call
+    using Sink = std::function<void(const unsigned char* data, size_t size)>;
+
+    // zlib_header: wrap in a zlib header and adler32 trailer (PNG IDAT data),
+    // otherwise write raw DEFLATE
+    Deflater(int level, Sink sink, bool zlib_header = true);
+
+    // Preload the window with data that precedes the stream (its last 32 KiB
+    // count), so the first bytes written can match against it. Only before the
+    // first write; the data itself is not output, nor part of adler().
+    void set_dictionary(const unsigned char* data, size_t size);
+
+    void write(const unsigned char* data, size_t size);
+    // Compress everything written so far and end on a byte boundary with an
+    // empty stored block (zlib's Z_SYNC_FLUSH), handing all of it to the sink
+    void sync_flush();
+    // Write the final block and trailer. Nothing may be written afterwards.
+    void finish();
+
+    // adler32 of everything written so far
+    uint32_t adler() const { return adler_; }
+
+private:
+    Sink sink_;
+    int level_;
+    bool zlib_header_;
+    bool header_written_ = false;
+    bool finished_ = false;
+    uint32_t adler_ = 1;
+
+    // Match search limits for the level (zlib's configuration table)
+    int good_length_;
+    int max_lazy_;
+    int nice_length_;
+    int max_chain_;
+
+    // Two window sizes of input; the upper half slides down as it fills.
+    // Positions are 16-bit with 0 meaning "no entry", as in zlib.
+    std::vector<unsigned char> window_;
+    std::vector<uint16_t> head_;
+    std::vector<uint16_t> prev_;
+    size_t strstart_ = 0;
+    size_t lookahead_ = 0;
+    long block_start_ = 0;
+    int match_length_ = 2;
+    int match_start_ = 0;
+    int prev_length_ = 2;
+    int prev_match_ = 0;
+    bool match_available_ = false;
+
+    // Symbols of the block being built: distance 0 for a literal byte
+    std::vector<uint16_t> sym_distance_;
+    std::vector<uint16_t> sym_value_;
+    size_t sym_count_ = 0;
+
+    uint64_t bits_ = 0;
+    int bit_count_ = 0;
+    std::vector<unsigned char> out_;
+
+    void write_header();
+    void put_bits(uint32_t value, int count);
+    void align_to_byte();
+    void drain();
+    void slide_window();
+    uint16_t insert_string(size_t pos);
+    int longest_match(int cur_match);
+    void tally(int distance, int value);
+    void compress_fast(bool flush);
+    void compress_lazy(bool flush);
+    void compress(bool flush);
+    void flush_block(bool last);
+    void write_stored(const unsigned char* data, size_t size, bool last);
+};
+
+#endif // DEFLATE_H
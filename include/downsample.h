@@ -0,0 +1,17 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <cstddef>
+
+// Output length of an axis of `size` pixels shrunk by an integer factor
+int downsampled_size(int size, int factor);
+
+// Box downsample by integer factors: every output pixel is the rounded mean of a
+// factor_x x factor_y block of the source. Blocks that hang over the right or
+// bottom edge average just the pixels that exist, so the output is
+// downsampled_size(width, factor_x) x downsampled_size(height, factor_y).
+// 2x2 blocks take a dedicated SIMD path. Strides are in bytes.
+void downsample(const unsigned char* src, int width, int height, std::ptrdiff_t src_stride,
+                unsigned char* dst, std::ptrdiff_t dst_stride, int channels, int factor_x, int factor_y);
+
+#endif // DOWNSAMPLE_H
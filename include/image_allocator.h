@@ -0,0 +1,25 @@
+#ifndef IMAGE_ALLOCATOR_H
+#define IMAGE_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+
+// Where an Image gets its pixel buffer from. An Image keeps a reference to the
+// allocator that produced its buffer and hands the buffer back to it when it is
+// destroyed, so pools, arenas or mappings can back images without copies.
+// Implementations must be thread-safe if images are created on several threads.
+class ImageAllocator {
+public:
+    virtual ~ImageAllocator() = default;
+
+    // Return a buffer of at least bytes bytes, or throw std::bad_alloc
+    virtual unsigned char* allocate(size_t bytes) = 0;
+    // Release a buffer from allocate() (or adopted by an Image) of the given size
+    virtual void deallocate(unsigned char* data, size_t bytes) = 0;
+};
+
+// malloc / free. This is also what stb_image allocates decoded images with, so
+// loaded images are owned by this allocator too.
+std::shared_ptr<ImageAllocator> default_image_allocator();
+
+#endif // IMAGE_ALLOCATOR_H
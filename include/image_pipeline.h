@@ -0,0 +1,62 @@
+#ifndef IMAGE_PIPELINE_H
+#define IMAGE_PIPELINE_H
+
+#include "buffer_pool.h"
+#include "image_utils.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A chain of image operations described as text, compiled once and then run
+// over any number of images (from several threads at once if need be).
+//
+// A spec lists steps separated by commas or newlines, each a name followed by
+// colon-separated arguments:
+//
+//   resize:0.5,contrast:1.5,otsu
+//
+// A config file holds the same, usually one step per line; # starts a comment.
+//
+//   grayscale  sepia  invert  otsu  hough
+//   brightness:<adjustment>  contrast:<factor>  gamma:<gamma>  threshold:<0-255>
+//   lowpass:<size>  highpass:<2-3>  adaptive_threshold:<block size>:<offset>
+//   local_contrast:<window>:<strength>  normalize:<window>
+//   resize:<scale>  resize:<width>:<height>  downsample:<factor>  crop:<x>:<y>:<w>:<h>
+//
+// grayscale leaves images with fewer than 3 channels as they are. resize
+// averages the covered area when shrinking and interpolates bilinearly when
+// enlarging.
+//
+// Compiling optimises across steps:
+// - Neighbouring point steps (brightness, contrast, gamma, threshold, invert)
+//   fold into one lookup table, applied in a single pass.
+// - A crop moves ahead of the per-pixel steps before it, so they only touch the
+//   pixels that are kept. This is exact, because those steps do not look at
+//   neighbouring pixels.
+// - Steps that need a separate output take it from a buffer pool, so a batch
+//   stops allocating once it has seen each image size.
+class ImagePipeline {
+public:
+    // Throws std::invalid_argument naming the offending step
+    static ImagePipeline parse(const std::string& spec);
+    static ImagePipeline load(const std::string& config_path);
+
+    Image run(Image image) const;
+
+    // Compiled stages, e.g. "lut(brightness, contrast) -> lowpass:5"
+    std::string describe() const;
+    size_t stages() const { return stages_.size(); }
+
+private:
+    struct Stage {
+        std::string description;
+        std::function<Image(Image)> run;
+    };
+
+    std::vector<Stage> stages_;
+    std::shared_ptr<BufferPool> pool_;
+};
+
+#endif // IMAGE_PIPELINE_H
@@ -1,7 +1,18 @@
 #ifndef IMAGE_UTILS_H
 #define IMAGE_UTILS_H
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "image_allocator.h"
+#include "image_view.h"
+#include "jpeg_writer.h"
+#include "png_stream.h"
+#include "resize.h"
+
+class Lut;
 
 // Struct to represent an image
 struct Image {
@@ -10,36 +21,129 @@ struct Image {
     int channels;    // Number of channels (e.g., 3 for RGB, 4 for RGBA)
     unsigned char* data; // Pointer to the raw pixel data
 
-    // Constructor to load an image from a file
+    // Constructor to load an image from a file. PGM, PPM and raw files (see
+    // mapped_image.h) are memory-mapped instead of decoded.
     Image(const std::string& filepath);
+    // Decode an image file held in memory (any format stb_image reads: PNG,
+    // JPEG, BMP, PGM/PPM, ...), e.g. one received over the network
+    Image(const unsigned char* encoded, size_t encoded_size);
+    // Blank (zeroed) image; allocator defaults to default_image_allocator()
+    Image(int width, int height, int channels, std::shared_ptr<ImageAllocator> allocator = nullptr);
+    // Image whose pixels are left unset, for results about to be overwritten in full
+    static Image uninitialized(int width, int height, int channels, std::shared_ptr<ImageAllocator> allocator = nullptr);
+    // Take ownership of a buffer of width * height * channels bytes; it is handed
+    // back to allocator->deallocate() on destruction
+    Image(int width, int height, int channels, unsigned char* data, std::shared_ptr<ImageAllocator> allocator);
+    // Deep copy, from the same allocator as other
+    Image(const Image& other);
+    // Moves leave the source empty (no data, zero size)
+    Image(Image&& other) noexcept;
+    Image& operator=(const Image& other);
+    Image& operator=(Image&& other) noexcept;
     // Destructor to free image memory
     ~Image();
 
-    // Save the image in PNG format
-    void save_as_png(const std::string& filepath) const;
-    // Save the image in JPG format
-    void save_as_jpg(const std::string& filepath, int quality = 100) const;
+    // Pixel bytes (width * height * channels)
+    size_t size() const { return static_cast<size_t>(width) * height * channels; }
+    bool empty() const { return data == nullptr; }
+    const std::shared_ptr<ImageAllocator>& allocator() const { return allocator_; }
+
+    // The whole image, or a w x h region of it at (x, y), as a view into data
+    ImageView view() { return ImageView(data, width, height, channels); }
+    ConstImageView view() const { return ConstImageView(data, width, height, channels); }
+    ImageView region(int x, int y, int w, int h) { return view().region(x, y, w, h); }
+    ConstImageView region(int x, int y, int w, int h) const { return view().region(x, y, w, h); }
+
+    // Save the image in PNG format (level 0 stores without compression, for
+    // scratch files that only need to be fast)
+    void save_as_png(const std::string& filepath, const PngSaveOptions& options = PngSaveOptions()) const;
+    // Save the image in JPG format, encoding rows of blocks in parallel (see
+    // jpeg_writer.h)
+    void save_as_jpg(const std::string& filepath, int quality = kDefaultJpegQuality) const;
+    void save_as_jpg(const std::string& filepath, const JpegSaveOptions& options) const;
+    // Encode into out instead of a file, replacing its contents. Passing the
+    // same buffer for every image reuses its capacity.
+    void encode_as_png(std::vector<unsigned char>& out, const PngSaveOptions& options = PngSaveOptions()) const;
+    void encode_as_jpg(std::vector<unsigned char>& out, const JpegSaveOptions& options = JpegSaveOptions()) const;
+    // Save uncompressed through a memory mapping, for handing to another stage:
+    // PGM for 1 channel, PPM for 3 (save_as_ppm), or the raw format (save_as_raw)
+    void save_as_ppm(const std::string& filepath) const;
+    void save_as_raw(const std::string& filepath) const;
 
     // Convert the image to grayscale
     void convert_to_grayscale();
     // Convert the image to sepia tone
     void convert_to_sepia();
+    // The same, on a region only
+    void convert_to_grayscale(ImageView region);
+    void convert_to_sepia(ImageView region);
 
-
+    // Every operation below also comes in a view form, which runs on any region
+    // (e.g. image.region(x, y, w, h)) in place or into another view of the same
+    // size. Neighbourhood filters treat the region's edges as the image border.
+    // The pointer forms take tightly packed whole images.
 
     void add_images(const unsigned char* img1, const unsigned char* img2, unsigned char* result, int width1, int height1, int channels1, int width2, int height2, int channels2);
     void subtract_images(const unsigned char* img1, const unsigned char* img2, unsigned char* result, int width1, int height1, int channels1, int width2, int height2, int channels2);
     void adjust_brightness(unsigned char* img, int width, int height, int channels, int adjustment);
     void adjust_contrast(unsigned char* img, int width, int height, int channels, float contrast_factor);
     void threshold_image(unsigned char* img, int width, int height, int channels, unsigned char threshold);
+    void adjust_gamma(unsigned char* img, int width, int height, int channels, float gamma);
+    void invert_image(unsigned char* img, int width, int height, int channels);
+    // Run every byte of the image through a lookup table (see lut.h)
+    void apply_lut(unsigned char* img, int width, int height, int channels, const Lut& lut);
     void low_pass_filter(const unsigned char* img, unsigned char* result, int width, int height, int channels, int filter_type);
     void high_pass_filter(const unsigned char* img, unsigned char* result, int width, int height, int channels, int filter_type);
     void otsu_threshold(const unsigned char* img, unsigned char* result, int width, int height, int channels);
+    // Threshold each sample against the mean of its block_size x block_size neighbourhood minus offset
+    void adaptive_threshold(const unsigned char* img, unsigned char* result, int width, int height, int channels, int block_size, int offset);
+    // Scale each sample's distance from its local mean by strength (> 1 sharpens, < 1 flattens)
+    void enhance_local_contrast(const unsigned char* img, unsigned char* result, int width, int height, int channels, int window_size, float strength);
+    // Normalize each sample to zero local mean and unit local standard deviation, mapped around 128
+    void normalize_local_contrast(const unsigned char* img, unsigned char* result, int width, int height, int channels, int window_size);
     void hough_transform(const unsigned char* img, unsigned char* result, int width, int height, int channels);
 
-    void resize_image(const unsigned char* src, unsigned char* dest, int old_width, int old_height, int new_width, int new_height, int channels);
+    void resize_image(const unsigned char* src, unsigned char* dest, int old_width, int old_height, int new_width, int new_height, int channels, ResizeFilter filter = ResizeFilter::Nearest);
+    // Shrink by an integer factor (2 for half size, ...): each output pixel is the
+    // mean of a factor x factor block; dest is ceil(width / factor) x ceil(height / factor)
+    void downsample_image(const unsigned char* src, unsigned char* dest, int width, int height, int channels, int factor);
+    // Top-left dest_width x dest_height corner of src
     void crop_image(const unsigned char* src, unsigned char* dest, int src_width, int src_height, int dest_width, int dest_height, int channels);
+    // Any rectangle of src; dest is rect.width x rect.height
+    void crop_image(const unsigned char* src, unsigned char* dest, int src_width, int src_height, int channels, const Rect& rect);
+
+    void add_images(ConstImageView img1, ConstImageView img2, ImageView result);
+    void subtract_images(ConstImageView img1, ConstImageView img2, ImageView result);
+    void adjust_brightness(ImageView img, int adjustment);
+    void adjust_contrast(ImageView img, float contrast_factor);
+    void threshold_image(ImageView img, unsigned char threshold);
+    void adjust_gamma(ImageView img, float gamma);
+    void invert_image(ImageView img);
+    void apply_lut(ImageView img, const Lut& lut);
+    void low_pass_filter(ConstImageView img, ImageView result, int filter_size);
+    void high_pass_filter(ConstImageView img, ImageView result, int filter_size);
+    void otsu_threshold(ConstImageView img, ImageView result);
+    void adaptive_threshold(ConstImageView img, ImageView result, int block_size, int offset);
+    void enhance_local_contrast(ConstImageView img, ImageView result, int window_size, float strength);
+    void normalize_local_contrast(ConstImageView img, ImageView result, int window_size);
+    void hough_transform(ConstImageView img, ImageView result);
+    void resize_image(ConstImageView src, ImageView dest, ResizeFilter filter = ResizeFilter::Nearest);
+    void downsample_image(ConstImageView src, ImageView dest, int factor);
+    void crop_image(ConstImageView src, ImageView dest, const Rect& rect);
+
+    // Copy a rectangle of this image out into a new image (see crop.h). For a
+    // crop that does not need its own buffer, use region() instead.
+    Image crop(const Rect& rect, std::shared_ptr<ImageAllocator> allocator = nullptr) const;
+    // Several crops in one pass over this image
+    std::vector<Image> crop_many(const std::vector<Rect>& rects, std::shared_ptr<ImageAllocator> allocator = nullptr) const;
+
+private:
+    // Owner of data and the size it was allocated with. Replace an image's
+    // buffer by assigning another Image, never by writing to data directly.
+    std::shared_ptr<ImageAllocator> allocator_;
+    size_t allocated_ = 0;
 
+    void release();
 };
 
 #endif // IMAGE_UTILS_H
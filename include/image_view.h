@@ -0,0 +1,70 @@
+#ifndef IMAGE_VIEW_H
+#define IMAGE_VIEW_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+
+// Axis-aligned pixel rectangle: top-left corner and size
+struct Rect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Non-owning window onto interleaved 8-bit pixels: a first-row pointer, a size
+// and a row stride in bytes. Views of a region point into the parent's buffer,
+// so crops, ROIs and tiles cost nothing to make, and every Image operation that
+// takes a view works on just that region. A view never outlives the buffer it
+// was taken from.
+//
+// ImageView is writable, ConstImageView read-only; an ImageView converts to a
+// ConstImageView implicitly.
+template <typename T>
+struct BasicImageView {
+    T* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::ptrdiff_t stride = 0;  // bytes from one row to the next
+
+    BasicImageView() = default;
+    BasicImageView(T* data, int width, int height, int channels, std::ptrdiff_t stride)
+        : data(data), width(width), height(height), channels(channels), stride(stride) {}
+    // Tightly packed rows
+    BasicImageView(T* data, int width, int height, int channels)
+        : BasicImageView(data, width, height, channels, static_cast<std::ptrdiff_t>(width) * channels) {}
+
+    // ImageView -> ConstImageView
+    template <typename U, typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+    BasicImageView(const BasicImageView<U>& other)
+        : data(other.data), width(other.width), height(other.height), channels(other.channels), stride(other.stride) {}
+
+    T* row(int y) const { return data + y * stride; }
+    T* pixel(int x, int y) const { return row(y) + x * channels; }
+
+    // Bytes of pixel data in one row
+    size_t row_bytes() const { return static_cast<size_t>(width) * channels; }
+    // Rows follow each other with no padding, so the view is one flat span
+    bool contiguous() const { return stride == static_cast<std::ptrdiff_t>(row_bytes()) || height <= 1; }
+    bool empty() const { return data == nullptr || width <= 0 || height <= 0; }
+
+    bool same_size(int w, int h, int c) const { return width == w && height == h && channels == c; }
+    template <typename U>
+    bool same_size(const BasicImageView<U>& other) const { return same_size(other.width, other.height, other.channels); }
+
+    // The w x h region whose top-left pixel is (x, y)
+    BasicImageView region(int x, int y, int w, int h) const {
+        if (x < 0 || y < 0 || w <= 0 || h <= 0 || x > width - w || y > height - h) {
+            throw std::invalid_argument("Region lies outside the image.");
+        }
+        return BasicImageView(pixel(x, y), w, h, channels, stride);
+    }
+    BasicImageView region(const Rect& rect) const { return region(rect.x, rect.y, rect.width, rect.height); }
+};
+
+using ImageView = BasicImageView<unsigned char>;
+using ConstImageView = BasicImageView<const unsigned char>;
+
+#endif // IMAGE_VIEW_H
@@ -0,0 +1,80 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Streaming zlib / raw DEFLATE decoder. Compressed bytes are pulled from a source
+// callback as they are needed and decompressed output is handed out in pieces of
+// any size, so memory stays at the 32 KiB history window plus one input buffer
+// no matter how large the stream is.
+class Inflater {
+public:
+    // Fill buffer with up to capacity compressed bytes; return 0 at end of input
+    using Source = std::function<size_t(unsigned char* buffer, size_t capacity)>;
+
+    // zlib_header: expect the 2-byte zlib header (PNG IDAT data), otherwise raw DEFLATE
+    explicit Inflater(Source source, bool zlib_header = true);
+
+    // Decompress exactly count bytes into out. Throws std::runtime_error if the
+    // data is corrupt or ends first.
+    void read(unsigned char* out, size_t count);
+    // Read on to the end of the stream, which must hold no more output, and check
+    // the zlib Adler-32 trailer against everything read. Throws
+    // std::runtime_error if either check fails.
+    void finish();
+    // The final block has been fully read
+    bool finished() const { return state_ == State::Done && pending_length_ == 0; }
+
+private:
+    struct Huffman {
+        uint16_t fast[1 << 9];  // (length << 9) | symbol for codes up to 9 bits, 0 if longer
+        uint16_t first_code[16];
+        uint16_t first_symbol[16];
+        uint32_t max_code[17];
+        uint8_t size[288];
+        uint16_t value[288];
+
+        void build(const uint8_t* lengths, int count);
+    };
+
+    enum class State { Header, Stored, Codes, Done };
+
+    Source source_;
+    std::vector<unsigned char> input_;
+    size_t input_pos_ = 0;
+    size_t input_end_ = 0;
+    size_t padding_ = 0;  // zero bytes made up past the end of the input
+
+    uint64_t bits_ = 0;
+    int bit_count_ = 0;
+
+    State state_ = State::Header;
+    bool final_block_ = false;
+    bool zlib_header_;
+    bool header_read_ = false;
+    size_t stored_remaining_ = 0;
+    Huffman literals_;
+    Huffman distances_;
+
+    // Back-reference still being copied out
+    size_t pending_length_ = 0;
+    size_t pending_distance_ = 0;
+
+    std::vector<unsigned char> window_;
+    size_t window_pos_ = 0;
+    uint64_t total_out_ = 0;
+    uint32_t adler_ = 1;  // of the output so far, for the zlib trailer
+
+    int next_byte();
+    void refill();
+    uint32_t get_bits(int count);
+    int decode(const Huffman& huffman);
+    void read_zlib_header();
+    void start_block();
+    void read_dynamic_tables();
+};
+
+#endif // INFLATE_H
@@ -0,0 +1,54 @@
+#ifndef INTEGRAL_IMAGE_H
+#define INTEGRAL_IMAGE_H
+
+#include "image_view.h"
+
+#include <cstdint>
+#include <vector>
+
+struct Image;
+
+// Summed-area table of an 8-bit image, one table per channel, interleaved like the
+// pixels. Gives the sum, mean and variance of any rectangle in four lookups.
+// Each table uses 32-bit entries when the whole-image sum fits in 32 bits and
+// 64-bit entries otherwise.
+class IntegralImage {
+public:
+    // Build the tables; the sum-of-squares table is only needed for variance()
+    IntegralImage(const unsigned char* img, int width, int height, int channels, bool with_squares = true);
+    explicit IntegralImage(const Image& image, bool with_squares = true);
+    explicit IntegralImage(ConstImageView view, bool with_squares = true);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int channels() const { return channels_; }
+
+    // Queries cover the inclusive rectangle [x0, x1] x [y0, y1] of channel c.
+    // The rectangle is clamped to the image, so windows may hang over the border.
+
+    // Number of pixels inside the clamped rectangle
+    int64_t area(int x0, int y0, int x1, int y1) const;
+    uint64_t sum(int x0, int y0, int x1, int y1, int c) const;
+    uint64_t sum_of_squares(int x0, int y0, int x1, int y1, int c) const;
+    double mean(int x0, int y0, int x1, int y1, int c) const;
+    double variance(int x0, int y0, int x1, int y1, int c) const;
+
+private:
+    int width_;
+    int height_;
+    int channels_;
+    bool has_squares_;
+
+    // Tables are (width + 1) x (height + 1) with a zero first row and column.
+    // Only one of each 32/64-bit pair is populated.
+    std::vector<uint32_t> sums32_;
+    std::vector<uint64_t> sums64_;
+    std::vector<uint32_t> squares32_;
+    std::vector<uint64_t> squares64_;
+
+    bool clamp_rect(int& x0, int& y0, int& x1, int& y1) const;
+    uint64_t lookup(const std::vector<uint32_t>& narrow, const std::vector<uint64_t>& wide,
+                    int x0, int y0, int x1, int y1, int c) const;
+};
+
+#endif // INTEGRAL_IMAGE_H
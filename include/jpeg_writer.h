@@ -0,0 +1,36 @@
+#ifndef JPEG_WRITER_H
+#define JPEG_WRITER_H
+
+#include "image_view.h"
+
+#include <string>
+#include <vector>
+
+// Baseline JPEG encoder. Every row of MCUs (8 or 16 pixel rows) is its own
+// restart interval: the DC predictions start over at each one and a restart
+// marker separates them, so rows are encoded independently and in parallel
+// and then joined in order. Output is the same for any number of threads, and
+// any baseline decoder reads it.
+//
+// 1 channel is written as grayscale, 3 as YCbCr; the alpha of 2- and 4-channel
+// images is dropped. The DCT is the AAN float transform, run on eight columns at
+// a time so the compiler can vectorise it, with quantisation folded into its
+// output scaling.
+// Quality of Image::save_as_jpg() and every other default: the one it always had
+constexpr int kDefaultJpegQuality = 100;
+
+struct JpegSaveOptions {
+    // 1-100, scaling the standard tables as libjpeg and stb_image_write do. At
+    // 90 and below chroma is subsampled 2x2 (4:2:0), above it is kept at full
+    // resolution, also as stb_image_write does.
+    int quality = kDefaultJpegQuality;
+    // MCU rows encoded at once (0: num_threads())
+    int threads = 0;
+};
+
+// Encode into out, replacing its contents; reusing one buffer across calls keeps
+// its capacity
+void encode_jpeg(ConstImageView img, std::vector<unsigned char>& out, const JpegSaveOptions& options = JpegSaveOptions());
+void save_jpeg(ConstImageView img, const std::string& filepath, const JpegSaveOptions& options = JpegSaveOptions());
+
+#endif // JPEG_WRITER_H
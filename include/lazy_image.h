@@ -0,0 +1,105 @@
+#ifndef LAZY_IMAGE_H
+#define LAZY_IMAGE_H
+
+#include "image_utils.h"
+#include "point_pipeline.h"
+
+#include <memory>
+#include <string>
+
+// How evaluate() runs tileable chains
+struct TileOptions {
+    bool enabled = true;
+    // Output tile edge in pixels; 0 sizes tiles so that a tile's two scratch
+    // buffers, halo included, take about 512 KiB
+    int tile_size = 0;
+};
+
+// Deferred image operations. Each call records a node in a graph instead of
+// running, and evaluate() plans and runs the whole graph at once:
+//
+//   Image result = LazyImage(std::move(image)).grayscale().blur(5).threshold(128).evaluate();
+//
+// Results may feed several later operations, so graphs need not be chains:
+//
+//   LazyImage gray = LazyImage(std::move(image)).grayscale();
+//   Image sharpened = gray.add(gray.high_pass(3)).evaluate();
+//
+// The planner
+// - fuses runs of point operations (brightness, contrast, gamma, threshold,
+//   invert, lut) into one lookup table, unless an intermediate result is used
+//   elsewhere too;
+// - makes crops views into their input instead of copies;
+// - runs an operation in place when it never reads a pixel after writing it
+//   (point operations, colour conversions, thresholds, local contrast, add and
+//   subtract) and this is the last use of an input no other result shares;
+// - gives every other result a buffer by liveness: a buffer returns to a free
+//   list after the last read of the result it holds and is reused by the next
+//   result of the same size. A chain of any length then needs at most two;
+// - runs a chain of same-size operations other than otsu_threshold (whose
+//   threshold depends on the whole image) tile by tile when the image is bigger
+//   than a tile. Each tile, grown by the halo of context rows and columns the
+//   chain's kernels read, goes through the whole chain in two scratch tiles that
+//   stay in the L2 cache, and only its own pixels are written out, so the
+//   chain's intermediate results never travel to and from DRAM. Results match
+//   the untiled ones exactly: pixels a tile computes wrongly near its edges all
+//   lie within the halo.
+//
+// The source image is never written. Nodes are immutable and shared, so a
+// LazyImage is cheap to copy, and graphs can be evaluated repeatedly and from
+// several threads. Bad arguments throw std::invalid_argument when the node is
+// added, not on evaluation.
+class LazyImage {
+public:
+    // Pass std::move(image) to hand the pixels over without a copy
+    explicit LazyImage(Image source);
+
+    int width() const;
+    int height() const;
+    int channels() const;
+
+    // Point operations, as in PointPipeline
+    LazyImage brightness(int adjustment) const;
+    LazyImage contrast(float contrast_factor) const;
+    LazyImage threshold(unsigned char threshold) const;
+    LazyImage gamma(float gamma) const;
+    LazyImage invert() const;
+    LazyImage lut(const Lut& lut) const;
+
+    // Same results as the Image operations of the same name
+    LazyImage grayscale() const;
+    LazyImage sepia() const;
+    // low_pass_filter
+    LazyImage blur(int filter_size) const;
+    // high_pass_filter; filter_size 2 or 3
+    LazyImage high_pass(int filter_size) const;
+    LazyImage otsu_threshold() const;
+    LazyImage adaptive_threshold(int block_size, int offset) const;
+    LazyImage enhance_local_contrast(int window_size, float strength) const;
+    LazyImage normalize_local_contrast(int window_size) const;
+    LazyImage resize(int width, int height, ResizeFilter filter = ResizeFilter::Bilinear) const;
+    LazyImage downsample(int factor) const;
+    LazyImage crop(const Rect& rect) const;
+    // Per-sample saturating sum and difference with an image of the same size
+    LazyImage add(const LazyImage& other) const;
+    LazyImage subtract(const LazyImage& other) const;
+
+    // Run the graph. Buffers come from allocator (default: default_buffer_pool()).
+    Image evaluate(std::shared_ptr<ImageAllocator> allocator = nullptr, const TileOptions& tiles = TileOptions()) const;
+    // The steps evaluate() would run, one per line, with the buffer each one
+    // writes and whether it runs in place, followed by the number of buffers
+    std::string plan(const TileOptions& tiles = TileOptions()) const;
+
+private:
+    struct Node;
+    struct Plan;
+
+    explicit LazyImage(std::shared_ptr<const Node> node);
+    Plan make_plan(const TileOptions& tiles) const;
+    LazyImage then(Node node) const;
+    LazyImage point(const std::string& name, const PointPipeline& points) const;
+
+    std::shared_ptr<const Node> node_;
+};
+
+#endif // LAZY_IMAGE_H
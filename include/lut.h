@@ -0,0 +1,42 @@
+#ifndef LUT_H
+#define LUT_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+
+// 256-entry lookup table for a unary per-byte operation. Brightness, contrast,
+// threshold, gamma, inversion and arbitrary curves all compile to one, and tables
+// compose, so any chain of them costs a single lookup per byte when applied.
+class Lut {
+public:
+    // Identity table
+    Lut();
+    explicit Lut(const std::array<unsigned char, 256>& table);
+
+    // Same results as the matching Image operations
+    static Lut brightness(int adjustment);
+    static Lut contrast(float contrast_factor);
+    static Lut threshold(unsigned char threshold);
+    // out = 255 * (in / 255)^(1 / gamma), rounded; gamma > 1 brightens
+    static Lut gamma(float gamma);
+    static Lut invert();
+    // Tabulate curve(0) .. curve(255), clamping the results to [0, 255]
+    static Lut from_curve(const std::function<int(int)>& curve);
+
+    // Table that applies this one, then next
+    Lut then(const Lut& next) const;
+    bool is_identity() const;
+
+    unsigned char operator[](unsigned char value) const { return table_[value]; }
+    const unsigned char* data() const { return table_.data(); }
+
+    // Look up count bytes (in may equal out), split across the thread pool
+    void apply(const unsigned char* in, unsigned char* out, size_t count) const;
+    void apply(unsigned char* data, size_t count) const { apply(data, data, count); }
+
+private:
+    std::array<unsigned char, 256> table_;
+};
+
+#endif // LUT_H
@@ -0,0 +1,56 @@
+#ifndef MAPPED_IMAGE_H
+#define MAPPED_IMAGE_H
+
+#include <string>
+
+#include "image_utils.h"
+#include "image_view.h"
+
+// Uncompressed image files that are opened and written through mmap, for
+// handing intermediate results between stages without encoding or decoding.
+//
+//   Pgm  binary PGM (P5), 1 channel, maxval 255
+//   Ppm  binary PPM (P6), 3 channels, maxval 255
+//   Raw  any of 1-4 channels: a 64-byte header, then tightly packed rows
+//
+// Raw header (integers little-endian, the rest zero):
+//   0   magic "IMGRAW01"
+//   8   width     uint32
+//   12  height    uint32
+//   16  channels  uint32
+// Pixel data starts at byte 64, so it is as aligned as the mapping.
+enum class MappedFormat { Pgm, Ppm, Raw };
+
+// .pgm and .ppm by extension, everything else raw
+MappedFormat mapped_format_for(const std::string& filepath);
+
+// Whether filepath starts with a header map_image() accepts
+bool is_mappable_image(const std::string& filepath);
+
+// Open a PGM, PPM or raw file (told apart by content) as an Image whose data
+// points straight into a private mapping of the file. Pages are read in as they
+// are first touched, and in-place operations write to copy-on-write pages, so
+// the file itself never changes. The mapping is released with the image's data.
+Image map_image(const std::string& filepath);
+
+// Create a width x height x channels image file and return an Image whose data
+// is a shared, writable mapping of its pixels, so operations can render straight
+// into the file. It is written under a temporary name next to filepath, so an
+// image mapped from filepath keeps its pixels and readers never see a partial
+// file. Pass the image to commit_mapped_image() once it is rendered; if it is
+// destroyed first (say while an exception unwinds), the temporary file is
+// removed and filepath is left as it was.
+Image create_mapped_image(const std::string& filepath, int width, int height, int channels, MappedFormat format);
+
+// Release the mapping of an image from create_mapped_image() and rename its
+// file over filepath. img is left empty. Throws std::runtime_error if the
+// rename fails (the temporary file is removed) and std::invalid_argument if img
+// did not come from create_mapped_image() or was committed already.
+void commit_mapped_image(Image& img);
+
+// Write img by sizing a temporary file up front, copying rows into a mapping of
+// it and renaming it over filepath; img may be mapped from filepath itself
+void save_mapped_image(ConstImageView img, const std::string& filepath, MappedFormat format);
+void save_mapped_image(ConstImageView img, const std::string& filepath);
+
+#endif // MAPPED_IMAGE_H
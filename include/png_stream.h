@@ -0,0 +1,107 @@
+#ifndef PNG_STREAM_H
+#define PNG_STREAM_H
+
+#include "image_view.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Row-streaming PNG decoder. The file is read and inflated incrementally and
+// rows are unfiltered one at a time, so decoding holds two rows of filtered data
+// and a 32 KiB window rather than the whole image. Output matches stbi_load: 8
+// bits per sample, palettes expanded to RGB (RGBA with transparency), 16-bit
+// samples reduced to their high byte, and a tRNS colour key turned into an
+// alpha channel.
+//
+// Interlaced (Adam7) files cannot be delivered row by row before the last pass;
+// those are decoded whole with stb_image and then handed out in the same way.
+class PngReader {
+public:
+    explicit PngReader(const std::string& filepath);
+    ~PngReader();
+
+    PngReader(const PngReader&) = delete;
+    PngReader& operator=(const PngReader&) = delete;
+
+    int width() const;
+    int height() const;
+    // Output channels (1 gray, 2 gray + alpha, 3 RGB, 4 RGBA)
+    int channels() const;
+    bool interlaced() const;
+    // Rows handed out so far
+    int rows_read() const;
+
+    // Decode the next rows (at most max_rows) into dst, rows stride bytes apart.
+    // Returns the number of rows decoded, 0 once the image is done.
+    int read_rows(unsigned char* dst, std::ptrdiff_t stride, int max_rows);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// Per-row PNG filter choice. The fixed filters cost one pass per row; Adaptive
+// tries all five and keeps the one whose output has the smallest sum of
+// absolute values (as signed bytes), the heuristic libpng and stb_image_write
+// use, for about five times the filtering work.
+enum class PngFilter { None, Sub, Up, Average, Paeth, Adaptive };
+
+struct PngSaveOptions {
+    // zlib level: 0 stores uncompressed (fastest, for scratch files), 1 is the
+    // fastest compression, 9 the smallest. The default beats stb_image_write on
+    // both speed and size; 6-9 save another few percent at half the speed or
+    // less (see bench/png_encode.md).
+    int compression_level = 3;
+    PngFilter filter = PngFilter::Adaptive;
+    // Threads compressing at once (0: num_threads()). With more than one, rows
+    // are filtered and deflated in chunks of about 256 KiB concurrently, each
+    // primed with the data before it and ended with a sync flush, so the chunks
+    // join into one ordinary zlib stream. Output is the same for any count above
+    // one and within a fraction of a percent of the serial encoder's size.
+    int threads = 0;
+};
+
+// Row-streaming PNG encoder. Rows are filtered and compressed as they are
+// written and IDAT chunks go to the file as they fill, so encoding holds two rows
+// and the compressor's 32 KiB window rather than the whole image. The file is
+// completed when the last row has been written; a writer destroyed before that
+// removes its partial file.
+class PngWriter {
+public:
+    // Receives the encoded file in order; the pointer is only valid during the call
+    using Sink = std::function<void(const unsigned char* data, size_t size)>;
+
+    // channels: 1 gray, 2 gray + alpha, 3 RGB, 4 RGBA
+    PngWriter(const std::string& filepath, int width, int height, int channels,
+              const PngSaveOptions& options = PngSaveOptions());
+    // Hand the file to sink instead of writing it to disk (e.g. to append it to
+    // a buffer or a socket)
+    PngWriter(Sink sink, int width, int height, int channels, const PngSaveOptions& options = PngSaveOptions());
+    ~PngWriter();
+
+    PngWriter(const PngWriter&) = delete;
+    PngWriter& operator=(const PngWriter&) = delete;
+
+    int width() const;
+    int height() const;
+    int channels() const;
+    // Rows written so far
+    int rows_written() const;
+
+    // Encode the next count rows of src, rows stride bytes apart
+    void write_rows(const unsigned char* src, std::ptrdiff_t stride, int count);
+    void write_rows(ConstImageView rows);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// Decode filepath in bands of up to band_rows rows and call fn(band, y) for each,
+// where y is the band's first row. Only one band is held in memory at a time.
+void decode_png_bands(const std::string& filepath, int band_rows,
+                      const std::function<void(ConstImageView band, int y)>& fn);
+
+#endif // PNG_STREAM_H
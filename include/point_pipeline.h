@@ -0,0 +1,45 @@
+#ifndef POINT_PIPELINE_H
+#define POINT_PIPELINE_H
+
+#include "image_view.h"
+#include "lut.h"
+
+#include <cstddef>
+#include <functional>
+
+struct Image;
+
+// Chain of per-byte point operations, e.g.
+//     PointPipeline().brightness(50).contrast(1.5f).threshold(128).apply(image);
+// Each stage is folded into a single lookup table as it is added, so applying the
+// chain reads and writes every byte once no matter how many stages it has.
+class PointPipeline {
+public:
+    PointPipeline& brightness(int adjustment);
+    PointPipeline& contrast(float contrast_factor);
+    PointPipeline& threshold(unsigned char threshold);
+    PointPipeline& gamma(float gamma);
+    PointPipeline& invert();
+    PointPipeline& curve(const std::function<int(int)>& curve);
+    PointPipeline& lut(const Lut& lut);
+    // Append another pipeline's stages
+    PointPipeline& then(const PointPipeline& next);
+
+    // Number of stages added so far
+    size_t size() const { return stages_; }
+    bool empty() const { return stages_ == 0; }
+    // The composed table
+    const Lut& compiled() const { return lut_; }
+
+    void apply(const unsigned char* in, unsigned char* out, size_t count) const;
+    void apply(unsigned char* data, size_t count) const { apply(data, data, count); }
+    void apply(Image& image) const;
+    // In place on a region of an image
+    void apply(ImageView view) const;
+
+private:
+    Lut lut_;
+    size_t stages_ = 0;
+};
+
+#endif // POINT_PIPELINE_H
@@ -0,0 +1,106 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <vector>
+
+// Per-operation timing for Image operations and image I/O. Every call made
+// while profiling is on adds its wall time, bytes read and written, pixels and
+// process CPU time to a running total for its operation name:
+//
+//   set_profiling(true);
+//   ... run a batch ...
+//   std::cout << profile_report();
+//
+// Profiling is off until set_profiling(true); each operation then costs one
+// check of an atomic flag. Building with -DIMAGE_PROFILING=0 compiles the
+// timing out altogether.
+//
+// Operations that call others (saving an image encodes it; LazyImage runs
+// Image operations) count the time of both, so totals add up to more than the
+// run took. CPU time is the whole process's, so operations running at once on
+// different threads (as in process_batch) each see the others' work too.
+#ifndef IMAGE_PROFILING
+#define IMAGE_PROFILING 1
+#endif
+
+struct ProfileEntry {
+    std::string name;
+    size_t calls = 0;
+    double seconds = 0;      // wall time
+    double cpu_seconds = 0;  // process CPU time, all threads
+    size_t bytes_read = 0;
+    size_t bytes_written = 0;
+    size_t pixels = 0;       // pixels produced
+    int threads = 1;         // pool size when the operations ran
+
+    double megapixels_per_second() const { return seconds > 0 ? pixels / seconds / 1e6 : 0; }
+    // Share of the pool's threads kept busy: CPU time over wall time x threads
+    double utilisation() const { return seconds > 0 ? cpu_seconds / (seconds * threads) : 0; }
+};
+
+void set_profiling(bool enabled);
+bool profiling_enabled();
+// Drop all totals collected so far
+void reset_profile();
+// Totals per operation, most time first
+std::vector<ProfileEntry> profile_entries();
+// profile_entries() as a table
+std::string profile_report();
+
+#if IMAGE_PROFILING
+
+// Times its own lifetime as one call of name, if profiling is on when it is
+// created. name must outlive the program (a string literal).
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name, size_t bytes_read = 0, size_t bytes_written = 0, size_t pixels = 0) {
+        if (profiling_enabled()) {
+            start(name, bytes_read, bytes_written, pixels);
+        }
+    }
+    ~ProfileScope() {
+        if (name_ != nullptr) {
+            finish();
+        }
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    // Whether this call is being recorded; check before measuring anything
+    // costly just for the profile (e.g. a file's size)
+    bool active() const { return name_ != nullptr; }
+    // Amounts known only once the operation has run
+    void add_read(size_t bytes) { bytes_read_ += bytes; }
+    void add_written(size_t bytes) { bytes_written_ += bytes; }
+    void add_pixels(size_t pixels) { pixels_ += pixels; }
+
+private:
+    const char* name_ = nullptr;
+    size_t bytes_read_ = 0;
+    size_t bytes_written_ = 0;
+    size_t pixels_ = 0;
+    std::chrono::steady_clock::time_point start_;
+    std::clock_t cpu_start_ = 0;
+
+    void start(const char* name, size_t bytes_read, size_t bytes_written, size_t pixels);
+    void finish();
+};
+
+#else
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char*, size_t = 0, size_t = 0, size_t = 0) {}
+    bool active() const { return false; }
+    void add_read(size_t) {}
+    void add_written(size_t) {}
+    void add_pixels(size_t) {}
+};
+
+#endif // IMAGE_PROFILING
+
+#endif // PROFILER_H
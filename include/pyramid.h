@@ -0,0 +1,49 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "resize.h"
+
+#include <cstddef>
+#include <vector>
+
+struct Image;
+
+// Power-of-two image pyramid (mipmap chain). Level 0 is a copy of the source and
+// each further level is half the size of the previous one (rounded up), down to
+// 1x1 or max_levels. All levels share one contiguous allocation of about 4/3 of
+// the source size.
+//
+// Levels are built with the integer 2x2 downsample. With gaussian set, each level
+// is first smoothed with a [1 2 1] binomial, which together with the 2x2 box
+// gives a [1 3 3 1] / 8 kernel per axis and keeps aliasing out of small levels.
+class Pyramid {
+public:
+    struct Level {
+        int width;
+        int height;
+        unsigned char* data;  // rows are width * channels bytes, no padding
+    };
+
+    // max_levels <= 0 builds every level down to 1x1
+    Pyramid(const unsigned char* img, int width, int height, int channels, int max_levels = 0, bool gaussian = false);
+    explicit Pyramid(const Image& image, int max_levels = 0, bool gaussian = false);
+
+    int channels() const { return channels_; }
+    int levels() const { return static_cast<int>(levels_.size()); }
+    const Level& level(int index) const { return levels_.at(index); }
+
+    // Smallest level still at least width x height, so a final resize to that
+    // size only ever shrinks (level 0 if the target is larger than the source)
+    int nearest_level(int width, int height) const;
+
+    // Resize to width x height starting from nearest_level() instead of level 0
+    void resize(unsigned char* dst, int width, int height, std::ptrdiff_t dst_stride,
+                ResizeFilter filter = ResizeFilter::Area) const;
+
+private:
+    int channels_;
+    std::vector<unsigned char> storage_;
+    std::vector<Level> levels_;
+};
+
+#endif // PYRAMID_H
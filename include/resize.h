@@ -0,0 +1,44 @@
+#ifndef RESIZE_H
+#define RESIZE_H
+
+#include <cstddef>
+#include <memory>
+
+// Resampling filters for resize()
+enum class ResizeFilter {
+    Nearest,   // nearest neighbour, the original resize_image sampling
+    Bilinear,  // triangle filter
+    Bicubic,   // Catmull-Rom spline
+    Lanczos,   // Lanczos-3 windowed sinc
+    Area,      // box average over the covered source area, best for downscaling
+};
+
+// Resize for one fixed pair of sizes. The filter coefficient tables are built
+// once in the constructor and reused by every resize() call, so a batch of
+// same-size images only pays for them once. Area shrinks by whole factors
+// (e.g. 4000x3000 -> 1000x750) skip the tables and take the integer box
+// downsample in downsample.h instead. Other non-nearest filters run on
+// stb_image_resize2's SIMD paths, split across the thread pool.
+// One Resizer runs one resize at a time.
+class Resizer {
+public:
+    Resizer(int src_width, int src_height, int dst_width, int dst_height, int channels, ResizeFilter filter);
+    ~Resizer();
+
+    Resizer(const Resizer&) = delete;
+    Resizer& operator=(const Resizer&) = delete;
+
+    // Strides are in bytes
+    void resize(const unsigned char* src, std::ptrdiff_t src_stride, unsigned char* dst, std::ptrdiff_t dst_stride);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+// One-off resize (builds and discards the coefficient tables)
+void resize(const unsigned char* src, int src_width, int src_height, std::ptrdiff_t src_stride,
+            unsigned char* dst, int dst_width, int dst_height, std::ptrdiff_t dst_stride,
+            int channels, ResizeFilter filter);
+
+#endif // RESIZE_H
@@ -0,0 +1,60 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+
+// Byte-wise kernels behind the point operations. Each one has a scalar reference
+// implementation and vector versions (AVX2, SSE4.1, NEON); the widest one the CPU
+// supports is picked at runtime. Every version gives exactly the scalar result.
+// in and out may be the same buffer. Where the table lookup kernel beats float
+// math (scalar, NEON), contrast runs as a 256-entry lookup instead.
+
+enum class SimdLevel {
+    Scalar,
+    SSE41,
+    AVX2,
+    NEON,
+};
+
+// Best level supported by this CPU
+SimdLevel detected_simd_level();
+// Level the kernels currently dispatch to
+SimdLevel simd_level();
+// Force a level (e.g. Scalar to compare against the reference); levels the CPU
+// does not support fall back to the detected one
+void set_simd_level(SimdLevel level);
+const char* simd_level_name(SimdLevel level);
+
+// out = min(a + b, 255)
+void add_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count);
+// out = max(a - b, 0)
+void subtract_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count);
+// out = clamp(in + value, 0, 255)
+void add_scalar_saturate(const unsigned char* in, unsigned char* out, size_t count, int value);
+// out = clamp(int((in - 127.5f) * factor + 127.5f), 0, 255)
+void contrast_bytes(const unsigned char* in, unsigned char* out, size_t count, float factor);
+// out = in >= threshold ? 255 : 0
+void threshold_bytes(const unsigned char* in, unsigned char* out, size_t count, unsigned char threshold);
+// out = table[in], table has 256 entries
+void lut_bytes(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* table);
+// Rounded mean of each 2x2 block of two rows: out has out_pixels pixels, each row
+// 2 * out_pixels. Vectorized for 1, 2 and 4 channels.
+void downsample2x_row(const unsigned char* row0, const unsigned char* row1, unsigned char* out, size_t out_pixels, int channels);
+// out = in (no overlap), with non-temporal stores that bypass the cache on x86.
+// Only worth it for copies far larger than the cache whose result is not read
+// again right away; otherwise memcpy is faster.
+void stream_copy(const unsigned char* in, unsigned char* out, size_t count);
+
+// Scalar reference versions, whatever the dispatch level
+namespace scalar {
+void add_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count);
+void subtract_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count);
+void add_scalar_saturate(const unsigned char* in, unsigned char* out, size_t count, int value);
+void contrast_bytes(const unsigned char* in, unsigned char* out, size_t count, float factor);
+void threshold_bytes(const unsigned char* in, unsigned char* out, size_t count, unsigned char threshold);
+void lut_bytes(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* table);
+void downsample2x_row(const unsigned char* row0, const unsigned char* row1, unsigned char* out, size_t out_pixels, int channels);
+void stream_copy(const unsigned char* in, unsigned char* out, size_t count);
+} // namespace scalar
+
+#endif // SIMD_KERNELS_H
@@ -0,0 +1,84 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker owns a task deque: it pops its own work
+// from the back and steals from the front of the others when it runs dry. The
+// thread that calls run() works on the batch too, so a pool of N threads starts
+// N - 1 workers, and nested run() calls from inside a task cannot deadlock.
+class ThreadPool {
+public:
+    // num_threads <= 0 uses every hardware thread
+    explicit ThreadPool(int num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Total parallelism, including the calling thread
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    // Run fn(0) .. fn(count - 1) across the pool and wait for all of them.
+    // The first exception thrown by a task is rethrown here.
+    void run(int count, const std::function<void(int)>& fn);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> next_queue_{0};
+    bool stopping_ = false;
+
+    void worker_loop(int index);
+    void push(int queue, std::function<void()> task);
+    bool run_one(int self);
+};
+
+// Execution settings shared by every image operation. Changing them while an
+// operation is running is not supported.
+
+// Number of threads operations may use (<= 0 means all hardware threads)
+void set_num_threads(int num_threads);
+int num_threads();
+
+// Rows per band handed to one task (0 picks a size from the image and thread count)
+void set_tile_rows(int rows);
+int tile_rows();
+
+// The pool every operation dispatches through, sized by set_num_threads()
+ThreadPool& default_thread_pool();
+
+// Smallest piece of work, in bytes, worth handing to another thread; callers
+// size min_rows and grain from it
+constexpr size_t kMinChunkBytes = 1 << 16;
+
+// Split rows [0, height) into bands of at least min_rows and run fn(y_begin, y_end)
+// for each band on the default pool
+void parallel_rows(int height, const std::function<void(int, int)>& fn, int min_rows = 1);
+
+// Split [0, count) into chunks of at least grain elements and run fn(begin, end)
+// for each chunk on the default pool
+void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+// Cover a width x height image with tile_width x tile_height tiles and run
+// fn(x_begin, y_begin, x_end, y_end) for each tile on the default pool
+void parallel_tiles(int width, int height, int tile_width, int tile_height,
+                    const std::function<void(int, int, int, int)>& fn);
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,285 @@
+#include "../include/band_pipeline.h"
+#include "../include/bounded_queue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// Pixels per band when the band height is left to the pipeline
+constexpr size_t kDefaultBandBytes = 4 << 20;
+// Bands in flight on each side of the processing thread
+constexpr size_t kQueueDepth = 2;
+
+struct Chunk {
+    std::vector<unsigned char> pixels;
+    int y = 0;
+    int rows = 0;
+};
+
+// Chunks circulate between a free list and a queue of filled ones, so the
+// buffers are allocated once and a stage that runs ahead blocks on the free list
+struct ChunkQueue {
+    BoundedQueue<Chunk> free;
+    BoundedQueue<Chunk> full;
+
+    explicit ChunkQueue(size_t chunk_bytes) : free(kQueueDepth + 1), full(kQueueDepth + 1) {
+        for (size_t i = 0; i < kQueueDepth + 1; ++i) {
+            Chunk chunk;
+            chunk.pixels.resize(chunk_bytes);
+            free.push(std::move(chunk));
+        }
+    }
+
+    void close() {
+        free.close();
+        full.close();
+    }
+};
+
+// First exception from any of the pipeline's threads
+class ErrorSlot {
+public:
+    void record(std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = error;
+        }
+    }
+
+    void rethrow() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+
+} // namespace
+
+BandPipeline& BandPipeline::map(std::function<void(ImageView band)> fn) {
+    Stage stage;
+    stage.map = std::move(fn);
+    stages_.push_back(std::move(stage));
+    return *this;
+}
+
+BandPipeline& BandPipeline::filter(int halo, std::function<void(ConstImageView in, ImageView out)> fn) {
+    if (halo < 0) {
+        throw std::invalid_argument("Halo must be non-negative.");
+    }
+    Stage stage;
+    stage.halo = halo;
+    stage.filter = std::move(fn);
+    stages_.push_back(std::move(stage));
+    return *this;
+}
+
+int BandPipeline::halo() const {
+    int total = 0;
+    for (const Stage& stage : stages_) {
+        total += stage.halo;
+    }
+    return total;
+}
+
+void BandPipeline::set_band_rows(int rows) {
+    if (rows < 0) {
+        throw std::invalid_argument("Band height must be non-negative.");
+    }
+    band_rows_ = rows;
+}
+
+int BandPipeline::rows_per_band(size_t row_bytes, int height) const {
+    int rows = band_rows_;
+    if (rows == 0) {
+        // Enough rows that the halo is a small overhead and each band still
+        // splits across the pool
+        rows = static_cast<int>(std::max<size_t>(1, kDefaultBandBytes / std::max<size_t>(1, row_bytes)));
+        rows = std::max(rows, 4 * halo());
+    }
+    return std::min(rows, height);
+}
+
+void BandPipeline::run(const Source& source, int width, int height, int channels, const Sink& sink) const {
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        throw std::invalid_argument("Image dimensions must be positive.");
+    }
+    const size_t row_bytes = static_cast<size_t>(width) * channels;
+    const std::ptrdiff_t stride = static_cast<std::ptrdiff_t>(row_bytes);
+    const int band = rows_per_band(row_bytes, height);
+    const int halo = this->halo();
+
+    ChunkQueue input(row_bytes * band);
+    ChunkQueue output(row_bytes * band);
+    ErrorSlot error;
+
+    std::thread reader([&] {
+        try {
+            Chunk chunk;
+            int y = 0;
+            while (y < height && input.free.pop(chunk)) {
+                chunk.y = y;
+                chunk.rows = source(chunk.pixels.data(), stride, std::min(band, height - y));
+                if (chunk.rows <= 0) {
+                    throw std::runtime_error("Image source ended before its last row.");
+                }
+                y += chunk.rows;
+                if (!input.full.push(std::move(chunk))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            error.record(std::current_exception());
+            output.close();
+        }
+        input.full.close();
+    });
+
+    std::thread writer([&] {
+        try {
+            Chunk chunk;
+            while (output.full.pop(chunk)) {
+                sink(ConstImageView(chunk.pixels.data(), width, chunk.rows, channels, stride), chunk.y);
+                output.free.push(std::move(chunk));
+            }
+        } catch (...) {
+            error.record(std::current_exception());
+            input.close();
+            output.close();
+        }
+    });
+
+    // Band [y0, y1) of the output, computed from buf whose first row is image row buf_y
+    auto emit = [&](const unsigned char* buf, int buf_y, int y0, int y1) {
+        Chunk chunk;
+        if (!output.free.pop(chunk)) {
+            return false;
+        }
+        std::memcpy(chunk.pixels.data(), buf + (y0 - buf_y) * row_bytes, (y1 - y0) * row_bytes);
+        chunk.y = y0;
+        chunk.rows = y1 - y0;
+        return output.full.push(std::move(chunk));
+    };
+
+    // Run every stage over rows of a and leave the result in a; b is scratch
+    auto process = [&](std::vector<unsigned char>& a, std::vector<unsigned char>& b, int rows) {
+        for (const Stage& stage : stages_) {
+            ImageView view(a.data(), width, rows, channels, stride);
+            if (stage.map) {
+                stage.map(view);
+            } else {
+                stage.filter(view, ImageView(b.data(), width, rows, channels, stride));
+                std::swap(a, b);
+            }
+        }
+    };
+
+    try {
+        if (halo == 0) {
+            // Bands are independent: process each chunk as it arrives and pass
+            // its buffer straight on to the writer
+            Chunk chunk;
+            Chunk out;
+            std::vector<unsigned char> scratch(row_bytes * band);
+            while (input.full.pop(chunk)) {
+                process(chunk.pixels, scratch, chunk.rows);
+                if (!output.free.pop(out)) {
+                    break;
+                }
+                std::swap(out.pixels, chunk.pixels);
+                out.y = chunk.y;
+                out.rows = chunk.rows;
+                input.free.push(std::move(chunk));
+                if (!output.full.push(std::move(out))) {
+                    break;
+                }
+            }
+        } else {
+            // Rolling window of decoded rows [window_y, window_end): each band
+            // needs halo rows past both of its ends, and the ones below are kept
+            // for the next band
+            const int extended = band + 2 * halo;
+            std::vector<unsigned char> window(row_bytes * (extended + band));
+            std::vector<unsigned char> a(row_bytes * extended);
+            std::vector<unsigned char> b(row_bytes * extended);
+            int window_y = 0;
+            int window_end = 0;
+            Chunk chunk;
+            for (int y0 = 0; y0 < height; y0 += band) {
+                const int y1 = std::min(y0 + band, height);
+                const int lo = std::max(y0 - halo, 0);
+                const int hi = std::min(y1 + halo, height);
+                if (lo > window_y) {
+                    std::memmove(window.data(), window.data() + (lo - window_y) * row_bytes,
+                                 (window_end - lo) * row_bytes);
+                    window_y = lo;
+                }
+                while (window_end < hi) {
+                    if (!input.full.pop(chunk)) {
+                        break;
+                    }
+                    std::memcpy(window.data() + (window_end - window_y) * row_bytes, chunk.pixels.data(),
+                                chunk.rows * row_bytes);
+                    window_end += chunk.rows;
+                    input.free.push(std::move(chunk));
+                }
+                if (window_end < hi) {
+                    break;  // the reader stopped; its error is rethrown below
+                }
+                std::memcpy(a.data(), window.data(), (hi - lo) * row_bytes);
+                process(a, b, hi - lo);
+                if (!emit(a.data(), lo, y0, y1)) {
+                    break;
+                }
+            }
+        }
+    } catch (...) {
+        error.record(std::current_exception());
+    }
+
+    input.close();
+    output.full.close();
+    reader.join();
+    writer.join();
+    error.rethrow();
+}
+
+void BandPipeline::run(const std::string& input_png, const std::string& output_png,
+                       const PngSaveOptions& options) const {
+    PngReader reader(input_png);
+    PngWriter writer(output_png, reader.width(), reader.height(), reader.channels(), options);
+    run([&](unsigned char* dst, std::ptrdiff_t stride, int max_rows) { return reader.read_rows(dst, stride, max_rows); },
+        reader.width(), reader.height(), reader.channels(),
+        [&](ConstImageView rows, int) { writer.write_rows(rows); });
+}
+
+void BandPipeline::run(ConstImageView src, ImageView dst) const {
+    if (!dst.same_size(src)) {
+        throw std::invalid_argument("Images must have the same dimensions and number of channels.");
+    }
+    const size_t row_bytes = src.row_bytes();
+    int next = 0;
+    run([&](unsigned char* out, std::ptrdiff_t stride, int max_rows) {
+            int rows = std::min(max_rows, src.height - next);
+            for (int i = 0; i < rows; ++i) {
+                std::memcpy(out + i * stride, src.row(next + i), row_bytes);
+            }
+            next += rows;
+            return rows;
+        },
+        src.width, src.height, src.channels,
+        [&](ConstImageView rows, int y) {
+            for (int i = 0; i < rows.height; ++i) {
+                std::memcpy(dst.row(y + i), rows.row(i), row_bytes);
+            }
+        });
+}
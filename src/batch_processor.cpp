@@ -0,0 +1,243 @@
+#include "../include/batch_processor.h"
+#include "../include/bounded_queue.h"
+#include "../include/helpers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Extensions Image(filepath) loads: stb_image's formats and the mapped ones
+const char* const kReadableExtensions[] = {".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif", ".psd",
+                                           ".hdr", ".pic", ".pnm", ".pgm", ".ppm", ".raw"};
+// Extensions an output can have
+const char* const kWritableExtensions[] = {".png", ".jpg", ".jpeg", ".pgm", ".ppm", ".raw"};
+
+std::string lowercase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+template <size_t N>
+bool ends_in_any(const std::string& name, const char* const (&extensions)[N]) {
+    const std::string lower = lowercase(name);
+    for (const char* extension : extensions) {
+        if (str_ends_in(lower.c_str(), extension)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The format follows the output's extension
+void save_image(const Image& image, const std::string& path, const BatchOptions& options) {
+    const std::string lower = lowercase(path);
+    if (str_ends_in(lower.c_str(), ".jpg") || str_ends_in(lower.c_str(), ".jpeg")) {
+        image.save_as_jpg(path, options.jpeg);
+    } else if (str_ends_in(lower.c_str(), ".pgm") || str_ends_in(lower.c_str(), ".ppm")) {
+        image.save_as_ppm(path);
+    } else if (str_ends_in(lower.c_str(), ".raw")) {
+        image.save_as_raw(path);
+    } else {
+        image.save_as_png(path, options.png);
+    }
+}
+
+std::vector<std::string> output_paths(const std::vector<std::string>& inputs, const std::string& output_dir,
+                                      const std::string& output_extension) {
+    std::vector<std::string> outputs;
+    outputs.reserve(inputs.size());
+    std::map<std::string, size_t> taken;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const fs::path input(inputs[i]);
+        std::string extension = output_extension;
+        if (extension.empty()) {
+            extension = ends_in_any(inputs[i], kWritableExtensions) ? input.extension().string() : ".png";
+        }
+        const std::string output = (fs::path(output_dir) / input.stem()).string() + extension;
+        auto [it, inserted] = taken.emplace(lowercase(output), i);
+        if (!inserted) {
+            throw std::invalid_argument("Inputs " + inputs[it->second] + " and " + inputs[i] +
+                                        " would both be saved to " + output);
+        }
+        outputs.push_back(output);
+    }
+    return outputs;
+}
+
+struct Job {
+    size_t index = 0;
+    std::optional<Image> image;
+};
+
+// Wall time of fn, added to a thread-local total
+template <typename Fn>
+void timed(double& total, Fn&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    total += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+std::vector<std::string> list_image_files(const std::string& directory) {
+    std::vector<std::string> files;
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory)) {
+        if (entry.is_regular_file() && ends_in_any(entry.path().filename().string(), kReadableExtensions)) {
+            files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::vector<std::string> read_file_list(const std::string& list_path) {
+    std::ifstream list(list_path);
+    if (!list) {
+        throw std::runtime_error("Error reading file list: " + list_path);
+    }
+    std::vector<std::string> files;
+    std::string line;
+    while (std::getline(list, line)) {
+        // Trailing whitespace (including \r of CRLF files) is never part of a name
+        line.erase(std::find_if(line.rbegin(), line.rend(), [](unsigned char c) { return !std::isspace(c); }).base(),
+                   line.end());
+        if (!line.empty() && line[0] != '#') {
+            files.push_back(line);
+        }
+    }
+    return files;
+}
+
+std::vector<std::string> collect_inputs(const std::string& path) {
+    if (fs::is_directory(path)) {
+        return list_image_files(path);
+    }
+    if (ends_in_any(path, kReadableExtensions)) {
+        return {path};
+    }
+    return read_file_list(path);
+}
+
+BatchReport process_batch(const std::vector<std::string>& inputs, const std::string& output_dir,
+                          const BatchOperation& operation, const BatchOptions& options) {
+    if (options.decode_threads < 1 || options.process_threads < 1 || options.encode_threads < 1) {
+        throw std::invalid_argument("Every batch stage needs at least one thread.");
+    }
+    if (!options.output_extension.empty() && !ends_in_any(options.output_extension, kWritableExtensions)) {
+        throw std::invalid_argument("Cannot write images with extension " + options.output_extension);
+    }
+    const std::vector<std::string> outputs = output_paths(inputs, output_dir, options.output_extension);
+    fs::create_directories(output_dir);
+
+    const bool was_profiling = profiling_enabled();
+    if (options.profile) {
+        reset_profile();
+        set_profiling(true);
+    }
+
+    BatchReport report;
+    std::vector<std::pair<size_t, std::string>> failures;
+    std::mutex report_mutex;
+    auto fail = [&](size_t index, const std::string& error) {
+        std::lock_guard<std::mutex> lock(report_mutex);
+        failures.emplace_back(index, error);
+    };
+    // Run one job's step; a failure drops the job and is reported
+    auto attempt = [&](size_t index, auto&& step) {
+        try {
+            step();
+            return true;
+        } catch (const std::exception& e) {
+            fail(index, e.what());
+        } catch (...) {
+            fail(index, "unknown error");
+        }
+        return false;
+    };
+
+    BoundedQueue<Job> decoded(options.queue_depth);
+    BoundedQueue<Job> processed(options.queue_depth);
+    std::atomic<size_t> next_input{0};
+    std::atomic<int> decoders_left{options.decode_threads};
+    std::atomic<int> processors_left{options.process_threads};
+    std::atomic<size_t> succeeded{0};
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.decode_threads; ++t) {
+        threads.emplace_back([&] {
+            double busy = 0;
+            for (size_t i = next_input++; i < inputs.size(); i = next_input++) {
+                Job job;
+                job.index = i;
+                if (attempt(i, [&] { timed(busy, [&] { job.image.emplace(inputs[i]); }); })) {
+                    decoded.push(std::move(job));
+                }
+            }
+            if (--decoders_left == 0) {
+                decoded.close();
+            }
+            std::lock_guard<std::mutex> lock(report_mutex);
+            report.decode_seconds += busy;
+        });
+    }
+    for (int t = 0; t < options.process_threads; ++t) {
+        threads.emplace_back([&] {
+            double busy = 0;
+            Job job;
+            while (decoded.pop(job)) {
+                if (attempt(job.index, [&] { timed(busy, [&] { job.image = operation(std::move(*job.image)); }); })) {
+                    processed.push(std::move(job));
+                }
+            }
+            if (--processors_left == 0) {
+                processed.close();
+            }
+            std::lock_guard<std::mutex> lock(report_mutex);
+            report.process_seconds += busy;
+        });
+    }
+    for (int t = 0; t < options.encode_threads; ++t) {
+        threads.emplace_back([&] {
+            double busy = 0;
+            Job job;
+            while (processed.pop(job)) {
+                if (attempt(job.index, [&] { timed(busy, [&] { save_image(*job.image, outputs[job.index], options); }); })) {
+                    ++succeeded;
+                }
+                job.image.reset();
+            }
+            std::lock_guard<std::mutex> lock(report_mutex);
+            report.encode_seconds += busy;
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (options.profile) {
+        set_profiling(was_profiling);
+        report.profile = profile_entries();
+    }
+
+    report.succeeded = succeeded;
+    std::sort(failures.begin(), failures.end());
+    for (auto& [index, error] : failures) {
+        report.failures.push_back({inputs[index], std::move(error)});
+    }
+    return report;
+}
@@ -0,0 +1,160 @@
+#include "../include/box_blur.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Slightly more than 1, so that sum * (kRoundUp / count) never lands below the
+// true quotient. The excess is far smaller than 1 / count for any realistic
+// window, so truncating the product gives exactly sum / count.
+constexpr double kRoundUp = 1.0 + 1.0 / (1ull << 40);
+
+// Number of in-image taps of the clamped window centred on each position of an axis
+std::vector<int> window_counts(int length, int radius) {
+    std::vector<int> counts(length);
+    for (int i = 0; i < length; ++i) {
+        counts[i] = std::min(i + radius, length - 1) - std::max(i - radius, 0) + 1;
+    }
+    return counts;
+}
+
+// Slide the horizontal window over [x_begin, x_end). Add / Sub say whether the
+// sample entering / leaving the window exists, so the border checks happen once
+// per range instead of once per tap.
+template <bool Add, bool Sub>
+void slide(const unsigned char* row, uint32_t* out, uint32_t* acc, int x_begin, int x_end, int channels, int radius) {
+    for (int x = x_begin; x < x_end; ++x) {
+        for (int c = 0; c < channels; ++c) {
+            out[x * channels + c] = acc[c];
+            if constexpr (Add) acc[c] += row[(x + radius + 1) * channels + c];
+            if constexpr (Sub) acc[c] -= row[(x - radius) * channels + c];
+        }
+    }
+}
+
+// Horizontal running sums of one row
+void horizontal_sums(const unsigned char* row, uint32_t* out, uint32_t* acc, int width, int channels, int radius) {
+    std::fill(acc, acc + channels, 0u);
+    int first = std::min(radius, width - 1);
+    for (int x = 0; x <= first; ++x) {
+        for (int c = 0; c < channels; ++c) {
+            acc[c] += row[x * channels + c];
+        }
+    }
+
+    int add_end = std::max(0, width - radius - 1);  // x < add_end: sample x + radius + 1 exists
+    int sub_begin = std::min(radius, width);        // x >= sub_begin: sample x - radius exists
+    if (add_end <= sub_begin) {
+        slide<true, false>(row, out, acc, 0, add_end, channels, radius);
+        slide<false, false>(row, out, acc, add_end, sub_begin, channels, radius);
+        slide<false, true>(row, out, acc, sub_begin, width, channels, radius);
+    } else {
+        slide<true, false>(row, out, acc, 0, sub_begin, channels, radius);
+        slide<true, true>(row, out, acc, sub_begin, add_end, channels, radius);
+        slide<false, true>(row, out, acc, add_end, width, channels, radius);
+    }
+}
+
+// Vertical running sum over the horizontal sums of rows [y_begin, y_end). Only the
+// 2 * radius + 2 most recent horizontal rows are kept, in a ring.
+template <typename Acc>
+void blur_rows(const unsigned char* src, std::ptrdiff_t src_stride, unsigned char* dst, std::ptrdiff_t dst_stride,
+               int width, int height, int channels, int radius, int y_begin, int y_end) {
+    const size_t row_len = static_cast<size_t>(width) * channels;
+    const int ring_rows = std::min(2 * radius + 2, height);
+    std::vector<uint32_t> ring(ring_rows * row_len);
+    std::vector<uint32_t> row_acc(channels);
+    std::vector<Acc> acc(row_len, 0);
+
+    auto horizontal_row = [&](int y) {
+        uint32_t* out = ring.data() + (y % ring_rows) * row_len;
+        horizontal_sums(src + y * src_stride, out, row_acc.data(), width, channels, radius);
+        return out;
+    };
+
+    for (int y = std::max(0, y_begin - radius); y <= std::min(height - 1, y_begin + radius); ++y) {
+        const uint32_t* h = horizontal_row(y);
+        for (size_t i = 0; i < row_len; ++i) {
+            acc[i] += h[i];
+        }
+    }
+
+    const std::vector<int> count_x = window_counts(width, radius);
+    const std::vector<int> count_y = window_counts(height, radius);
+    std::vector<double> scale(row_len);
+    int scale_count = -1;
+
+    for (int y = y_begin; y < y_end; ++y) {
+        // The vertical count only changes near the top and bottom borders
+        if (count_y[y] != scale_count) {
+            scale_count = count_y[y];
+            for (int x = 0; x < width; ++x) {
+                double s = kRoundUp / (static_cast<double>(count_x[x]) * scale_count);
+                std::fill(scale.begin() + x * channels, scale.begin() + (x + 1) * channels, s);
+            }
+        }
+
+        unsigned char* out = dst + y * dst_stride;
+        for (size_t i = 0; i < row_len; ++i) {
+            out[i] = static_cast<unsigned char>(static_cast<double>(acc[i]) * scale[i]);
+        }
+
+        if (y + 1 == y_end) break;
+        if (y - radius >= 0) {
+            const uint32_t* h = ring.data() + ((y - radius) % ring_rows) * row_len;
+            for (size_t i = 0; i < row_len; ++i) {
+                acc[i] -= h[i];
+            }
+        }
+        if (y + radius + 1 < height) {
+            const uint32_t* h = horizontal_row(y + radius + 1);
+            for (size_t i = 0; i < row_len; ++i) {
+                acc[i] += h[i];
+            }
+        }
+    }
+}
+
+} // namespace
+
+void box_blur(const unsigned char* src, std::ptrdiff_t src_stride,
+              unsigned char* dst, std::ptrdiff_t dst_stride,
+              int width, int height, int channels, int radius) {
+    if (radius < 0) {
+        throw std::invalid_argument("Blur radius must be non-negative.");
+    }
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        return;
+    }
+
+    if (radius == 0) {
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(dst + y * dst_stride, src + y * src_stride, static_cast<size_t>(width) * channels);
+        }
+        return;
+    }
+
+    // A window wider than the image covers the same pixels as one exactly as wide
+    radius = std::min(radius, std::max(width, height));
+
+    // 32-bit vertical sums unless the largest window could overflow them
+    uint64_t max_sum = 255ull * std::min(2 * radius + 1, width) * std::min(2 * radius + 1, height);
+    bool narrow = max_sum <= std::numeric_limits<uint32_t>::max();
+
+    // Every band re-primes its window from 2 * radius + 1 rows, so keep bands a
+    // few windows tall to bound that overhead
+    int min_rows = std::max(4 * (2 * radius + 1), static_cast<int>((1 << 16) / (static_cast<size_t>(width) * channels) + 1));
+    parallel_rows(height, [&](int y_begin, int y_end) {
+        if (narrow) {
+            blur_rows<uint32_t>(src, src_stride, dst, dst_stride, width, height, channels, radius, y_begin, y_end);
+        } else {
+            blur_rows<uint64_t>(src, src_stride, dst, dst_stride, width, height, channels, radius, y_begin, y_end);
+        }
+    }, min_rows);
+}
@@ -0,0 +1,112 @@
+#include "../include/buffer_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+unsigned char* aligned_new(size_t bytes) {
+    void* data = std::aligned_alloc(BufferPool::kAlignment, bytes);
+    if (data == nullptr) {
+        throw std::bad_alloc();
+    }
+    return static_cast<unsigned char*>(data);
+}
+
+} // namespace
+
+BufferPool::BufferPool(size_t max_retained_bytes) : max_retained_(max_retained_bytes) {}
+
+BufferPool::~BufferPool() {
+    trim_locked(0);
+}
+
+size_t BufferPool::size_class(size_t bytes) {
+    if (bytes <= kAlignment) {
+        return kAlignment;
+    }
+    // Quarter steps of the power of two below bytes, never finer than the alignment
+    size_t top = 1;
+    while (top < (bytes - 1) / 2 + 1) {
+        top <<= 1;
+    }
+    size_t step = std::max(kAlignment, top / 4);
+    return (bytes + step - 1) / step * step;
+}
+
+unsigned char* BufferPool::allocate(size_t bytes) {
+    const size_t size = size_class(bytes);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = free_.find(size);
+        if (it != free_.end() && !it->second.empty()) {
+            unsigned char* data = it->second.back();
+            it->second.pop_back();
+            ++stats_.hits;
+            stats_.retained_bytes -= size;
+            stats_.outstanding_bytes += size;
+            stats_.peak_outstanding_bytes = std::max(stats_.peak_outstanding_bytes, stats_.outstanding_bytes);
+            return data;
+        }
+    }
+
+    // Heap allocation outside the lock
+    unsigned char* data = aligned_new(size);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.misses;
+    stats_.outstanding_bytes += size;
+    stats_.peak_outstanding_bytes = std::max(stats_.peak_outstanding_bytes, stats_.outstanding_bytes);
+    return data;
+}
+
+void BufferPool::deallocate(unsigned char* data, size_t bytes) {
+    if (data == nullptr) {
+        return;
+    }
+    const size_t size = size_class(bytes);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.outstanding_bytes -= size;
+        if (stats_.retained_bytes + size <= max_retained_) {
+            free_[size].push_back(data);
+            stats_.retained_bytes += size;
+            return;
+        }
+        ++stats_.evictions;
+    }
+    std::free(data);
+}
+
+BufferPool::Stats BufferPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void BufferPool::set_max_retained_bytes(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_retained_ = bytes;
+    trim_locked(bytes);
+}
+
+void BufferPool::trim(size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    trim_locked(max_bytes);
+}
+
+// Largest classes go first: they free the most memory per buffer
+void BufferPool::trim_locked(size_t max_bytes) {
+    for (auto it = free_.rbegin(); it != free_.rend() && stats_.retained_bytes > max_bytes; ++it) {
+        std::vector<unsigned char*>& list = it->second;
+        while (!list.empty() && stats_.retained_bytes > max_bytes) {
+            std::free(list.back());
+            list.pop_back();
+            stats_.retained_bytes -= it->first;
+        }
+    }
+}
+
+std::shared_ptr<BufferPool> default_buffer_pool() {
+    static const std::shared_ptr<BufferPool> pool = std::make_shared<BufferPool>();
+    return pool;
+}
@@ -0,0 +1,99 @@
+#include "../include/crop.h"
+#include "../include/simd_kernels.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// Destinations bigger than this would push the source (and everything else)
+// out of the cache, and nobody reads them back right away
+constexpr size_t kStreamingBytes = size_t(8) << 20;
+
+void check_rect(ConstImageView src, const Rect& rect, ImageView dst) {
+    if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0 ||
+        rect.x > src.width - rect.width || rect.y > src.height - rect.height) {
+        throw std::invalid_argument("Crop rectangle lies outside the image.");
+    }
+    if (!dst.same_size(rect.width, rect.height, src.channels)) {
+        throw std::invalid_argument("Crop destination must match the rectangle size.");
+    }
+}
+
+void copy_row(const unsigned char* in, unsigned char* out, size_t bytes, bool streaming) {
+    if (streaming) {
+        stream_copy(in, out, bytes);
+    } else {
+        std::memcpy(out, in, bytes);
+    }
+}
+
+} // namespace
+
+void crop(ConstImageView src, const Rect& rect, ImageView dst) {
+    check_rect(src, rect, dst);
+    ConstImageView from = src.region(rect);
+    const size_t row_bytes = from.row_bytes();
+    const bool streaming = row_bytes * from.height >= kStreamingBytes;
+
+    if (from.contiguous() && dst.contiguous()) {
+        // Full-width crop: one block
+        parallel_for(row_bytes * from.height, kMinChunkBytes, [&](size_t begin, size_t end) {
+            copy_row(from.data + begin, dst.data + begin, end - begin, streaming);
+        });
+        return;
+    }
+    int min_rows = static_cast<int>(std::max<size_t>(1, kMinChunkBytes / row_bytes));
+    parallel_rows(from.height, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            copy_row(from.row(y), dst.row(y), row_bytes, streaming);
+        }
+    }, min_rows);
+}
+
+void crop_many(ConstImageView src, const std::vector<Rect>& rects, const std::vector<ImageView>& dsts) {
+    if (rects.size() != dsts.size()) {
+        throw std::invalid_argument("Need one destination per crop rectangle.");
+    }
+    size_t total = 0;
+    int top = src.height;
+    int bottom = 0;
+    for (size_t i = 0; i < rects.size(); ++i) {
+        check_rect(src, rects[i], dsts[i]);
+        total += static_cast<size_t>(rects[i].width) * rects[i].height * src.channels;
+        top = std::min(top, rects[i].y);
+        bottom = std::max(bottom, rects[i].y + rects[i].height);
+    }
+    if (rects.empty()) {
+        return;
+    }
+    const bool streaming = total >= kStreamingBytes;
+
+    // Rects in order of their first row, so a band only looks at rects that can reach it
+    std::vector<size_t> order(rects.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rects[a].y < rects[b].y; });
+
+    int min_rows = static_cast<int>(std::max<size_t>(1, kMinChunkBytes / src.row_bytes()));
+    parallel_rows(bottom - top, [&](int band_begin, int band_end) {
+        const int y_begin = top + band_begin;
+        const int y_end = top + band_end;
+        for (int y = y_begin; y < y_end; ++y) {
+            const unsigned char* in = src.row(y);
+            for (size_t i : order) {
+                const Rect& r = rects[i];
+                if (r.y > y) {
+                    break;
+                }
+                if (y < r.y + r.height) {
+                    copy_row(in + static_cast<size_t>(r.x) * src.channels, dsts[i].row(y - r.y),
+                             static_cast<size_t>(r.width) * src.channels, streaming);
+                }
+            }
+        }
+    }, min_rows);
+}
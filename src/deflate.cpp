@@ -0,0 +1,823 @@
+#include "../include/deflate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace {
+
+constexpr int kWindowSize = 1 << 15;
+constexpr int kWindowMask = kWindowSize - 1;
+constexpr int kHashBits = 15;
+constexpr int kHashSize = 1 << kHashBits;
+constexpr int kMinMatch = 3;
+constexpr int kMaxMatch = 258;
+// Keep this much input ahead of the cursor so a match can always run to full length
+constexpr int kMinLookahead = kMaxMatch + kMinMatch + 1;
+constexpr int kMaxDistance = kWindowSize - kMinLookahead;
+// A length-3 match further back than this costs more than three literals
+constexpr int kTooFar = 4096;
+constexpr size_t kSymbolBufferSize = 1 << 14;
+constexpr size_t kMaxStoredBlock = 65535;
+constexpr size_t kOutputChunk = 1 << 16;
+
+constexpr int kLiteralCodes = 286;
+constexpr int kDistanceCodes = 30;
+
+const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                    6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+const uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+// zlib's per-level search parameters: good_length, max_lazy, nice_length, max_chain
+const int kLevelConfig[10][4] = {
+    {0, 0, 0, 0},        {4, 4, 8, 4},        {4, 5, 16, 8},     {4, 6, 32, 32},
+    {4, 4, 16, 16},      {8, 16, 32, 32},     {8, 16, 128, 128}, {8, 32, 128, 256},
+    {32, 128, 258, 1024}, {32, 258, 258, 4096},
+};
+
+// Symbol lookup: match length - 3 to length code, distance to distance code
+struct CodeTables {
+    uint8_t length_code[256];
+    uint8_t distance_code[512];  // distance - 1 below 256, then (distance - 1) >> 7
+
+    CodeTables() {
+        for (int code = 0; code < 29; ++code) {
+            for (int i = 0; i < (1 << kLengthExtra[code]); ++i) {
+                int length = kLengthBase[code] + i - 3;
+                if (length < 256) {
+                    length_code[length] = static_cast<uint8_t>(code);
+                }
+            }
+        }
+        for (int code = 0; code < 30; ++code) {
+            for (int i = 0; i < (1 << kDistanceExtra[code]); ++i) {
+                int distance = kDistanceBase[code] + i - 1;
+                if (distance < 256) {
+                    distance_code[distance] = static_cast<uint8_t>(code);
+                } else {
+                    distance_code[256 + (distance >> 7)] = static_cast<uint8_t>(code);
+                }
+            }
+        }
+    }
+
+    int length(int length) const { return length_code[length - 3]; }
+    int distance(int distance) const {
+        return distance <= 256 ? distance_code[distance - 1] : distance_code[256 + ((distance - 1) >> 7)];
+    }
+};
+
+const CodeTables& code_tables() {
+    static const CodeTables tables;
+    return tables;
+}
+
+struct CrcTable {
+    uint32_t entries[8][256];
+
+    CrcTable() {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[0][n] = c;
+        }
+        for (int t = 1; t < 8; ++t) {
+            for (int n = 0; n < 256; ++n) {
+                uint32_t c = entries[t - 1][n];
+                entries[t][n] = entries[0][c & 0xFF] ^ (c >> 8);
+            }
+        }
+    }
+};
+
+// Bytes that match at the start of two words loaded little-endian; diff is
+// their xor and not zero
+int matching_bytes(uint64_t diff) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward64(&index, diff);
+    return static_cast<int>(index / 8);
+#else
+    return __builtin_ctzll(diff) / 8;
+#endif
+}
+
+uint32_t reverse_bits(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+// Huffman code lengths for the given symbol frequencies, no longer than max_bits.
+// Lengths beyond the limit are folded back as in miniz: overflowing codes move to
+// max_bits, then codes are lengthened one at a time until the Kraft sum is exact.
+void build_lengths(const uint32_t* freqs, int count, int max_bits, uint8_t* lengths) {
+    std::fill(lengths, lengths + count, 0);
+    std::vector<int> used;
+    for (int i = 0; i < count; ++i) {
+        if (freqs[i] != 0) {
+            used.push_back(i);
+        }
+    }
+    if (used.empty()) {
+        return;
+    }
+    if (used.size() == 1) {
+        // A complete code needs two symbols; some decoders insist
+        lengths[used[0]] = 1;
+        lengths[used[0] == 0 ? 1 : 0] = 1;
+        return;
+    }
+
+    // Plain Huffman tree over the used symbols, then each leaf's depth
+    struct Node {
+        uint32_t freq;
+        int index;
+    };
+    auto heavier = [](const Node& a, const Node& b) {
+        return a.freq != b.freq ? a.freq > b.freq : a.index > b.index;
+    };
+    std::priority_queue<Node, std::vector<Node>, decltype(heavier)> heap(heavier);
+    const int n = static_cast<int>(used.size());
+    std::vector<int> parent(2 * n - 1, -1);
+    for (int i = 0; i < n; ++i) {
+        heap.push({freqs[used[i]], i});
+    }
+    int next = n;
+    while (heap.size() > 1) {
+        Node a = heap.top();
+        heap.pop();
+        Node b = heap.top();
+        heap.pop();
+        parent[a.index] = next;
+        parent[b.index] = next;
+        heap.push({a.freq + b.freq, next++});
+    }
+    std::vector<int> depth(2 * n - 1, 0);
+    for (int i = 2 * n - 3; i >= 0; --i) {
+        depth[i] = depth[parent[i]] + 1;
+    }
+
+    int counts[64] = {0};
+    int longest = 0;
+    for (int i = 0; i < n; ++i) {
+        ++counts[depth[i]];
+        longest = std::max(longest, depth[i]);
+    }
+    if (longest > max_bits) {
+        for (int i = max_bits + 1; i <= longest; ++i) {
+            counts[max_bits] += counts[i];
+            counts[i] = 0;
+        }
+        uint32_t total = 0;
+        for (int i = max_bits; i > 0; --i) {
+            total += static_cast<uint32_t>(counts[i]) << (max_bits - i);
+        }
+        while (total != (1u << max_bits)) {
+            --counts[max_bits];
+            for (int i = max_bits - 1; i > 0; --i) {
+                if (counts[i] != 0) {
+                    --counts[i];
+                    counts[i + 1] += 2;
+                    break;
+                }
+            }
+            --total;
+        }
+    }
+
+    // Shortest lengths to the most frequent symbols
+    std::stable_sort(used.begin(), used.end(), [&](int a, int b) { return freqs[a] > freqs[b]; });
+    int pos = 0;
+    for (int length = 1; length <= max_bits; ++length) {
+        for (int i = 0; i < counts[length]; ++i) {
+            lengths[used[pos++]] = static_cast<uint8_t>(length);
+        }
+    }
+}
+
+// Canonical codes for the lengths, bit-reversed for LSB-first output
+void build_codes(const uint8_t* lengths, int count, uint16_t* codes) {
+    int sizes[16] = {0};
+    for (int i = 0; i < count; ++i) {
+        ++sizes[lengths[i]];
+    }
+    sizes[0] = 0;
+    uint32_t next_code[16] = {0};
+    uint32_t code = 0;
+    for (int i = 1; i < 16; ++i) {
+        code = (code + sizes[i - 1]) << 1;
+        next_code[i] = code;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (lengths[i] != 0) {
+            codes[i] = static_cast<uint16_t>(reverse_bits(next_code[lengths[i]]++, lengths[i]));
+        }
+    }
+}
+
+// Run-length code the literal and distance lengths with symbols 16-18.
+// Each entry is symbol | (extra bits value << 8).
+std::vector<uint16_t> encode_code_lengths(const uint8_t* lengths, int count) {
+    std::vector<uint16_t> out;
+    int i = 0;
+    while (i < count) {
+        int value = lengths[i];
+        int run = 1;
+        while (i + run < count && lengths[i + run] == value) {
+            ++run;
+        }
+        i += run;
+        if (value == 0) {
+            while (run >= 11) {
+                int n = std::min(run, 138);
+                out.push_back(static_cast<uint16_t>(18 | ((n - 11) << 8)));
+                run -= n;
+            }
+            if (run >= 3) {
+                out.push_back(static_cast<uint16_t>(17 | ((run - 3) << 8)));
+                run = 0;
+            }
+        } else {
+            out.push_back(static_cast<uint16_t>(value));
+            --run;
+            while (run >= 3) {
+                int n = std::min(run, 6);
+                out.push_back(static_cast<uint16_t>(16 | ((n - 3) << 8)));
+                run -= n;
+            }
+        }
+        while (run-- > 0) {
+            out.push_back(static_cast<uint16_t>(value));
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size) {
+    static const CrcTable table;
+    const auto& t = table.entries;
+    crc = ~crc;
+    // Slicing by 8: one table lookup per byte, eight bytes per step
+    while (size >= 8) {
+        uint32_t lo = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 |
+                             uint32_t(data[3]) << 24);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+uint32_t adler32(uint32_t adler, const unsigned char* data, size_t size) {
+    // 5552 is the most bytes that can be summed before the 32-bit sums overflow
+    constexpr size_t kMaxRun = 5552;
+    uint32_t a = adler & 0xFFFF;
+    uint32_t b = adler >> 16;
+    while (size > 0) {
+        size_t n = std::min(size, kMaxRun);
+        size -= n;
+        for (size_t i = 0; i < n; ++i) {
+            a += data[i];
+            b += a;
+        }
+        data += n;
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+uint32_t adler32_combine(uint32_t adler_a, uint32_t adler_b, size_t size_b) {
+    // As in zlib: B's sums shifted by A's, everything mod 65521
+    constexpr uint32_t kBase = 65521;
+    const uint32_t rem = static_cast<uint32_t>(size_b % kBase);
+    uint32_t sum1 = adler_a & 0xFFFF;
+    uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * sum1) % kBase);
+    sum1 += (adler_b & 0xFFFF) + kBase - 1;
+    sum2 += (adler_a >> 16) + (adler_b >> 16) + kBase - rem;
+    if (sum1 >= kBase) sum1 -= kBase;
+    if (sum1 >= kBase) sum1 -= kBase;
+    if (sum2 >= 2 * kBase) sum2 -= 2 * kBase;
+    if (sum2 >= kBase) sum2 -= kBase;
+    return sum1 | (sum2 << 16);
+}
+
+void zlib_header(int level, unsigned char header[2]) {
+    // CMF: deflate with a 32 KiB window; FLG: level hint, check bits to a multiple of 31
+    int level_hint = level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3;
+    int cmf = 0x78;
+    int flg = level_hint << 6;
+    flg += 31 - (cmf * 256 + flg) % 31;
+    header[0] = static_cast<unsigned char>(cmf);
+    header[1] = static_cast<unsigned char>(flg);
+}
+
+Deflater::Deflater(int level, Sink sink, bool zlib_header)
+    : sink_(std::move(sink)), level_(level), zlib_header_(zlib_header) {
+    if (level < 0 || level > 9) {
+        throw std::invalid_argument("Compression level must be between 0 and 9.");
+    }
+    good_length_ = kLevelConfig[level][0];
+    max_lazy_ = kLevelConfig[level][1];
+    nice_length_ = kLevelConfig[level][2];
+    max_chain_ = kLevelConfig[level][3];
+
+    // Room past the end so match comparisons can over-read
+    window_.assign(2 * kWindowSize + kMaxMatch + 8, 0);
+    if (level > 0) {
+        head_.assign(kHashSize, 0);
+        prev_.assign(kWindowSize, 0);
+        sym_distance_.resize(kSymbolBufferSize);
+        sym_value_.resize(kSymbolBufferSize);
+    }
+}
+
+void Deflater::write_header() {
+    header_written_ = true;
+    if (zlib_header_) {
+        unsigned char header[2];
+        zlib_header(level_, header);
+        out_.insert(out_.end(), header, header + 2);
+    }
+}
+
+void Deflater::put_bits(uint32_t value, int count) {
+    bits_ |= static_cast<uint64_t>(value) << bit_count_;
+    bit_count_ += count;
+    while (bit_count_ >= 8) {
+        out_.push_back(static_cast<unsigned char>(bits_));
+        bits_ >>= 8;
+        bit_count_ -= 8;
+    }
+}
+
+void Deflater::align_to_byte() {
+    if (bit_count_ > 0) {
+        put_bits(0, 8 - bit_count_);
+    }
+}
+
+// Hand finished output to the sink
+void Deflater::drain() {
+    if (!out_.empty()) {
+        sink_(out_.data(), out_.size());
+        out_.clear();
+    }
+}
+
+// Move the upper half of the window down and rebase the hash chains
+void Deflater::slide_window() {
+    if (block_start_ < kWindowSize) {
+        // The pending block's input is about to be discarded: send it first
+        flush_block(false);
+    }
+    std::memcpy(window_.data(), window_.data() + kWindowSize, kWindowSize);
+    strstart_ -= kWindowSize;
+    match_start_ -= kWindowSize;
+    block_start_ -= kWindowSize;
+    for (auto& pos : head_) {
+        pos = pos >= kWindowSize ? static_cast<uint16_t>(pos - kWindowSize) : 0;
+    }
+    for (auto& pos : prev_) {
+        pos = pos >= kWindowSize ? static_cast<uint16_t>(pos - kWindowSize) : 0;
+    }
+}
+
+// Add the 3 bytes at pos to the hash chains; returns the previous chain head
+uint16_t Deflater::insert_string(size_t pos) {
+    const unsigned char* p = window_.data() + pos;
+    uint32_t hash = ((uint32_t(p[0]) << 10) ^ (uint32_t(p[1]) << 5) ^ p[2]) & (kHashSize - 1);
+    uint16_t match = head_[hash];
+    prev_[pos & kWindowMask] = match;
+    head_[hash] = static_cast<uint16_t>(pos);
+    return match;
+}
+
+// Longest match for strstart_ along the hash chain, longer than prev_length_
+int Deflater::longest_match(int cur_match) {
+    int chain = max_chain_;
+    if (prev_length_ >= good_length_) {
+        chain >>= 2;
+    }
+    const int max_length = static_cast<int>(std::min<size_t>(kMaxMatch, lookahead_));
+    const int nice = std::min(nice_length_, max_length);
+    const int limit = strstart_ > static_cast<size_t>(kMaxDistance) ? static_cast<int>(strstart_) - kMaxDistance : 0;
+    const unsigned char* scan = window_.data() + strstart_;
+    int best_length = prev_length_;
+
+    do {
+        const unsigned char* match = window_.data() + cur_match;
+        // Cheap rejections: the byte that would make this match longer, then the start
+        if (match[best_length] != scan[best_length] || match[best_length - 1] != scan[best_length - 1] ||
+            match[0] != scan[0] || match[1] != scan[1]) {
+            continue;
+        }
+        // Compare 8 bytes at a time; the window's slack covers reading past the end
+        int length = 2;
+        while (length < max_length) {
+            uint64_t a;
+            uint64_t b;
+            std::memcpy(&a, match + length, 8);
+            std::memcpy(&b, scan + length, 8);
+            uint64_t diff = a ^ b;
+            if (diff != 0) {
+                length += matching_bytes(diff);
+                break;
+            }
+            length += 8;
+        }
+        length = std::min(length, max_length);
+        if (length > best_length) {
+            match_start_ = cur_match;
+            best_length = length;
+            if (length >= nice) {
+                break;
+            }
+        }
+    } while ((cur_match = prev_[cur_match & kWindowMask]) > limit && --chain != 0);
+
+    return std::min(best_length, max_length);
+}
+
+void Deflater::tally(int distance, int value) {
+    sym_distance_[sym_count_] = static_cast<uint16_t>(distance);
+    sym_value_[sym_count_] = static_cast<uint16_t>(value);
+    ++sym_count_;
+}
+
+// Greedy matching for the fast levels (zlib's deflate_fast)
+void Deflater::compress_fast(bool flush) {
+    while (lookahead_ >= static_cast<size_t>(kMinLookahead) || (flush && lookahead_ > 0)) {
+        int hash_head = 0;
+        if (lookahead_ >= static_cast<size_t>(kMinMatch)) {
+            hash_head = insert_string(strstart_);
+        }
+        match_length_ = kMinMatch - 1;
+        if (hash_head != 0 && strstart_ - hash_head <= static_cast<size_t>(kMaxDistance)) {
+            prev_length_ = kMinMatch - 1;
+            match_length_ = longest_match(hash_head);
+        }
+        if (match_length_ >= kMinMatch) {
+            tally(static_cast<int>(strstart_) - match_start_, match_length_);
+            lookahead_ -= match_length_;
+            if (match_length_ <= max_lazy_ && lookahead_ >= static_cast<size_t>(kMinMatch)) {
+                // Short match: hash the positions it covers too
+                while (--match_length_ != 0) {
+                    insert_string(++strstart_);
+                }
+                ++strstart_;
+            } else {
+                strstart_ += match_length_;
+            }
+        } else {
+            tally(0, window_[strstart_]);
+            --lookahead_;
+            ++strstart_;
+        }
+        if (sym_count_ == kSymbolBufferSize) {
+            flush_block(false);
+        }
+    }
+}
+
+// Lazy matching: only take a match if the next position does not start a
+// longer one (zlib's deflate_slow)
+void Deflater::compress_lazy(bool flush) {
+    while (lookahead_ >= static_cast<size_t>(kMinLookahead) || (flush && lookahead_ > 0)) {
+        int hash_head = 0;
+        if (lookahead_ >= static_cast<size_t>(kMinMatch)) {
+            hash_head = insert_string(strstart_);
+        }
+        prev_length_ = match_length_;
+        prev_match_ = match_start_;
+        match_length_ = kMinMatch - 1;
+
+        if (hash_head != 0 && prev_length_ < max_lazy_ && strstart_ - hash_head <= static_cast<size_t>(kMaxDistance)) {
+            match_length_ = longest_match(hash_head);
+            if (match_length_ == kMinMatch && static_cast<int>(strstart_) - match_start_ > kTooFar) {
+                match_length_ = kMinMatch - 1;
+            }
+        }
+
+        if (prev_length_ >= kMinMatch && match_length_ <= prev_length_) {
+            // The previous position's match wins
+            size_t max_insert = strstart_ + lookahead_ - kMinMatch;
+            tally(static_cast<int>(strstart_) - 1 - prev_match_, prev_length_);
+            lookahead_ -= prev_length_ - 1;
+            prev_length_ -= 2;
+            do {
+                if (++strstart_ <= max_insert) {
+                    insert_string(strstart_);
+                }
+            } while (--prev_length_ != 0);
+            match_available_ = false;
+            match_length_ = kMinMatch - 1;
+            ++strstart_;
+            if (sym_count_ == kSymbolBufferSize) {
+                flush_block(false);
+            }
+        } else if (match_available_) {
+            tally(0, window_[strstart_ - 1]);
+            ++strstart_;
+            --lookahead_;
+            if (sym_count_ == kSymbolBufferSize) {
+                flush_block(false);
+            }
+        } else {
+            match_available_ = true;
+            ++strstart_;
+            --lookahead_;
+        }
+    }
+    if (flush && match_available_) {
+        tally(0, window_[strstart_ - 1]);
+        match_available_ = false;
+    }
+}
+
+void Deflater::compress(bool flush) {
+    if (level_ >= 4) {
+        compress_lazy(flush);
+    } else {
+        compress_fast(flush);
+    }
+}
+
+void Deflater::write_stored(const unsigned char* data, size_t size, bool last) {
+    do {
+        size_t n = std::min(size, kMaxStoredBlock);
+        size -= n;
+        put_bits(last && size == 0 ? 1 : 0, 3);
+        align_to_byte();
+        put_bits(static_cast<uint32_t>(n), 16);
+        put_bits(static_cast<uint32_t>(n ^ 0xFFFF), 16);
+        out_.insert(out_.end(), data, data + n);
+        data += n;
+    } while (size > 0);
+}
+
+// Emit the symbols gathered since block_start_ as one block, in whichever of
+// the three block types is smallest
+void Deflater::flush_block(bool last) {
+    const CodeTables& tables = code_tables();
+    // With a lazy match pending, the byte before the cursor belongs to the next block
+    const size_t block_end = strstart_ - (match_available_ ? 1 : 0);
+    const size_t stored_size = block_end - block_start_;
+
+    uint32_t literal_freqs[kLiteralCodes] = {0};
+    uint32_t distance_freqs[kDistanceCodes] = {0};
+    uint64_t extra_bits = 0;
+    for (size_t i = 0; i < sym_count_; ++i) {
+        if (sym_distance_[i] == 0) {
+            ++literal_freqs[sym_value_[i]];
+        } else {
+            int length_code = tables.length(sym_value_[i]);
+            int distance_code = tables.distance(sym_distance_[i]);
+            ++literal_freqs[257 + length_code];
+            ++distance_freqs[distance_code];
+            extra_bits += kLengthExtra[length_code] + kDistanceExtra[distance_code];
+        }
+    }
+    literal_freqs[256] = 1;
+
+    uint8_t literal_lengths[kLiteralCodes];
+    uint8_t distance_lengths[kDistanceCodes];
+    build_lengths(literal_freqs, kLiteralCodes, 15, literal_lengths);
+    build_lengths(distance_freqs, kDistanceCodes, 15, distance_lengths);
+    if (std::all_of(distance_lengths, distance_lengths + kDistanceCodes, [](uint8_t l) { return l == 0; })) {
+        // No matches: still send one distance code, as zlib does
+        distance_lengths[0] = 1;
+        distance_lengths[1] = 1;
+    }
+
+    int literal_count = kLiteralCodes;
+    while (literal_count > 257 && literal_lengths[literal_count - 1] == 0) {
+        --literal_count;
+    }
+    int distance_count = kDistanceCodes;
+    while (distance_count > 1 && distance_lengths[distance_count - 1] == 0) {
+        --distance_count;
+    }
+
+    uint8_t all_lengths[kLiteralCodes + kDistanceCodes];
+    std::memcpy(all_lengths, literal_lengths, literal_count);
+    std::memcpy(all_lengths + literal_count, distance_lengths, distance_count);
+    std::vector<uint16_t> runs = encode_code_lengths(all_lengths, literal_count + distance_count);
+
+    uint32_t code_length_freqs[19] = {0};
+    for (uint16_t run : runs) {
+        ++code_length_freqs[run & 0xFF];
+    }
+    uint8_t code_length_lengths[19];
+    build_lengths(code_length_freqs, 19, 7, code_length_lengths);
+    int code_length_count = 19;
+    while (code_length_count > 4 && code_length_lengths[kCodeLengthOrder[code_length_count - 1]] == 0) {
+        --code_length_count;
+    }
+
+    // Sizes in bits of the three candidates
+    uint64_t dynamic_bits = 3 + 5 + 5 + 4 + 3 * code_length_count + extra_bits;
+    for (int i = 0; i < 19; ++i) {
+        dynamic_bits += static_cast<uint64_t>(code_length_freqs[i]) * code_length_lengths[i];
+    }
+    dynamic_bits += code_length_freqs[16] * 2 + code_length_freqs[17] * 3 + code_length_freqs[18] * 7;
+    uint64_t fixed_bits = 3 + extra_bits;
+    for (int i = 0; i < kLiteralCodes; ++i) {
+        dynamic_bits += static_cast<uint64_t>(literal_freqs[i]) * literal_lengths[i];
+        fixed_bits += static_cast<uint64_t>(literal_freqs[i]) * (i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8);
+    }
+    for (int i = 0; i < kDistanceCodes; ++i) {
+        dynamic_bits += static_cast<uint64_t>(distance_freqs[i]) * distance_lengths[i];
+        fixed_bits += static_cast<uint64_t>(distance_freqs[i]) * 5;
+    }
+    uint64_t stored_bits = (stored_size / kMaxStoredBlock + 1) * (3 + 7 + 32) + stored_size * 8;
+
+    if (stored_bits <= std::min(dynamic_bits, fixed_bits)) {
+        write_stored(window_.data() + block_start_, stored_size, last);
+    } else {
+        uint8_t fixed_literal[288];
+        uint8_t fixed_distance[kDistanceCodes];
+        const uint8_t* lit_lengths = literal_lengths;
+        const uint8_t* dist_lengths = distance_lengths;
+        if (fixed_bits <= dynamic_bits) {
+            std::fill(fixed_literal, fixed_literal + 144, 8);
+            std::fill(fixed_literal + 144, fixed_literal + 256, 9);
+            std::fill(fixed_literal + 256, fixed_literal + 280, 7);
+            std::fill(fixed_literal + 280, fixed_literal + 288, 8);
+            std::fill(fixed_distance, fixed_distance + kDistanceCodes, 5);
+            lit_lengths = fixed_literal;
+            dist_lengths = fixed_distance;
+            put_bits(last ? 1 : 0, 1);
+            put_bits(1, 2);
+        } else {
+            put_bits(last ? 1 : 0, 1);
+            put_bits(2, 2);
+            put_bits(literal_count - 257, 5);
+            put_bits(distance_count - 1, 5);
+            put_bits(code_length_count - 4, 4);
+            for (int i = 0; i < code_length_count; ++i) {
+                put_bits(code_length_lengths[kCodeLengthOrder[i]], 3);
+            }
+            uint16_t code_length_codes[19] = {0};
+            build_codes(code_length_lengths, 19, code_length_codes);
+            for (uint16_t run : runs) {
+                int symbol = run & 0xFF;
+                put_bits(code_length_codes[symbol], code_length_lengths[symbol]);
+                if (symbol >= 16) {
+                    put_bits(run >> 8, symbol == 16 ? 2 : symbol == 17 ? 3 : 7);
+                }
+            }
+        }
+
+        uint16_t literal_codes[288] = {0};
+        uint16_t distance_codes[kDistanceCodes] = {0};
+        // The fixed code is defined over all 288 symbols, 286 and 287 included
+        build_codes(lit_lengths, lit_lengths == fixed_literal ? 288 : kLiteralCodes, literal_codes);
+        build_codes(dist_lengths, kDistanceCodes, distance_codes);
+        for (size_t i = 0; i < sym_count_; ++i) {
+            int distance = sym_distance_[i];
+            int value = sym_value_[i];
+            if (distance == 0) {
+                put_bits(literal_codes[value], lit_lengths[value]);
+                continue;
+            }
+            int length_code = tables.length(value);
+            put_bits(literal_codes[257 + length_code], lit_lengths[257 + length_code]);
+            put_bits(value - kLengthBase[length_code], kLengthExtra[length_code]);
+            int distance_code = tables.distance(distance);
+            put_bits(distance_codes[distance_code], dist_lengths[distance_code]);
+            put_bits(distance - kDistanceBase[distance_code], kDistanceExtra[distance_code]);
+        }
+        put_bits(literal_codes[256], lit_lengths[256]);
+    }
+
+    sym_count_ = 0;
+    block_start_ = static_cast<long>(block_end);
+    if (out_.size() >= kOutputChunk) {
+        drain();
+    }
+}
+
+void Deflater::set_dictionary(const unsigned char* data, size_t size) {
+    if (header_written_) {
+        throw std::logic_error("Deflater: dictionary set after writing.");
+    }
+    if (level_ == 0) {
+        return;  // stored blocks never refer back
+    }
+    size_t n = std::min<size_t>(size, kWindowSize);
+    std::memcpy(window_.data(), data + size - n, n);
+    for (size_t pos = 0; pos + kMinMatch <= n; ++pos) {
+        insert_string(pos);
+    }
+    strstart_ = n;
+    block_start_ = static_cast<long>(n);
+}
+
+void Deflater::write(const unsigned char* data, size_t size) {
+    if (finished_) {
+        throw std::logic_error("Deflater: write after finish.");
+    }
+    if (!header_written_) {
+        write_header();
+    }
+    adler_ = adler32(adler_, data, size);
+
+    if (level_ == 0) {
+        // Stored blocks straight from the input, buffered up to the block limit
+        while (size > 0) {
+            size_t n = std::min(size, kMaxStoredBlock - lookahead_);
+            std::memcpy(window_.data() + lookahead_, data, n);
+            lookahead_ += n;
+            data += n;
+            size -= n;
+            if (lookahead_ == kMaxStoredBlock) {
+                write_stored(window_.data(), lookahead_, false);
+                lookahead_ = 0;
+                drain();
+            }
+        }
+        return;
+    }
+
+    while (size > 0) {
+        if (strstart_ >= static_cast<size_t>(2 * kWindowSize - kMinLookahead)) {
+            slide_window();
+        }
+        size_t space = 2 * kWindowSize - (strstart_ + lookahead_);
+        size_t n = std::min(space, size);
+        std::memcpy(window_.data() + strstart_ + lookahead_, data, n);
+        lookahead_ += n;
+        data += n;
+        size -= n;
+        compress(false);
+    }
+}
+
+void Deflater::sync_flush() {
+    if (finished_) {
+        throw std::logic_error("Deflater: flush after finish.");
+    }
+    if (!header_written_) {
+        write_header();
+    }
+    if (level_ == 0) {
+        write_stored(window_.data(), lookahead_, false);
+        lookahead_ = 0;
+    } else {
+        compress(true);
+        if (sym_count_ > 0) {
+            flush_block(false);
+        }
+        write_stored(nullptr, 0, false);
+    }
+    drain();
+}
+
+void Deflater::finish() {
+    if (finished_) {
+        return;
+    }
+    if (!header_written_) {
+        write_header();
+    }
+    if (level_ == 0) {
+        write_stored(window_.data(), lookahead_, true);
+        lookahead_ = 0;
+    } else {
+        compress(true);
+        flush_block(true);
+    }
+    align_to_byte();
+    if (zlib_header_) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out_.push_back(static_cast<unsigned char>(adler_ >> shift));
+        }
+    }
+    finished_ = true;
+    drain();
+}
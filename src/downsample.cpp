@@ -0,0 +1,104 @@
+#include "../include/downsample.h"
+#include "../include/simd_kernels.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Rounded mean of the sums in acc over blocks of factor_x columns, each block
+// covering `rows` source rows
+void reduce_columns(const uint32_t* acc, unsigned char* out, int width, int channels, int factor_x, int rows) {
+    int out_width = downsampled_size(width, factor_x);
+    for (int ox = 0; ox < out_width; ++ox) {
+        int x_begin = ox * factor_x;
+        int x_end = std::min(width, x_begin + factor_x);
+        uint32_t count = static_cast<uint32_t>((x_end - x_begin) * rows);
+        for (int c = 0; c < channels; ++c) {
+            uint32_t sum = 0;
+            for (int x = x_begin; x < x_end; ++x) {
+                sum += acc[x * channels + c];
+            }
+            out[ox * channels + c] = static_cast<unsigned char>((sum + count / 2) / count);
+        }
+    }
+}
+
+// Any factor: add up each block's rows, then reduce the columns
+void downsample_rows(const unsigned char* src, int width, int height, std::ptrdiff_t src_stride,
+                     unsigned char* dst, std::ptrdiff_t dst_stride, int channels, int factor_x, int factor_y,
+                     int oy_begin, int oy_end) {
+    const size_t row_len = static_cast<size_t>(width) * channels;
+    std::vector<uint32_t> acc(row_len);
+    for (int oy = oy_begin; oy < oy_end; ++oy) {
+        int y_begin = oy * factor_y;
+        int y_end = std::min(height, y_begin + factor_y);
+        std::fill(acc.begin(), acc.end(), 0u);
+        for (int y = y_begin; y < y_end; ++y) {
+            const unsigned char* in = src + y * src_stride;
+            for (size_t i = 0; i < row_len; ++i) {
+                acc[i] += in[i];
+            }
+        }
+        reduce_columns(acc.data(), dst + oy * dst_stride, width, channels, factor_x, y_end - y_begin);
+    }
+}
+
+// 2x2: full blocks through the SIMD kernel, the odd last column / row by hand
+void downsample2x_rows(const unsigned char* src, int width, int height, std::ptrdiff_t src_stride,
+                       unsigned char* dst, std::ptrdiff_t dst_stride, int channels, int oy_begin, int oy_end) {
+    const int full_columns = width / 2;
+    for (int oy = oy_begin; oy < oy_end; ++oy) {
+        const unsigned char* row0 = src + 2 * oy * src_stride;
+        unsigned char* out = dst + oy * dst_stride;
+        if (2 * oy + 1 >= height) {
+            downsample_rows(src, width, height, src_stride, dst, dst_stride, channels, 2, 2, oy, oy + 1);
+            continue;
+        }
+        const unsigned char* row1 = row0 + src_stride;
+        downsample2x_row(row0, row1, out, full_columns, channels);
+        if (width % 2 != 0) {
+            const unsigned char* a = row0 + (width - 1) * channels;
+            const unsigned char* b = row1 + (width - 1) * channels;
+            for (int c = 0; c < channels; ++c) {
+                out[full_columns * channels + c] = static_cast<unsigned char>((a[c] + b[c] + 1) / 2);
+            }
+        }
+    }
+}
+
+} // namespace
+
+int downsampled_size(int size, int factor) {
+    return (size + factor - 1) / factor;
+}
+
+void downsample(const unsigned char* src, int width, int height, std::ptrdiff_t src_stride,
+                unsigned char* dst, std::ptrdiff_t dst_stride, int channels, int factor_x, int factor_y) {
+    if (factor_x < 1 || factor_y < 1) {
+        throw std::invalid_argument("Downsample factors must be positive.");
+    }
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        return;
+    }
+
+    const int out_height = downsampled_size(height, factor_y);
+    const size_t row_len = static_cast<size_t>(width) * channels;
+    const int min_rows = static_cast<int>(std::max<size_t>(1, (1 << 16) / (row_len * factor_y)));
+
+    parallel_rows(out_height, [&](int oy_begin, int oy_end) {
+        if (factor_x == 1 && factor_y == 1) {
+            for (int y = oy_begin; y < oy_end; ++y) {
+                std::memcpy(dst + y * dst_stride, src + y * src_stride, row_len);
+            }
+        } else if (factor_x == 2 && factor_y == 2) {
+            downsample2x_rows(src, width, height, src_stride, dst, dst_stride, channels, oy_begin, oy_end);
+        } else {
+            downsample_rows(src, width, height, src_stride, dst, dst_stride, channels, factor_x, factor_y, oy_begin, oy_end);
+        }
+    }, min_rows);
+}
@@ -0,0 +1,29 @@
+#include "../include/image_allocator.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+class MallocAllocator : public ImageAllocator {
+public:
+    unsigned char* allocate(size_t bytes) override {
+        void* data = std::malloc(bytes > 0 ? bytes : 1);
+        if (data == nullptr) {
+            throw std::bad_alloc();
+        }
+        return static_cast<unsigned char*>(data);
+    }
+
+    void deallocate(unsigned char* data, size_t bytes) override {
+        (void)bytes;
+        std::free(data);
+    }
+};
+
+} // namespace
+
+std::shared_ptr<ImageAllocator> default_image_allocator() {
+    static const std::shared_ptr<ImageAllocator> allocator = std::make_shared<MallocAllocator>();
+    return allocator;
+}
@@ -0,0 +1,312 @@
+#include "../include/image_pipeline.h"
+#include "../include/downsample.h"
+#include "../include/point_pipeline.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+struct Step {
+    std::string text;  // as written, for error messages
+    std::string name;
+    std::vector<double> args;
+};
+
+struct StepInfo {
+    const char* name;
+    int min_args;
+    int max_args;
+    bool point;      // folds into a lookup table
+    bool per_pixel;  // output pixel depends on the same input pixel only
+};
+
+const StepInfo kSteps[] = {
+    {"grayscale", 0, 0, false, true},
+    {"sepia", 0, 0, false, true},
+    {"invert", 0, 0, true, true},
+    {"brightness", 1, 1, true, true},
+    {"contrast", 1, 1, true, true},
+    {"gamma", 1, 1, true, true},
+    {"threshold", 1, 1, true, true},
+    {"otsu", 0, 0, false, false},
+    {"hough", 0, 0, false, false},
+    {"lowpass", 1, 1, false, false},
+    {"highpass", 1, 1, false, false},
+    {"adaptive_threshold", 2, 2, false, false},
+    {"local_contrast", 2, 2, false, false},
+    {"normalize", 1, 1, false, false},
+    {"resize", 1, 2, false, false},
+    {"downsample", 1, 1, false, false},
+    {"crop", 4, 4, false, false},
+};
+
+std::string trim(const std::string& text) {
+    size_t begin = 0;
+    size_t end = text.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+[[noreturn]] void bad_step(const Step& step, const std::string& reason) {
+    throw std::invalid_argument("Pipeline step '" + step.text + "': " + reason);
+}
+
+const StepInfo& info(const Step& step) {
+    for (const StepInfo& candidate : kSteps) {
+        if (step.name == candidate.name) {
+            return candidate;
+        }
+    }
+    bad_step(step, "unknown operation");
+}
+
+int int_arg(const Step& step, size_t index, int min_value, int max_value = INT32_MAX) {
+    const double value = step.args[index];
+    if (value != std::floor(value) || value < min_value || value > max_value) {
+        bad_step(step, "argument " + std::to_string(index + 1) + " must be an integer from " +
+                           std::to_string(min_value) + (max_value == INT32_MAX ? " up" : " to " + std::to_string(max_value)));
+    }
+    return static_cast<int>(value);
+}
+
+float positive_arg(const Step& step, size_t index) {
+    if (!(step.args[index] > 0)) {
+        bad_step(step, "argument " + std::to_string(index + 1) + " must be positive");
+    }
+    return static_cast<float>(step.args[index]);
+}
+
+std::vector<Step> parse_steps(const std::string& spec) {
+    std::vector<Step> steps;
+    std::string item;
+    std::istringstream lines(spec);
+    std::string line;
+    while (std::getline(lines, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream items(line);
+        while (std::getline(items, item, ',')) {
+            Step step;
+            step.text = trim(item);
+            if (step.text.empty()) {
+                continue;
+            }
+            std::istringstream fields(step.text);
+            std::string field;
+            std::getline(fields, field, ':');
+            step.name = trim(field);
+            std::transform(step.name.begin(), step.name.end(), step.name.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            while (std::getline(fields, field, ':')) {
+                field = trim(field);
+                size_t used = 0;
+                double value = 0;
+                try {
+                    value = std::stod(field, &used);
+                } catch (const std::exception&) {
+                    used = 0;
+                }
+                if (used == 0 || used != field.size() || !std::isfinite(value)) {
+                    bad_step(step, "'" + field + "' is not a number");
+                }
+                step.args.push_back(value);
+            }
+            const StepInfo& step_info = info(step);
+            const int count = static_cast<int>(step.args.size());
+            if (count < step_info.min_args || count > step_info.max_args) {
+                bad_step(step, step_info.min_args == step_info.max_args
+                                   ? "takes " + std::to_string(step_info.min_args) + " argument(s)"
+                                   : "takes " + std::to_string(step_info.min_args) + " to " +
+                                         std::to_string(step_info.max_args) + " arguments");
+            }
+            steps.push_back(std::move(step));
+        }
+    }
+    if (steps.empty()) {
+        throw std::invalid_argument("Pipeline has no steps.");
+    }
+    return steps;
+}
+
+// Crops first: every per-pixel step then only sees the pixels that survive
+void move_crops_forward(std::vector<Step>& steps) {
+    for (size_t i = 1; i < steps.size(); ++i) {
+        if (steps[i].name != "crop") {
+            continue;
+        }
+        for (size_t j = i; j > 0 && info(steps[j - 1]).per_pixel; --j) {
+            std::swap(steps[j], steps[j - 1]);
+        }
+    }
+}
+
+void add_point_step(PointPipeline& points, const Step& step) {
+    if (step.name == "invert") {
+        points.invert();
+    } else if (step.name == "brightness") {
+        points.brightness(int_arg(step, 0, -255, 255));
+    } else if (step.name == "contrast") {
+        points.contrast(static_cast<float>(step.args[0]));
+    } else if (step.name == "gamma") {
+        points.gamma(positive_arg(step, 0));
+    } else if (step.name == "threshold") {
+        points.threshold(static_cast<unsigned char>(int_arg(step, 0, 0, 255)));
+    }
+}
+
+// Run fn(in, out) into a new image of in's size from pool
+template <typename Fn>
+std::function<Image(Image)> filter_stage(std::shared_ptr<BufferPool> pool, Fn fn) {
+    return [pool, fn](Image image) {
+        Image out = Image::uninitialized(image.width, image.height, image.channels, pool);
+        fn(image, out);
+        return out;
+    };
+}
+
+} // namespace
+
+ImagePipeline ImagePipeline::parse(const std::string& spec) {
+    std::vector<Step> steps = parse_steps(spec);
+    move_crops_forward(steps);
+
+    ImagePipeline pipeline;
+    pipeline.pool_ = default_buffer_pool();
+    std::shared_ptr<BufferPool> pool = pipeline.pool_;
+
+    PointPipeline points;
+    std::string point_names;
+    auto flush_points = [&] {
+        if (points.empty()) {
+            return;
+        }
+        PointPipeline lut = points;
+        pipeline.stages_.push_back({"lut(" + point_names + ")", [lut](Image image) {
+            lut.apply(image);
+            return image;
+        }});
+        points = PointPipeline();
+        point_names.clear();
+    };
+
+    for (const Step& step : steps) {
+        if (info(step).point) {
+            add_point_step(points, step);
+            point_names += (point_names.empty() ? "" : ", ") + step.name;
+            continue;
+        }
+        flush_points();
+
+        std::function<Image(Image)> run;
+        const std::string& name = step.name;
+        if (name == "grayscale") {
+            run = [](Image image) {
+                if (image.channels >= 3) {
+                    image.convert_to_grayscale();
+                }
+                return image;
+            };
+        } else if (name == "sepia") {
+            run = [](Image image) {
+                image.convert_to_sepia();
+                return image;
+            };
+        } else if (name == "otsu") {
+            run = filter_stage(pool, [](Image& in, Image& out) { in.otsu_threshold(in.view(), out.view()); });
+        } else if (name == "hough") {
+            run = filter_stage(pool, [](Image& in, Image& out) { in.hough_transform(in.view(), out.view()); });
+        } else if (name == "lowpass") {
+            const int size = int_arg(step, 0, 0);
+            run = filter_stage(pool, [size](Image& in, Image& out) { in.low_pass_filter(in.view(), out.view(), size); });
+        } else if (name == "highpass") {
+            const int size = int_arg(step, 0, 2, 3);  // the kernel is 3x3
+            run = filter_stage(pool, [size](Image& in, Image& out) { in.high_pass_filter(in.view(), out.view(), size); });
+        } else if (name == "adaptive_threshold") {
+            const int block = int_arg(step, 0, 1);
+            const int offset = int_arg(step, 1, -255, 255);
+            run = filter_stage(pool, [block, offset](Image& in, Image& out) {
+                in.adaptive_threshold(in.view(), out.view(), block, offset);
+            });
+        } else if (name == "local_contrast") {
+            const int window = int_arg(step, 0, 1);
+            const float strength = static_cast<float>(step.args[1]);
+            run = filter_stage(pool, [window, strength](Image& in, Image& out) {
+                in.enhance_local_contrast(in.view(), out.view(), window, strength);
+            });
+        } else if (name == "normalize") {
+            const int window = int_arg(step, 0, 1);
+            run = filter_stage(pool, [window](Image& in, Image& out) {
+                in.normalize_local_contrast(in.view(), out.view(), window);
+            });
+        } else if (name == "resize") {
+            const bool scaled = step.args.size() == 1;
+            const double scale = scaled ? positive_arg(step, 0) : 0;
+            const int width = scaled ? 0 : int_arg(step, 0, 1);
+            const int height = scaled ? 0 : int_arg(step, 1, 1);
+            run = [pool, scaled, scale, width, height](Image image) {
+                const int w = scaled ? std::max(1, static_cast<int>(std::lround(image.width * scale))) : width;
+                const int h = scaled ? std::max(1, static_cast<int>(std::lround(image.height * scale))) : height;
+                const ResizeFilter filter = w <= image.width && h <= image.height ? ResizeFilter::Area : ResizeFilter::Bilinear;
+                Image out = Image::uninitialized(w, h, image.channels, pool);
+                image.resize_image(image.view(), out.view(), filter);
+                return out;
+            };
+        } else if (name == "downsample") {
+            const int factor = int_arg(step, 0, 1);
+            run = [pool, factor](Image image) {
+                Image out = Image::uninitialized(downsampled_size(image.width, factor),
+                                                 downsampled_size(image.height, factor), image.channels, pool);
+                image.downsample_image(image.view(), out.view(), factor);
+                return out;
+            };
+        } else if (name == "crop") {
+            const Rect rect{int_arg(step, 0, 0), int_arg(step, 1, 0), int_arg(step, 2, 1), int_arg(step, 3, 1)};
+            run = [pool, rect](Image image) { return image.crop(rect, pool); };
+        }
+        std::string description = name;
+        for (double arg : step.args) {
+            std::ostringstream text;
+            text << arg;
+            description += ":" + text.str();
+        }
+        pipeline.stages_.push_back({description, std::move(run)});
+    }
+    flush_points();
+    return pipeline;
+}
+
+ImagePipeline ImagePipeline::load(const std::string& config_path) {
+    std::ifstream file(config_path);
+    if (!file) {
+        throw std::runtime_error("Error reading pipeline config: " + config_path);
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    return parse(text.str());
+}
+
+Image ImagePipeline::run(Image image) const {
+    for (const Stage& stage : stages_) {
+        image = stage.run(std::move(image));
+    }
+    return image;
+}
+
+std::string ImagePipeline::describe() const {
+    std::string text;
+    for (const Stage& stage : stages_) {
+        text += (text.empty() ? "" : " -> ") + stage.description;
+    }
+    return text;
+}
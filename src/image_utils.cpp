@@ -1,79 +1,354 @@
 #include "../include/image_utils.h"
+#include "../include/box_blur.h"
+#include "../include/crop.h"
+#include "../include/integral_image.h"
+#include "../include/downsample.h"
+#include "../include/thread_pool.h"
+#include "../include/simd_kernels.h"
+#include "../include/lut.h"
+#include "../include/mapped_image.h"
+#include "../include/profiler.h"
 
 
 #include <stdexcept>
+#include <climits>
 #include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../stb_image/stb_image.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../stb_image/stb_image_write.h"
 
+namespace {
+
+// Pixel bytes and pixels of a view, for the profile
+template <typename T>
+size_t view_bytes(const BasicImageView<T>& view) {
+    return view.row_bytes() * view.height;
+}
+
+template <typename T>
+size_t view_pixels(const BasicImageView<T>& view) {
+    return static_cast<size_t>(view.width) * view.height;
+}
+
+size_t file_bytes(const std::string& path) {
+    std::error_code error;
+    const auto size = std::filesystem::file_size(path, error);
+    return error ? 0 : static_cast<size_t>(size);
+}
+
+// Rows per band so that a band covers at least kMinChunkBytes
+int min_band_rows(int width, int channels) {
+    size_t row_bytes = std::max<size_t>(1, static_cast<size_t>(width) * channels);
+    return static_cast<int>(std::max<size_t>(1, kMinChunkBytes / row_bytes));
+}
+
+// Per-channel products for a 3x3 colour matrix, one 256-entry table per
+// coefficient. Summing table entries gives bit-for-bit the same doubles as
+// multiplying per pixel, without the multiplies.
+struct ColorTables {
+    double weight[3][3][256];
+
+    explicit ColorTables(const double (&matrix)[3][3]) {
+        for (int out = 0; out < 3; ++out) {
+            for (int in = 0; in < 3; ++in) {
+                for (int v = 0; v < 256; ++v) {
+                    weight[out][in][v] = matrix[out][in] * v;
+                }
+            }
+        }
+    }
+};
+
+// Run fn(y, begin, end) over elements [begin, end) of row y, for rows of
+// row_elems elements. When every buffer involved is contiguous the rows form one
+// flat span, which is split as a whole and handed over as row 0.
+void parallel_spans(size_t row_elems, int rows, bool contiguous, size_t grain,
+                    const std::function<void(int, size_t, size_t)>& fn) {
+    if (contiguous) {
+        parallel_for(row_elems * rows, grain, [&](size_t begin, size_t end) {
+            fn(0, begin, end);
+        });
+        return;
+    }
+    int min_rows = static_cast<int>(std::max<size_t>(1, grain / std::max<size_t>(1, row_elems)));
+    parallel_rows(rows, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            fn(y, 0, row_elems);
+        }
+    }, min_rows);
+}
+
+// Operations writing into a second view need it to match the input
+template <typename T, typename U>
+void check_same_size(const BasicImageView<T>& a, const BasicImageView<U>& b) {
+    if (!a.same_size(b)) {
+        throw std::invalid_argument("Images must have the same dimensions and number of channels.");
+    }
+}
+
+// Map every byte of a view through a table
+void lookup(ImageView img, const Lut& lut) {
+    parallel_spans(img.row_bytes(), img.height, img.contiguous(), kMinChunkBytes, [&](int y, size_t begin, size_t end) {
+        lut_bytes(img.row(y) + begin, img.row(y) + begin, end - begin, lut.data());
+    });
+}
+
+const ColorTables& grayscale_tables() {
+    static const double matrix[3][3] = {{0.3, 0.59, 0.11}, {0, 0, 0}, {0, 0, 0}};
+    static const ColorTables tables(matrix);
+    return tables;
+}
+
+const ColorTables& sepia_tables() {
+    static const double matrix[3][3] = {{0.393, 0.769, 0.189},
+                                        {0.349, 0.686, 0.168},
+                                        {0.272, 0.534, 0.131}};
+    static const ColorTables tables(matrix);
+    return tables;
+}
+
+} // namespace
 
 // Constructor: Load an image from a file
-Image::Image(const std::string& filepath) {
-    data = stbi_load(filepath.c_str(), &width, &height, &channels, 0);
+Image::Image(const std::string& filepath) : width(0), height(0), channels(0), data(nullptr) {
+    ProfileScope profile("load");
+    if (is_mappable_image(filepath)) {
+        *this = map_image(filepath);
+    } else {
+        data = stbi_load(filepath.c_str(), &width, &height, &channels, 0);
+        if (data == nullptr) {
+            throw std::runtime_error("Error loading image: " + filepath);
+        }
+        allocator_ = default_image_allocator();
+        allocated_ = size();
+    }
+    if (profile.active()) {
+        profile.add_read(file_bytes(filepath));
+        profile.add_written(size());
+        profile.add_pixels(view_pixels(view()));
+    }
+}
+
+// Constructor: Decode an image file held in memory
+Image::Image(const unsigned char* encoded, size_t encoded_size) : width(0), height(0), channels(0), data(nullptr) {
+    if (encoded == nullptr || encoded_size == 0 || encoded_size > static_cast<size_t>(INT_MAX)) {
+        throw std::invalid_argument("Encoded image must be 1 byte to 2 GiB.");
+    }
+    ProfileScope profile("decode", encoded_size);
+    data = stbi_load_from_memory(encoded, static_cast<int>(encoded_size), &width, &height, &channels, 0);
     if (data == nullptr) {
-        throw std::runtime_error("Error loading image: " + filepath);
+        throw std::runtime_error(std::string("Error decoding image: ") + stbi_failure_reason());
     }
+    allocator_ = default_image_allocator();
+    allocated_ = size();
+    profile.add_written(size());
+    profile.add_pixels(view_pixels(view()));
+}
+
+// Allocate a zeroed image
+Image::Image(int width, int height, int channels, std::shared_ptr<ImageAllocator> allocator)
+    : width(width), height(height), channels(channels), data(nullptr),
+      allocator_(allocator ? std::move(allocator) : default_image_allocator()) {
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        throw std::invalid_argument("Image dimensions must be positive.");
+    }
+    allocated_ = size();
+    data = allocator_->allocate(allocated_);
+    std::memset(data, 0, allocated_);
+}
+
+Image Image::uninitialized(int width, int height, int channels, std::shared_ptr<ImageAllocator> allocator) {
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        throw std::invalid_argument("Image dimensions must be positive.");
+    }
+    if (!allocator) {
+        allocator = default_image_allocator();
+    }
+    unsigned char* data = allocator->allocate(static_cast<size_t>(width) * height * channels);
+    return Image(width, height, channels, data, std::move(allocator));
+}
+
+// Adopt a buffer the allocator already owns
+Image::Image(int width, int height, int channels, unsigned char* data, std::shared_ptr<ImageAllocator> allocator)
+    : width(width), height(height), channels(channels), data(data),
+      allocator_(allocator ? std::move(allocator) : default_image_allocator()), allocated_(size()) {}
+
+Image::Image(const Image& other)
+    : width(other.width), height(other.height), channels(other.channels), data(nullptr),
+      allocator_(other.allocator_ ? other.allocator_ : default_image_allocator()) {
+    if (other.data != nullptr) {
+        allocated_ = size();
+        data = allocator_->allocate(allocated_);
+        std::memcpy(data, other.data, allocated_);
+    }
+}
+
+Image::Image(Image&& other) noexcept
+    : width(other.width), height(other.height), channels(other.channels), data(other.data),
+      allocator_(std::move(other.allocator_)), allocated_(other.allocated_) {
+    other.width = other.height = other.channels = 0;
+    other.data = nullptr;
+    other.allocated_ = 0;
+}
+
+Image& Image::operator=(const Image& other) {
+    if (this != &other) {
+        Image copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+Image& Image::operator=(Image&& other) noexcept {
+    if (this != &other) {
+        release();
+        width = other.width;
+        height = other.height;
+        channels = other.channels;
+        data = other.data;
+        allocator_ = std::move(other.allocator_);
+        allocated_ = other.allocated_;
+        other.width = other.height = other.channels = 0;
+        other.data = nullptr;
+        other.allocated_ = 0;
+    }
+    return *this;
 }
 
 // Destructor: Free the image memory
 Image::~Image() {
+    release();
+}
+
+// Hand the buffer back to whoever allocated it
+void Image::release() {
     if (data != nullptr) {
-        stbi_image_free(data);
+        allocator_->deallocate(data, allocated_);
         data = nullptr; // Ensuring no dangling pointer
     }
+    allocated_ = 0;
 }
 
 // Save the image as PNG
-void Image::save_as_png(const std::string& filepath) const {
-    if (!stbi_write_png(filepath.c_str(), width, height, channels, data, width * channels)) {
-        throw std::runtime_error("Error saving PNG image: " + filepath);
+void Image::save_as_png(const std::string& filepath, const PngSaveOptions& options) const {
+    ProfileScope profile("save_as_png", size(), 0, view_pixels(view()));
+    {
+        PngWriter writer(filepath, width, height, channels, options);
+        writer.write_rows(view());
+    }
+    if (profile.active()) {
+        profile.add_written(file_bytes(filepath));
     }
 }
 
 // Save the image as JPG
 void Image::save_as_jpg(const std::string& filepath, int quality) const {
-    if (!stbi_write_jpg(filepath.c_str(), width, height, channels, data, quality)) {
-        throw std::runtime_error("Error saving JPG image: " + filepath);
+    JpegSaveOptions options;
+    options.quality = quality;
+    save_as_jpg(filepath, options);
+}
+
+void Image::save_as_jpg(const std::string& filepath, const JpegSaveOptions& options) const {
+    ProfileScope profile("save_as_jpg", size(), 0, view_pixels(view()));
+    save_jpeg(view(), filepath, options);
+    if (profile.active()) {
+        profile.add_written(file_bytes(filepath));
     }
 }
 
-// Convert the image to grayscale
-void Image::convert_to_grayscale() {
-    if (channels < 3) {
-        throw std::runtime_error("Image must have at least 3 channels for grayscale conversion.");
+void Image::encode_as_png(std::vector<unsigned char>& out, const PngSaveOptions& options) const {
+    ProfileScope profile("encode_as_png", size(), 0, view_pixels(view()));
+    out.clear();
+    {
+        PngWriter writer([&out](const unsigned char* bytes, size_t count) {
+            out.insert(out.end(), bytes, bytes + count);
+        }, width, height, channels, options);
+        writer.write_rows(view());
     }
+    profile.add_written(out.size());
+}
+
+void Image::encode_as_jpg(std::vector<unsigned char>& out, const JpegSaveOptions& options) const {
+    ProfileScope profile("encode_as_jpg", size(), 0, view_pixels(view()));
+    encode_jpeg(view(), out, options);
+    profile.add_written(out.size());
+}
 
-    for (int i = 0; i < width * height; ++i) {
-        unsigned char* pixel = data + i * channels;
-        unsigned char gray_value = static_cast<unsigned char>(0.3 * pixel[0] + 0.59 * pixel[1] + 0.11 * pixel[2]);
-        pixel[0] = gray_value;
-        pixel[1] = gray_value;
-        pixel[2] = gray_value;
+void Image::save_as_ppm(const std::string& filepath) const {
+    if (channels != 1 && channels != 3) {
+        throw std::invalid_argument("PGM/PPM images have 1 or 3 channels.");
+    }
+    ProfileScope profile("save_as_ppm", size(), 0, view_pixels(view()));
+    save_mapped_image(view(), filepath, channels == 1 ? MappedFormat::Pgm : MappedFormat::Ppm);
+    if (profile.active()) {
+        profile.add_written(file_bytes(filepath));
     }
 }
 
+void Image::save_as_raw(const std::string& filepath) const {
+    ProfileScope profile("save_as_raw", size(), 0, view_pixels(view()));
+    save_mapped_image(view(), filepath, MappedFormat::Raw);
+    if (profile.active()) {
+        profile.add_written(file_bytes(filepath));
+    }
+}
+
+// Convert the image to grayscale
+void Image::convert_to_grayscale() {
+    convert_to_grayscale(view());
+}
+
 // Convert the image to sepia tone
 void Image::convert_to_sepia() {
-    if (channels < 3) {
+    convert_to_sepia(view());
+}
+
+void Image::convert_to_grayscale(ImageView region) {
+    ProfileScope profile("convert_to_grayscale", view_bytes(region), view_bytes(region), view_pixels(region));
+    if (region.channels < 3) {
+        throw std::runtime_error("Image must have at least 3 channels for grayscale conversion.");
+    }
+
+    const auto& w = grayscale_tables().weight[0];
+    const int channels = region.channels;
+    parallel_spans(region.width, region.height, region.contiguous(), kMinChunkBytes / channels, [&](int y, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            unsigned char* pixel = region.row(y) + i * channels;
+            unsigned char gray_value = static_cast<unsigned char>(w[0][pixel[0]] + w[1][pixel[1]] + w[2][pixel[2]]);
+            pixel[0] = gray_value;
+            pixel[1] = gray_value;
+            pixel[2] = gray_value;
+        }
+    });
+}
+
+void Image::convert_to_sepia(ImageView region) {
+    ProfileScope profile("convert_to_sepia", view_bytes(region), view_bytes(region), view_pixels(region));
+    if (region.channels < 3) {
         throw std::runtime_error("Image must have at least 3 channels for sepia conversion.");
     }
 
-    for (int i = 0; i < width * height; ++i) {
-        unsigned char* pixel = data + i * channels;
+    const auto& w = sepia_tables().weight;
+    const int channels = region.channels;
+    parallel_spans(region.width, region.height, region.contiguous(), kMinChunkBytes / channels, [&](int y, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            unsigned char* pixel = region.row(y) + i * channels;
 
-        unsigned char red = pixel[0];
-        unsigned char green = pixel[1];
-        unsigned char blue = pixel[2];
+            unsigned char red = pixel[0];
+            unsigned char green = pixel[1];
+            unsigned char blue = pixel[2];
 
-        pixel[0] = std::min(255.0, 0.393 * red + 0.769 * green + 0.189 * blue);
-        pixel[1] = std::min(255.0, 0.349 * red + 0.686 * green + 0.168 * blue);
-        pixel[2] = std::min(255.0, 0.272 * red + 0.534 * green + 0.131 * blue);
-    }
-    
-    
+            pixel[0] = std::min(255.0, w[0][0][red] + w[0][1][green] + w[0][2][blue]);
+            pixel[1] = std::min(255.0, w[1][0][red] + w[1][1][green] + w[1][2][blue]);
+            pixel[2] = std::min(255.0, w[2][0][red] + w[2][1][green] + w[2][2][blue]);
+        }
+    });
 }
 // void Image::resize_image(const unsigned char* src, unsigned char* dest, int old_width, int old_height, int new_width, int new_height, int channels) {
 //     for (int y = 0; y < new_height; ++y) {
@@ -87,141 +362,279 @@ void Image::convert_to_sepia() {
 //     }
 // }
 
+// Crop the top-left corner of the image
 void Image::crop_image(const unsigned char* src, unsigned char* dest, int src_width, int src_height, int dest_width, int dest_height, int channels) {
-    for (int y = 0; y < dest_height; ++y) {
-        for (int x = 0; x < dest_width; ++x) {
-            for (int c = 0; c < channels; ++c) {
-                dest[(y * dest_width + x) * channels + c] = src[(y * src_width + x) * channels + c];
-            }
+    crop_image(src, dest, src_width, src_height, channels, Rect{0, 0, dest_width, dest_height});
+}
+
+// Crop an arbitrary rectangle, copying whole rows
+void Image::crop_image(const unsigned char* src, unsigned char* dest, int src_width, int src_height, int channels, const Rect& rect) {
+    ::crop(ConstImageView(src, src_width, src_height, channels), rect, ImageView(dest, rect.width, rect.height, channels));
+}
+
+void Image::crop_image(ConstImageView src, ImageView dest, const Rect& rect) {
+    ProfileScope profile("crop_image", view_bytes(dest), view_bytes(dest), view_pixels(dest));
+    ::crop(src, rect, dest);
+}
+
+Image Image::crop(const Rect& rect, std::shared_ptr<ImageAllocator> allocator) const {
+    const size_t pixels = static_cast<size_t>(std::max(rect.width, 0)) * std::max(rect.height, 0);
+    ProfileScope profile("crop", pixels * channels, pixels * channels, pixels);
+    if (rect.width <= 0 || rect.height <= 0) {
+        throw std::invalid_argument("Crop rectangle lies outside the image.");
+    }
+    Image result = uninitialized(rect.width, rect.height, channels, allocator ? std::move(allocator) : allocator_);
+    ::crop(view(), rect, result.view());
+    return result;
+}
+
+std::vector<Image> Image::crop_many(const std::vector<Rect>& rects, std::shared_ptr<ImageAllocator> allocator) const {
+    ProfileScope profile("crop_many");
+    if (!allocator) {
+        allocator = allocator_;
+    }
+    std::vector<Image> results;
+    std::vector<ImageView> views;
+    results.reserve(rects.size());
+    views.reserve(rects.size());
+    for (const Rect& rect : rects) {
+        if (rect.width <= 0 || rect.height <= 0) {
+            throw std::invalid_argument("Crop rectangle lies outside the image.");
         }
+        results.push_back(uninitialized(rect.width, rect.height, channels, allocator));
+        views.push_back(results.back().view());
+        profile.add_read(view_bytes(views.back()));
+        profile.add_written(view_bytes(views.back()));
+        profile.add_pixels(view_pixels(views.back()));
     }
+    ::crop_many(view(), rects, views);
+    return results;
 }
+
 // Add two images pixel by pixel
 void Image::add_images(const unsigned char* img1_data, const unsigned char* img2_data, unsigned char* result_data, int img1_width, int img1_height, int img1_channels, int img2_width, int img2_height, int img2_channels) {
-    
+    add_images(ConstImageView(img1_data, img1_width, img1_height, img1_channels),
+               ConstImageView(img2_data, img2_width, img2_height, img2_channels),
+               ImageView(result_data, img1_width, img1_height, img1_channels));
+}
+
+void Image::add_images(ConstImageView img1, ConstImageView img2, ImageView result) {
+    ProfileScope profile("add_images", view_bytes(img1) + view_bytes(img2), view_bytes(result), view_pixels(result));
     // Ensure both images have the same dimensions (width, height, channels)
-    if (img1_width != img2_width || img1_height != img2_height || img1_channels != img2_channels) {
-        throw std::invalid_argument("Images must have the same dimensions and number of channels.");
-    }
+    check_same_size(img1, img2);
+    check_same_size(img1, result);
 
-    // Iterate over each pixel and add corresponding values
-    int total_pixels = img1_width * img1_height * img1_channels;
-    for (int i = 0; i < total_pixels; i++) {
+    bool contiguous = img1.contiguous() && img2.contiguous() && result.contiguous();
+    parallel_spans(img1.row_bytes(), img1.height, contiguous, kMinChunkBytes, [&](int y, size_t begin, size_t end) {
         // Add the pixel values from both images and clamp the result between 0 and 255
-        result_data[i] = std::clamp(img1_data[i] + img2_data[i], 0, 255);
-    }
+        add_saturate(img1.row(y) + begin, img2.row(y) + begin, result.row(y) + begin, end - begin);
+    });
 }
 
 // Subtract one image from another pixel by pixel
 void Image::subtract_images(const unsigned char* img1_data, const unsigned char* img2_data, unsigned char* result_data, int img1_width, int img1_height, int img1_channels, int img2_width, int img2_height, int img2_channels) {
+    subtract_images(ConstImageView(img1_data, img1_width, img1_height, img1_channels),
+                    ConstImageView(img2_data, img2_width, img2_height, img2_channels),
+                    ImageView(result_data, img1_width, img1_height, img1_channels));
+}
+
+void Image::subtract_images(ConstImageView img1, ConstImageView img2, ImageView result) {
+    ProfileScope profile("subtract_images", view_bytes(img1) + view_bytes(img2), view_bytes(result), view_pixels(result));
     // Ensure both images have the same dimensions (width, height, channels)
-    if (img1_width != img2_width || img1_height != img2_height || img1_channels != img2_channels) {
-        throw std::invalid_argument("Images must have the same dimensions and number of channels.");
-    }
+    check_same_size(img1, img2);
+    check_same_size(img1, result);
 
-    // Iterate over each pixel and subtract corresponding values
-    int total_pixels = img1_width * img1_height * img1_channels;
-    for (int i = 0; i < total_pixels; i++) {
+    bool contiguous = img1.contiguous() && img2.contiguous() && result.contiguous();
+    parallel_spans(img1.row_bytes(), img1.height, contiguous, kMinChunkBytes, [&](int y, size_t begin, size_t end) {
         // Subtract the pixel values from both images and clamp the result between 0 and 255
-        result_data[i] = std::clamp(img1_data[i] - img2_data[i], 0, 255);
-    }
+        subtract_saturate(img1.row(y) + begin, img2.row(y) + begin, result.row(y) + begin, end - begin);
+    });
 }
 
 
 // Adjust brightness of the image
 void Image::adjust_brightness(unsigned char* img_data, int img_width, int img_height, int img_channels, int adjustment_value) {
-    int total_pixels = img_width * img_height * img_channels;
-    for (int i = 0; i < total_pixels; ++i) {
-        img_data[i] = std::clamp(static_cast<int>(img_data[i]) + adjustment_value, 0, 255);
-    }
+    adjust_brightness(ImageView(img_data, img_width, img_height, img_channels), adjustment_value);
+}
+
+void Image::adjust_brightness(ImageView img, int adjustment_value) {
+    ProfileScope profile("adjust_brightness", view_bytes(img), view_bytes(img), view_pixels(img));
+    parallel_spans(img.row_bytes(), img.height, img.contiguous(), kMinChunkBytes, [&](int y, size_t begin, size_t end) {
+        add_scalar_saturate(img.row(y) + begin, img.row(y) + begin, end - begin, adjustment_value);
+    });
 }
 
 // Adjust contrast of the image
 void Image::adjust_contrast(unsigned char* img, int width, int height, int channels, float contrast_factor) {
-    float midpoint = 127.5f;
-    for (int i = 0; i < width * height * channels; ++i) {
-        img[i] = std::clamp(static_cast<int>((img[i] - midpoint) * contrast_factor + midpoint), 0, 255);
-    }
+    adjust_contrast(ImageView(img, width, height, channels), contrast_factor);
+}
+
+void Image::adjust_contrast(ImageView img, float contrast_factor) {
+    ProfileScope profile("adjust_contrast", view_bytes(img), view_bytes(img), view_pixels(img));
+    // Scales each sample's distance from the 127.5 midpoint
+    parallel_spans(img.row_bytes(), img.height, img.contiguous(), kMinChunkBytes, [&](int y, size_t begin, size_t end) {
+        contrast_bytes(img.row(y) + begin, img.row(y) + begin, end - begin, contrast_factor);
+    });
 }
 // Apply a binary threshold to the image
 void Image::threshold_image(unsigned char* img, int width, int height, int channels, unsigned char threshold) {
-    for (int i = 0; i < width * height * channels; ++i) {
-        img[i] = (img[i] >= threshold) ? 255 : 0;
-    }
+    threshold_image(ImageView(img, width, height, channels), threshold);
+}
+
+void Image::threshold_image(ImageView img, unsigned char threshold) {
+    ProfileScope profile("threshold_image", view_bytes(img), view_bytes(img), view_pixels(img));
+    parallel_spans(img.row_bytes(), img.height, img.contiguous(), kMinChunkBytes, [&](int y, size_t begin, size_t end) {
+        threshold_bytes(img.row(y) + begin, img.row(y) + begin, end - begin, threshold);
+    });
+}
+
+// Apply gamma correction to the image
+void Image::adjust_gamma(unsigned char* img, int width, int height, int channels, float gamma) {
+    adjust_gamma(ImageView(img, width, height, channels), gamma);
+}
+
+void Image::adjust_gamma(ImageView img, float gamma) {
+    ProfileScope profile("adjust_gamma", view_bytes(img), view_bytes(img), view_pixels(img));
+    lookup(img, Lut::gamma(gamma));
+}
+
+// Invert the image (photographic negative)
+void Image::invert_image(unsigned char* img, int width, int height, int channels) {
+    invert_image(ImageView(img, width, height, channels));
+}
+
+void Image::invert_image(ImageView img) {
+    ProfileScope profile("invert_image", view_bytes(img), view_bytes(img), view_pixels(img));
+    lookup(img, Lut::invert());
+}
+
+// Map every byte of the image through a lookup table
+void Image::apply_lut(unsigned char* img, int width, int height, int channels, const Lut& lut) {
+    apply_lut(ImageView(img, width, height, channels), lut);
+}
+
+void Image::apply_lut(ImageView img, const Lut& lut) {
+    ProfileScope profile("apply_lut", view_bytes(img), view_bytes(img), view_pixels(img));
+    lookup(img, lut);
 }
 
 // Apply a low-pass filter (e.g., blur) to the image
 void Image::low_pass_filter(const unsigned char* img, unsigned char* result, int width, int height, int channels, int filter_size) {
-    int offset = filter_size / 2;
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            for (int c = 0; c < channels; ++c) {
-                int sum = 0;
-                int count = 0;
-                for (int fy = -offset; fy <= offset; ++fy) {
-                    for (int fx = -offset; fx <= offset; ++fx) {
-                        int nx = x + fx;
-                        int ny = y + fy;
-                        if (nx >= 0 && ny >= 0 && nx < width && ny < height) {
-                            sum += img[(ny * width + nx) * channels + c];
-                            ++count;
-                        }
-                    }
-                }
-                result[(y * width + x) * channels + c] = sum / count;
-            }
-        }
+    low_pass_filter(ConstImageView(img, width, height, channels), ImageView(result, width, height, channels), filter_size);
+}
+
+void Image::low_pass_filter(ConstImageView img, ImageView result, int filter_size) {
+    ProfileScope profile("low_pass_filter", view_bytes(img), view_bytes(result), view_pixels(result));
+    if (filter_size < 0) {
+        throw std::invalid_argument("Filter size must be non-negative.");
     }
+    check_same_size(img, result);
+    // Edge-clamped average over a filter_size x filter_size window (rounded up to odd)
+    box_blur(img.data, img.stride, result.data, result.stride, img.width, img.height, img.channels, filter_size / 2);
 }
 
 // Apply a high-pass filter (e.g., edge detection) to the image
 void Image::high_pass_filter(const unsigned char* img, unsigned char* result, int width, int height, int channels, int filter_size) {
+    high_pass_filter(ConstImageView(img, width, height, channels), ImageView(result, width, height, channels), filter_size);
+}
+
+void Image::high_pass_filter(ConstImageView img, ImageView result, int filter_size) {
+    ProfileScope profile("high_pass_filter", view_bytes(img), view_bytes(result), view_pixels(result));
+    check_same_size(img, result);
+    // The kernel is 3x3; larger sizes would index past it, and sizes 0 and 1
+    // would use only its centre
+    if (filter_size < 2 || filter_size > 3) {
+        throw std::invalid_argument("High-pass filter size must be 2 or 3.");
+    }
     int kernel[3][3] = {{-1, -1, -1},
                         {-1,  8, -1},
                         {-1, -1, -1}};
     int offset = filter_size / 2;
-
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            for (int c = 0; c < channels; ++c) {
-                int sum = 0;
-                for (int fy = -offset; fy <= offset; ++fy) {
-                    for (int fx = -offset; fx <= offset; ++fx) {
-                        int nx = x + fx;
-                        int ny = y + fy;
-                        if (nx >= 0 && ny >= 0 && nx < width && ny < height) {
-                            sum += img[(ny * width + nx) * channels + c] * kernel[fy + offset][fx + offset];
+    const int width = img.width;
+    const int height = img.height;
+    const int channels = img.channels;
+
+    parallel_rows(height, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            unsigned char* out = result.row(y);
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    int sum = 0;
+                    for (int fy = -offset; fy <= offset; ++fy) {
+                        for (int fx = -offset; fx <= offset; ++fx) {
+                            int nx = x + fx;
+                            int ny = y + fy;
+                            if (nx >= 0 && ny >= 0 && nx < width && ny < height) {
+                                sum += img.row(ny)[nx * channels + c] * kernel[fy + offset][fx + offset];
+                            }
                         }
                     }
+                    out[x * channels + c] = std::clamp(sum, 0, 255);
                 }
-                result[(y * width + x) * channels + c] = std::clamp(sum, 0, 255);
             }
         }
-    }
+    }, min_band_rows(width, channels));
 }
 
 // Resize the image
-void Image::resize_image(const unsigned char* src, unsigned char* dest, int old_width, int old_height, int new_width, int new_height, int channels) {
-    for (int y = 0; y < new_height; ++y) {
-        for (int x = 0; x < new_width; ++x) {
-            int src_x = static_cast<int>((x / static_cast<float>(new_width)) * old_width);
-            int src_y = static_cast<int>((y / static_cast<float>(new_height)) * old_height);
-            for (int c = 0; c < channels; ++c) {
-                dest[(y * new_width + x) * channels + c] = src[(src_y * old_width + src_x) * channels + c];
-            }
-        }
+void Image::resize_image(const unsigned char* src, unsigned char* dest, int old_width, int old_height, int new_width, int new_height, int channels, ResizeFilter filter) {
+    resize_image(ConstImageView(src, old_width, old_height, channels), ImageView(dest, new_width, new_height, channels), filter);
+}
+
+void Image::resize_image(ConstImageView src, ImageView dest, ResizeFilter filter) {
+    ProfileScope profile("resize_image", view_bytes(src), view_bytes(dest), view_pixels(dest));
+    if (src.channels != dest.channels) {
+        throw std::invalid_argument("Images must have the same number of channels.");
+    }
+    resize(src.data, src.width, src.height, src.stride, dest.data, dest.width, dest.height, dest.stride, src.channels, filter);
+}
+
+// Shrink by an integer factor, averaging each factor x factor block
+void Image::downsample_image(const unsigned char* src, unsigned char* dest, int width, int height, int channels, int factor) {
+    if (factor < 1) {
+        throw std::invalid_argument("Downsample factors must be positive.");
     }
+    downsample_image(ConstImageView(src, width, height, channels),
+                     ImageView(dest, downsampled_size(width, factor), downsampled_size(height, factor), channels), factor);
+}
+
+void Image::downsample_image(ConstImageView src, ImageView dest, int factor) {
+    ProfileScope profile("downsample_image", view_bytes(src), view_bytes(dest), view_pixels(dest));
+    if (factor < 1) {
+        throw std::invalid_argument("Downsample factors must be positive.");
+    }
+    if (!dest.same_size(downsampled_size(src.width, factor), downsampled_size(src.height, factor), src.channels)) {
+        throw std::invalid_argument("Destination must be the downsampled size of the source.");
+    }
+    downsample(src.data, src.width, src.height, src.stride, dest.data, dest.stride, src.channels, factor, factor);
 }
 
 // Perform Otsu's thresholding
 void Image::otsu_threshold(const unsigned char* img, unsigned char* result, int width, int height, int channels) {
+    otsu_threshold(ConstImageView(img, width, height, channels), ImageView(result, width, height, channels));
+}
+
+void Image::otsu_threshold(ConstImageView img, ImageView result) {
+    ProfileScope profile("otsu_threshold", view_bytes(img), view_bytes(result), view_pixels(result));
+    check_same_size(img, result);
+    const int channels = img.channels;
     int histogram[256] = {0};
 
-    for (int i = 0; i < width * height * channels; i += channels) {
-        ++histogram[img[i]];
-    }
+    // Per-band histograms, merged under a lock
+    std::mutex histogram_mutex;
+    parallel_spans(img.width, img.height, img.contiguous(), kMinChunkBytes, [&](int y, size_t begin, size_t end) {
+        int local[256] = {0};
+        const unsigned char* in = img.row(y);
+        for (size_t i = begin; i < end; ++i) {
+            ++local[in[i * channels]];
+        }
+        std::lock_guard<std::mutex> lock(histogram_mutex);
+        for (int t = 0; t < 256; ++t) {
+            histogram[t] += local[t];
+        }
+    });
 
-    int total = width * height;
+    int total = img.width * img.height;
     float sum = 0;
     for (int t = 0; t < 256; ++t) {
         sum += t * histogram[t];
@@ -253,16 +666,121 @@ void Image::otsu_threshold(const unsigned char* img, unsigned char* result, int
         }
     }
 
-    for (int i = 0; i < width * height * channels; ++i) {
-        result[i] = (img[i] > threshold) ? 255 : 0;
+    bool contiguous = img.contiguous() && result.contiguous();
+    parallel_spans(img.row_bytes(), img.height, contiguous, kMinChunkBytes, [&](int y, size_t begin, size_t end) {
+        const unsigned char* in = img.row(y);
+        unsigned char* out = result.row(y);
+        for (size_t i = begin; i < end; ++i) {
+            out[i] = (in[i] > threshold) ? 255 : 0;
+        }
+    });
+}
+
+// Adaptive thresholding against the local mean, using an integral image
+void Image::adaptive_threshold(const unsigned char* img, unsigned char* result, int width, int height, int channels, int block_size, int offset) {
+    adaptive_threshold(ConstImageView(img, width, height, channels), ImageView(result, width, height, channels), block_size, offset);
+}
+
+void Image::adaptive_threshold(ConstImageView img, ImageView result, int block_size, int offset) {
+    ProfileScope profile("adaptive_threshold", view_bytes(img), view_bytes(result), view_pixels(result));
+    if (block_size < 1) {
+        throw std::invalid_argument("Block size must be positive.");
     }
+    check_same_size(img, result);
+    IntegralImage integral(img, false);
+    int half = block_size / 2;
+    const int channels = img.channels;
+
+    parallel_rows(img.height, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            const unsigned char* in = img.row(y);
+            unsigned char* out = result.row(y);
+            for (int x = 0; x < img.width; ++x) {
+                int64_t area = integral.area(x - half, y - half, x + half, y + half);
+                for (int c = 0; c < channels; ++c) {
+                    int i = x * channels + c;
+                    // img > mean - offset, kept in integers: img * area > sum - offset * area
+                    int64_t sum = integral.sum(x - half, y - half, x + half, y + half, c);
+                    out[i] = (static_cast<int64_t>(in[i] + offset) * area > sum) ? 255 : 0;
+                }
+            }
+        }
+    }, min_band_rows(img.width, channels));
 }
 
-// Apply Hough Transform (placeholder example for line detection)
-void Image::hough_transform(const unsigned char* img, unsigned char* result, int width, int height, int channels) {
-    // Placeholder: Implement Hough Transform logic here
-    std::memcpy(result, img, width * height * channels);
+// Local contrast enhancement around the local mean, using an integral image
+void Image::enhance_local_contrast(const unsigned char* img, unsigned char* result, int width, int height, int channels, int window_size, float strength) {
+    enhance_local_contrast(ConstImageView(img, width, height, channels), ImageView(result, width, height, channels), window_size, strength);
+}
+
+void Image::enhance_local_contrast(ConstImageView img, ImageView result, int window_size, float strength) {
+    ProfileScope profile("enhance_local_contrast", view_bytes(img), view_bytes(result), view_pixels(result));
+    if (window_size < 1) {
+        throw std::invalid_argument("Window size must be positive.");
+    }
+    check_same_size(img, result);
+    IntegralImage integral(img, false);
+    int half = window_size / 2;
+    const int channels = img.channels;
+
+    parallel_rows(img.height, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            const unsigned char* in = img.row(y);
+            unsigned char* out = result.row(y);
+            for (int x = 0; x < img.width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    int i = x * channels + c;
+                    float mean = static_cast<float>(integral.mean(x - half, y - half, x + half, y + half, c));
+                    out[i] = std::clamp(static_cast<int>(mean + (in[i] - mean) * strength + 0.5f), 0, 255);
+                }
+            }
+        }
+    }, min_band_rows(img.width, channels));
+}
+
+// Local contrast normalization with the local mean and variance, using an integral image
+void Image::normalize_local_contrast(const unsigned char* img, unsigned char* result, int width, int height, int channels, int window_size) {
+    normalize_local_contrast(ConstImageView(img, width, height, channels), ImageView(result, width, height, channels), window_size);
 }
 
+void Image::normalize_local_contrast(ConstImageView img, ImageView result, int window_size) {
+    ProfileScope profile("normalize_local_contrast", view_bytes(img), view_bytes(result), view_pixels(result));
+    if (window_size < 1) {
+        throw std::invalid_argument("Window size must be positive.");
+    }
+    check_same_size(img, result);
+    IntegralImage integral(img, true);
+    int half = window_size / 2;
+    const int channels = img.channels;
+    const double spread = 64.0;   // one local standard deviation maps to this many levels
+    const double min_stddev = 1.0; // keeps flat regions from blowing up noise
+
+    parallel_rows(img.height, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            const unsigned char* in = img.row(y);
+            unsigned char* out = result.row(y);
+            for (int x = 0; x < img.width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    int i = x * channels + c;
+                    double mean = integral.mean(x - half, y - half, x + half, y + half, c);
+                    double stddev = std::max(min_stddev, std::sqrt(integral.variance(x - half, y - half, x + half, y + half, c)));
+                    out[i] = std::clamp(static_cast<int>(127.5 + (in[i] - mean) / stddev * spread), 0, 255);
+                }
+            }
+        }
+    }, min_band_rows(img.width, channels));
+}
 
+// Apply Hough Transform (placeholder example for line detection)
+void Image::hough_transform(const unsigned char* img, unsigned char* result, int width, int height, int channels) {
+    hough_transform(ConstImageView(img, width, height, channels), ImageView(result, width, height, channels));
+}
 
+void Image::hough_transform(ConstImageView img, ImageView result) {
+    ProfileScope profile("hough_transform", view_bytes(img), view_bytes(result), view_pixels(result));
+    // Placeholder: Implement Hough Transform logic here
+    check_same_size(img, result);
+    for (int y = 0; y < img.height; ++y) {
+        std::memcpy(result.row(y), img.row(y), img.row_bytes());
+    }
+}
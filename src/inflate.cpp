@@ -0,0 +1,388 @@
+#include "../include/inflate.h"
+#include "../include/deflate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr size_t kWindowSize = 1 << 15;
+constexpr size_t kWindowMask = kWindowSize - 1;
+constexpr size_t kInputBufferSize = 1 << 16;
+
+const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const uint16_t kDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                    6145, 8193, 12289, 16385, 24577};
+const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+const uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+uint32_t reverse_bits(uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; ++i) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+[[noreturn]] void corrupt(const char* what) {
+    throw std::runtime_error(std::string("Corrupt deflate stream: ") + what);
+}
+
+} // namespace
+
+// Canonical Huffman code from code lengths. Codes of up to 9 bits decode with one
+// lookup in fast; longer ones are found by comparing against max_code per length.
+void Inflater::Huffman::build(const uint8_t* lengths, int count) {
+    int sizes[17] = {0};
+    uint32_t next_code[16] = {0};
+    std::memset(fast, 0, sizeof(fast));
+    for (int i = 0; i < count; ++i) {
+        ++sizes[lengths[i]];
+    }
+    sizes[0] = 0;
+    for (int i = 1; i < 16; ++i) {
+        if (sizes[i] > (1 << i)) {
+            corrupt("bad code lengths");
+        }
+    }
+
+    uint32_t code = 0;
+    int symbols = 0;
+    for (int i = 1; i < 16; ++i) {
+        next_code[i] = code;
+        first_code[i] = static_cast<uint16_t>(code);
+        first_symbol[i] = static_cast<uint16_t>(symbols);
+        code += sizes[i];
+        if (sizes[i] != 0 && code - 1 >= (1u << i)) {
+            corrupt("bad code lengths");
+        }
+        max_code[i] = code << (16 - i);  // one past the last code, left-aligned to 16 bits
+        code <<= 1;
+        symbols += sizes[i];
+    }
+    max_code[16] = 0x10000;
+
+    for (int i = 0; i < count; ++i) {
+        int length = lengths[i];
+        if (length == 0) {
+            continue;
+        }
+        int slot = static_cast<int>(next_code[length] - first_code[length] + first_symbol[length]);
+        size[slot] = static_cast<uint8_t>(length);
+        value[slot] = static_cast<uint16_t>(i);
+        if (length <= 9) {
+            for (uint32_t j = reverse_bits(next_code[length], length); j < (1u << 9); j += 1u << length) {
+                fast[j] = static_cast<uint16_t>((length << 9) | i);
+            }
+        }
+        ++next_code[length];
+    }
+}
+
+Inflater::Inflater(Source source, bool zlib_header)
+    : source_(std::move(source)), input_(kInputBufferSize), zlib_header_(zlib_header), window_(kWindowSize) {}
+
+int Inflater::next_byte() {
+    if (input_pos_ == input_end_) {
+        input_end_ = source_(input_.data(), input_.size());
+        input_pos_ = 0;
+        if (input_end_ == 0) {
+            // Past the end: feed zeros so the bit buffer can look ahead, but
+            // anything that actually needs them is truncated
+            if (++padding_ > 16) {
+                corrupt("unexpected end of data");
+            }
+            return 0;
+        }
+    }
+    return input_[input_pos_++];
+}
+
+void Inflater::refill() {
+    if (input_end_ - input_pos_ >= 8) {
+        // Common case: the bytes are already buffered
+        const unsigned char* in = input_.data() + input_pos_;
+        while (bit_count_ <= 56) {
+            bits_ |= static_cast<uint64_t>(*in++) << bit_count_;
+            bit_count_ += 8;
+        }
+        input_pos_ = in - input_.data();
+        return;
+    }
+    while (bit_count_ <= 56) {
+        bits_ |= static_cast<uint64_t>(next_byte()) << bit_count_;
+        bit_count_ += 8;
+    }
+}
+
+uint32_t Inflater::get_bits(int count) {
+    if (bit_count_ < count) {
+        refill();
+    }
+    uint32_t value = static_cast<uint32_t>(bits_ & ((1ull << count) - 1));
+    bits_ >>= count;
+    bit_count_ -= count;
+    return value;
+}
+
+int Inflater::decode(const Huffman& huffman) {
+    if (bit_count_ < 16) {
+        refill();
+    }
+    int entry = huffman.fast[bits_ & 511];
+    if (entry != 0) {
+        int length = entry >> 9;
+        bits_ >>= length;
+        bit_count_ -= length;
+        return entry & 511;
+    }
+    // Longer code: walk the lengths in code order
+    uint32_t code = reverse_bits(static_cast<uint32_t>(bits_ & 0xFFFF), 16);
+    int length = 10;
+    while (code >= huffman.max_code[length]) {
+        ++length;
+    }
+    if (length >= 16) {
+        corrupt("bad code");
+    }
+    int slot = static_cast<int>((code >> (16 - length)) - huffman.first_code[length] + huffman.first_symbol[length]);
+    if (slot >= 288 || huffman.size[slot] != length) {
+        corrupt("bad code");
+    }
+    bits_ >>= length;
+    bit_count_ -= length;
+    return huffman.value[slot];
+}
+
+void Inflater::read_zlib_header() {
+    int cmf = static_cast<int>(get_bits(8));
+    int flg = static_cast<int>(get_bits(8));
+    if ((cmf * 256 + flg) % 31 != 0 || (cmf & 15) != 8 || (flg & 32) != 0) {
+        corrupt("bad zlib header");
+    }
+}
+
+void Inflater::read_dynamic_tables() {
+    int literal_count = static_cast<int>(get_bits(5)) + 257;
+    int distance_count = static_cast<int>(get_bits(5)) + 1;
+    int code_length_count = static_cast<int>(get_bits(4)) + 4;
+
+    uint8_t code_length_lengths[19] = {0};
+    for (int i = 0; i < code_length_count; ++i) {
+        code_length_lengths[kCodeLengthOrder[i]] = static_cast<uint8_t>(get_bits(3));
+    }
+    Huffman code_lengths;
+    code_lengths.build(code_length_lengths, 19);
+
+    // Literal and distance lengths form one run-length coded sequence
+    uint8_t lengths[288 + 32];
+    int total = literal_count + distance_count;
+    int n = 0;
+    while (n < total) {
+        int symbol = decode(code_lengths);
+        if (symbol < 16) {
+            lengths[n++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+        int repeat;
+        uint8_t fill = 0;
+        if (symbol == 16) {
+            if (n == 0) {
+                corrupt("bad code lengths");
+            }
+            repeat = 3 + static_cast<int>(get_bits(2));
+            fill = lengths[n - 1];
+        } else if (symbol == 17) {
+            repeat = 3 + static_cast<int>(get_bits(3));
+        } else if (symbol == 18) {
+            repeat = 11 + static_cast<int>(get_bits(7));
+        } else {
+            corrupt("bad code lengths");
+        }
+        if (n + repeat > total) {
+            corrupt("bad code lengths");
+        }
+        std::memset(lengths + n, fill, repeat);
+        n += repeat;
+    }
+    literals_.build(lengths, literal_count);
+    distances_.build(lengths + literal_count, distance_count);
+}
+
+void Inflater::start_block() {
+    final_block_ = get_bits(1) != 0;
+    int type = static_cast<int>(get_bits(2));
+    if (type == 0) {
+        // Stored: byte-align, then LEN and its complement
+        get_bits(bit_count_ % 8);
+        uint32_t length = get_bits(16);
+        uint32_t complement = get_bits(16);
+        if ((length ^ 0xFFFF) != complement) {
+            corrupt("bad stored block length");
+        }
+        stored_remaining_ = length;
+        state_ = State::Stored;
+    } else if (type == 1) {
+        uint8_t lengths[288];
+        std::fill(lengths, lengths + 144, 8);
+        std::fill(lengths + 144, lengths + 256, 9);
+        std::fill(lengths + 256, lengths + 280, 7);
+        std::fill(lengths + 280, lengths + 288, 8);
+        literals_.build(lengths, 288);
+        std::fill(lengths, lengths + 30, 5);
+        distances_.build(lengths, 30);
+        state_ = State::Codes;
+    } else if (type == 2) {
+        read_dynamic_tables();
+        state_ = State::Codes;
+    } else {
+        corrupt("bad block type");
+    }
+}
+
+void Inflater::read(unsigned char* out, size_t count) {
+    if (!header_read_) {
+        header_read_ = true;
+        if (zlib_header_) {
+            read_zlib_header();
+        }
+    }
+    unsigned char* const begin = out;
+    const size_t requested = count;
+
+    auto emit = [&](unsigned char byte) {
+        window_[window_pos_] = byte;
+        window_pos_ = (window_pos_ + 1) & kWindowMask;
+        *out++ = byte;
+        --count;
+    };
+
+    while (count > 0) {
+        if (pending_length_ > 0) {
+            size_t n = std::min(pending_length_, count);
+            pending_length_ -= n;
+            total_out_ += n;
+            for (size_t i = 0; i < n; ++i) {
+                emit(window_[(window_pos_ - pending_distance_) & kWindowMask]);
+            }
+            continue;
+        }
+
+        switch (state_) {
+        case State::Header:
+            start_block();
+            break;
+
+        case State::Stored: {
+            if (stored_remaining_ == 0) {
+                state_ = final_block_ ? State::Done : State::Header;
+                break;
+            }
+            size_t n = std::min(stored_remaining_, count);
+            stored_remaining_ -= n;
+            total_out_ += n;
+            for (size_t i = 0; i < n; ++i) {
+                // Whole bytes still in the bit buffer come first
+                emit(bit_count_ >= 8 ? static_cast<unsigned char>(get_bits(8)) : static_cast<unsigned char>(next_byte()));
+            }
+            break;
+        }
+
+        case State::Codes: {
+            int symbol = decode(literals_);
+            if (symbol < 256) {
+                ++total_out_;
+                emit(static_cast<unsigned char>(symbol));
+            } else if (symbol == 256) {
+                state_ = final_block_ ? State::Done : State::Header;
+            } else {
+                symbol -= 257;
+                if (symbol >= 29) {
+                    corrupt("bad length code");
+                }
+                size_t length = kLengthBase[symbol] + get_bits(kLengthExtra[symbol]);
+                int distance_symbol = decode(distances_);
+                if (distance_symbol >= 30) {
+                    corrupt("bad distance code");
+                }
+                size_t distance = kDistanceBase[distance_symbol] + get_bits(kDistanceExtra[distance_symbol]);
+                if (distance > total_out_) {
+                    corrupt("distance too far back");
+                }
+                size_t from = (window_pos_ - distance) & kWindowMask;
+                size_t n = std::min(length, count);
+                if (distance >= n && from + n <= kWindowSize && window_pos_ + n <= kWindowSize) {
+                    // No wrap and no self-overlap: copy the run in one go. memmove
+                    // matches the byte order of the copy when from lies ahead.
+                    std::memmove(window_.data() + window_pos_, window_.data() + from, n);
+                    std::memcpy(out, window_.data() + window_pos_, n);
+                    window_pos_ = (window_pos_ + n) & kWindowMask;
+                    out += n;
+                    count -= n;
+                    total_out_ += n;
+                    length -= n;
+                }
+                pending_length_ = length;
+                pending_distance_ = distance;
+            }
+            break;
+        }
+
+        case State::Done:
+            throw std::runtime_error("Deflate stream ended before the expected data.");
+        }
+    }
+    if (zlib_header_) {
+        adler_ = adler32(adler_, begin, requested);
+    }
+}
+
+void Inflater::finish() {
+    if (!header_read_) {
+        read(nullptr, 0);
+    }
+    if (pending_length_ > 0) {
+        corrupt("more data than expected");
+    }
+    while (state_ != State::Done) {
+        switch (state_) {
+        case State::Header:
+            start_block();
+            break;
+        case State::Stored:
+            if (stored_remaining_ > 0) {
+                corrupt("more data than expected");
+            }
+            state_ = final_block_ ? State::Done : State::Header;
+            break;
+        case State::Codes:
+            if (decode(literals_) != 256) {
+                corrupt("more data than expected");
+            }
+            state_ = final_block_ ? State::Done : State::Header;
+            break;
+        case State::Done:
+            break;
+        }
+    }
+    if (zlib_header_) {
+        // Big-endian, starting at the next byte boundary. A truncated stream
+        // reads made-up zeros here, which no Adler-32 equals.
+        get_bits(bit_count_ % 8);
+        uint32_t expected = 0;
+        for (int i = 0; i < 4; ++i) {
+            expected = (expected << 8) | get_bits(8);
+        }
+        if (expected != adler_) {
+            corrupt("Adler-32 checksum mismatch");
+        }
+    }
+}
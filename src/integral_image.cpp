@@ -0,0 +1,124 @@
+#include "../include/integral_image.h"
+#include "../include/image_utils.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Fill a (width + 1) x (height + 1) summed-area table of img, or of img squared
+template <typename T>
+void build_table(ConstImageView img, bool squared, std::vector<T>& table) {
+    const int width = img.width;
+    const int height = img.height;
+    const int channels = img.channels;
+    const size_t stride = static_cast<size_t>(width + 1) * channels;
+    table.assign(stride * (height + 1), 0);
+    std::vector<T> row_sum(channels);
+
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* in = img.row(y);
+        const T* above = table.data() + static_cast<size_t>(y) * stride;
+        T* out = table.data() + static_cast<size_t>(y + 1) * stride;
+        std::fill(row_sum.begin(), row_sum.end(), 0);
+
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                T v = in[x * channels + c];
+                row_sum[c] += squared ? v * v : v;
+                out[(x + 1) * channels + c] = above[(x + 1) * channels + c] + row_sum[c];
+            }
+        }
+    }
+}
+
+// Build into the narrow table when the largest entry fits in 32 bits
+void build(ConstImageView img, bool squared, std::vector<uint32_t>& narrow, std::vector<uint64_t>& wide) {
+    uint64_t max_sample = squared ? 255ull * 255ull : 255ull;
+    uint64_t max_total = max_sample * static_cast<uint64_t>(img.width) * static_cast<uint64_t>(img.height);
+    if (max_total <= std::numeric_limits<uint32_t>::max()) {
+        build_table(img, squared, narrow);
+    } else {
+        build_table(img, squared, wide);
+    }
+}
+
+} // namespace
+
+IntegralImage::IntegralImage(ConstImageView view, bool with_squares)
+    : width_(view.width), height_(view.height), channels_(view.channels), has_squares_(with_squares) {
+    if (width_ <= 0 || height_ <= 0 || channels_ <= 0) {
+        throw std::invalid_argument("Integral image needs positive dimensions.");
+    }
+    build(view, false, sums32_, sums64_);
+    if (with_squares) {
+        build(view, true, squares32_, squares64_);
+    }
+}
+
+IntegralImage::IntegralImage(const unsigned char* img, int width, int height, int channels, bool with_squares)
+    : IntegralImage(ConstImageView(img, width, height, channels), with_squares) {}
+
+IntegralImage::IntegralImage(const Image& image, bool with_squares)
+    : IntegralImage(image.view(), with_squares) {}
+
+// Clamp the rectangle to the image; false if nothing is left
+bool IntegralImage::clamp_rect(int& x0, int& y0, int& x1, int& y1) const {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, width_ - 1);
+    y1 = std::min(y1, height_ - 1);
+    return x0 <= x1 && y0 <= y1;
+}
+
+uint64_t IntegralImage::lookup(const std::vector<uint32_t>& narrow, const std::vector<uint64_t>& wide,
+                               int x0, int y0, int x1, int y1, int c) const {
+    if (!clamp_rect(x0, y0, x1, y1)) {
+        return 0;
+    }
+    const size_t stride = static_cast<size_t>(width_ + 1) * channels_;
+    const size_t top = static_cast<size_t>(y0) * stride;
+    const size_t bottom = static_cast<size_t>(y1 + 1) * stride;
+    const size_t left = static_cast<size_t>(x0) * channels_ + c;
+    const size_t right = static_cast<size_t>(x1 + 1) * channels_ + c;
+
+    // Unsigned wrap-around in the intermediate terms cancels out
+    if (!narrow.empty()) {
+        return uint64_t(narrow[bottom + right]) - narrow[top + right] - narrow[bottom + left] + narrow[top + left];
+    }
+    return wide[bottom + right] - wide[top + right] - wide[bottom + left] + wide[top + left];
+}
+
+int64_t IntegralImage::area(int x0, int y0, int x1, int y1) const {
+    if (!clamp_rect(x0, y0, x1, y1)) {
+        return 0;
+    }
+    return static_cast<int64_t>(x1 - x0 + 1) * (y1 - y0 + 1);
+}
+
+uint64_t IntegralImage::sum(int x0, int y0, int x1, int y1, int c) const {
+    return lookup(sums32_, sums64_, x0, y0, x1, y1, c);
+}
+
+uint64_t IntegralImage::sum_of_squares(int x0, int y0, int x1, int y1, int c) const {
+    if (!has_squares_) {
+        throw std::logic_error("Integral image was built without the sum-of-squares table.");
+    }
+    return lookup(squares32_, squares64_, x0, y0, x1, y1, c);
+}
+
+double IntegralImage::mean(int x0, int y0, int x1, int y1, int c) const {
+    int64_t n = area(x0, y0, x1, y1);
+    return n > 0 ? static_cast<double>(sum(x0, y0, x1, y1, c)) / n : 0.0;
+}
+
+double IntegralImage::variance(int x0, int y0, int x1, int y1, int c) const {
+    int64_t n = area(x0, y0, x1, y1);
+    if (n == 0) {
+        return 0.0;
+    }
+    double m = static_cast<double>(sum(x0, y0, x1, y1, c)) / n;
+    double sq = static_cast<double>(sum_of_squares(x0, y0, x1, y1, c)) / n;
+    return std::max(0.0, sq - m * m);
+}
@@ -0,0 +1,497 @@
+#include "../include/jpeg_writer.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Zigzag position -> natural (row-major) index of the coefficient
+const unsigned char kNaturalOrder[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// Quantisation tables of the JPEG standard (Annex K), natural order
+const unsigned char kLumaQuant[64] = {
+    16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+    14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+    18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99,
+};
+const unsigned char kChromaQuant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+// Huffman tables of the JPEG standard: codes of each length 1-16, then symbols
+const unsigned char kDcLumaCounts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const unsigned char kDcChromaCounts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const unsigned char kDcValues[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+const unsigned char kAcLumaCounts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const unsigned char kAcLumaValues[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71,
+    0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83,
+    0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa,
+};
+const unsigned char kAcChromaCounts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const unsigned char kAcChromaValues[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22,
+    0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36,
+    0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a,
+    0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba,
+    0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa,
+};
+
+struct HuffmanTable {
+    uint16_t code[256] = {};
+    unsigned char length[256] = {};
+};
+
+// Canonical codes from the counts per length, as a decoder rebuilds them
+HuffmanTable build_huffman(const unsigned char* counts, const unsigned char* values) {
+    HuffmanTable table;
+    int code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; ++length) {
+        for (int i = 0; i < counts[length - 1]; ++i, ++k) {
+            table.code[values[k]] = static_cast<uint16_t>(code++);
+            table.length[values[k]] = static_cast<unsigned char>(length);
+        }
+        code <<= 1;
+    }
+    return table;
+}
+
+// Entropy-coded data with 0xFF bytes stuffed
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<unsigned char>& out) : out_(out) {}
+
+    void put(uint32_t value, int length) {
+        bits_ = (bits_ << length) | value;
+        count_ += length;
+        while (count_ >= 8) {
+            count_ -= 8;
+            unsigned char byte = static_cast<unsigned char>(bits_ >> count_);
+            out_.push_back(byte);
+            if (byte == 0xFF) {
+                out_.push_back(0);
+            }
+        }
+    }
+
+    // Fill the last byte with 1 bits
+    void pad() {
+        if (count_ > 0) {
+            put((1u << (8 - count_)) - 1, 8 - count_);
+        }
+    }
+
+private:
+    std::vector<unsigned char>& out_;
+    uint64_t bits_ = 0;
+    int count_ = 0;
+};
+
+// One pass of the AAN forward DCT (as in libjpeg's jfdctflt.c) down each of
+// the eight columns of a row-major block. The loop runs across columns, so every
+// statement works on a whole row and vectorises.
+void fdct_columns(float* d) {
+    for (int i = 0; i < 8; ++i) {
+        float tmp0 = d[0 * 8 + i] + d[7 * 8 + i];
+        float tmp7 = d[0 * 8 + i] - d[7 * 8 + i];
+        float tmp1 = d[1 * 8 + i] + d[6 * 8 + i];
+        float tmp6 = d[1 * 8 + i] - d[6 * 8 + i];
+        float tmp2 = d[2 * 8 + i] + d[5 * 8 + i];
+        float tmp5 = d[2 * 8 + i] - d[5 * 8 + i];
+        float tmp3 = d[3 * 8 + i] + d[4 * 8 + i];
+        float tmp4 = d[3 * 8 + i] - d[4 * 8 + i];
+
+        float tmp10 = tmp0 + tmp3;
+        float tmp13 = tmp0 - tmp3;
+        float tmp11 = tmp1 + tmp2;
+        float tmp12 = tmp1 - tmp2;
+        d[0 * 8 + i] = tmp10 + tmp11;
+        d[4 * 8 + i] = tmp10 - tmp11;
+        float z1 = (tmp12 + tmp13) * 0.707106781f;
+        d[2 * 8 + i] = tmp13 + z1;
+        d[6 * 8 + i] = tmp13 - z1;
+
+        tmp10 = tmp4 + tmp5;
+        tmp11 = tmp5 + tmp6;
+        tmp12 = tmp6 + tmp7;
+        float z5 = (tmp10 - tmp12) * 0.382683433f;
+        float z2 = 0.541196100f * tmp10 + z5;
+        float z4 = 1.306562965f * tmp12 + z5;
+        float z3 = tmp11 * 0.707106781f;
+        float z11 = tmp7 + z3;
+        float z13 = tmp7 - z3;
+        d[5 * 8 + i] = z13 + z2;
+        d[3 * 8 + i] = z13 - z2;
+        d[1 * 8 + i] = z11 + z4;
+        d[7 * 8 + i] = z11 - z4;
+    }
+}
+
+void transpose_block(float* d) {
+    for (int y = 0; y < 8; ++y) {
+        for (int x = y + 1; x < 8; ++x) {
+            std::swap(d[y * 8 + x], d[x * 8 + y]);
+        }
+    }
+}
+
+// Number of bits in |value|, the JPEG magnitude category
+int magnitude_bits(int value) {
+    unsigned magnitude = static_cast<unsigned>(value < 0 ? -value : value);
+    if (magnitude == 0) {
+        return 0;
+    }
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanReverse(&index, magnitude);
+    return static_cast<int>(index) + 1;
+#else
+    return 32 - __builtin_clz(magnitude);
+#endif
+}
+
+// Tables and layout shared by every MCU row
+struct Encoder {
+    ConstImageView img;
+    int components = 1;  // 1 or 3
+    bool subsample = false;
+    int mcu_size = 8;    // pixels on a side: 16 with subsampled chroma
+    int mcus_per_row = 0;
+    int mcu_rows = 0;
+
+    unsigned char quant[2][64];  // luma, chroma; natural order
+    // Reciprocals of the quantisers with the DCT's output scaling folded in, in
+    // the transposed order the two column passes leave coefficients in
+    float divisors[2][64];
+    // Zigzag position -> index in that transposed order
+    unsigned char order[64];
+    HuffmanTable dc[2];
+    HuffmanTable ac[2];
+
+    Encoder(ConstImageView img, const JpegSaveOptions& options);
+
+    void write_headers(std::vector<unsigned char>& out) const;
+    // Entropy-coded data of MCU row row, without the restart marker after it.
+    // planes is scratch space for the row's samples.
+    void encode_row(int row, std::vector<float>& planes, std::vector<unsigned char>& out) const;
+    void encode_block(float* block, int table, int& dc_pred, BitWriter& bits) const;
+};
+
+Encoder::Encoder(ConstImageView image, const JpegSaveOptions& options) : img(image) {
+    components = img.channels >= 3 ? 3 : 1;
+    subsample = components == 3 && options.quality <= 90;
+    mcu_size = subsample ? 16 : 8;
+    mcus_per_row = (img.width + mcu_size - 1) / mcu_size;
+    mcu_rows = (img.height + mcu_size - 1) / mcu_size;
+
+    const int scale = options.quality < 50 ? 5000 / options.quality : 200 - options.quality * 2;
+    // AAN output scaling: coefficient (u, v) comes out 8 * s(u) * s(v) too big
+    const double pi = 3.14159265358979323846;
+    float aan[8];
+    aan[0] = 1.0f;
+    for (int k = 1; k < 8; ++k) {
+        aan[k] = static_cast<float>(std::cos(k * pi / 16) * std::sqrt(2.0));
+    }
+    for (int t = 0; t < 2; ++t) {
+        const unsigned char* base = t == 0 ? kLumaQuant : kChromaQuant;
+        for (int i = 0; i < 64; ++i) {
+            quant[t][i] = static_cast<unsigned char>(std::clamp((base[i] * scale + 50) / 100, 1, 255));
+        }
+        for (int i = 0; i < 64; ++i) {
+            const int u = i / 8;  // horizontal frequency
+            const int v = i % 8;  // vertical frequency
+            divisors[t][i] = 1.0f / (quant[t][v * 8 + u] * 8.0f * aan[u] * aan[v]);
+        }
+    }
+    for (int k = 0; k < 64; ++k) {
+        const int n = kNaturalOrder[k];
+        order[k] = static_cast<unsigned char>((n % 8) * 8 + n / 8);
+    }
+    dc[0] = build_huffman(kDcLumaCounts, kDcValues);
+    ac[0] = build_huffman(kAcLumaCounts, kAcLumaValues);
+    dc[1] = build_huffman(kDcChromaCounts, kDcValues);
+    ac[1] = build_huffman(kAcChromaCounts, kAcChromaValues);
+}
+
+void put_u16(std::vector<unsigned char>& out, int value) {
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+void put_huffman_table(std::vector<unsigned char>& out, int id, const unsigned char* counts,
+                       const unsigned char* values) {
+    out.push_back(static_cast<unsigned char>(id));
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        out.push_back(counts[i]);
+        total += counts[i];
+    }
+    out.insert(out.end(), values, values + total);
+}
+
+void Encoder::write_headers(std::vector<unsigned char>& out) const {
+    static const unsigned char kJfif[] = {0xFF, 0xD8, 0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0,
+                                          1,    1,    0,    0,    1, 0,  1,   0,   0};
+    out.insert(out.end(), kJfif, kJfif + sizeof(kJfif));
+
+    const int tables = components == 3 ? 2 : 1;
+    out.push_back(0xFF);
+    out.push_back(0xDB);
+    put_u16(out, 2 + 65 * tables);
+    for (int t = 0; t < tables; ++t) {
+        out.push_back(static_cast<unsigned char>(t));
+        for (int k = 0; k < 64; ++k) {
+            out.push_back(quant[t][kNaturalOrder[k]]);
+        }
+    }
+
+    out.push_back(0xFF);
+    out.push_back(0xC0);
+    put_u16(out, 8 + 3 * components);
+    out.push_back(8);
+    put_u16(out, img.height);
+    put_u16(out, img.width);
+    out.push_back(static_cast<unsigned char>(components));
+    for (int c = 0; c < components; ++c) {
+        out.push_back(static_cast<unsigned char>(c + 1));
+        out.push_back(c == 0 && subsample ? 0x22 : 0x11);
+        out.push_back(c == 0 ? 0 : 1);
+    }
+
+    out.push_back(0xFF);
+    out.push_back(0xC4);
+    put_u16(out, 2 + (17 + 12) + (17 + 162) + (components == 3 ? (17 + 12) + (17 + 162) : 0));
+    put_huffman_table(out, 0x00, kDcLumaCounts, kDcValues);
+    put_huffman_table(out, 0x10, kAcLumaCounts, kAcLumaValues);
+    if (components == 3) {
+        put_huffman_table(out, 0x01, kDcChromaCounts, kDcValues);
+        put_huffman_table(out, 0x11, kAcChromaCounts, kAcChromaValues);
+    }
+
+    // A restart interval of one MCU row
+    out.push_back(0xFF);
+    out.push_back(0xDD);
+    put_u16(out, 4);
+    put_u16(out, mcus_per_row);
+
+    out.push_back(0xFF);
+    out.push_back(0xDA);
+    put_u16(out, 6 + 2 * components);
+    out.push_back(static_cast<unsigned char>(components));
+    for (int c = 0; c < components; ++c) {
+        out.push_back(static_cast<unsigned char>(c + 1));
+        out.push_back(c == 0 ? 0x00 : 0x11);
+    }
+    out.push_back(0);
+    out.push_back(63);
+    out.push_back(0);
+}
+
+void Encoder::encode_block(float* block, int table, int& dc_pred, BitWriter& bits) const {
+    fdct_columns(block);
+    transpose_block(block);
+    fdct_columns(block);
+
+    int coef[64];
+    const float* divisor = divisors[table];
+    for (int i = 0; i < 64; ++i) {
+        float value = block[i] * divisor[i];
+        coef[i] = static_cast<int>(value + std::copysign(0.5f, value));  // round half away from zero
+    }
+
+    const HuffmanTable& dc_table = dc[table];
+    const HuffmanTable& ac_table = ac[table];
+    int diff = coef[0] - dc_pred;
+    dc_pred = coef[0];
+    int size = magnitude_bits(diff);
+    bits.put(dc_table.code[size], dc_table.length[size]);
+    if (size > 0) {
+        // Negative values are sent as value - 1 in size bits
+        bits.put(static_cast<uint32_t>(diff < 0 ? diff - 1 : diff) & ((1u << size) - 1), size);
+    }
+
+    int run = 0;
+    for (int k = 1; k < 64; ++k) {
+        int value = coef[order[k]];
+        if (value == 0) {
+            ++run;
+            continue;
+        }
+        while (run >= 16) {
+            bits.put(ac_table.code[0xF0], ac_table.length[0xF0]);
+            run -= 16;
+        }
+        size = magnitude_bits(value);
+        const int symbol = (run << 4) | size;
+        bits.put(ac_table.code[symbol], ac_table.length[symbol]);
+        bits.put(static_cast<uint32_t>(value < 0 ? value - 1 : value) & ((1u << size) - 1), size);
+        run = 0;
+    }
+    if (run > 0) {
+        bits.put(ac_table.code[0x00], ac_table.length[0x00]);
+    }
+}
+
+void Encoder::encode_row(int row, std::vector<float>& planes, std::vector<unsigned char>& out) const {
+    // Level-shifted Y, Cb and Cr of the row's pixels at full resolution, padded
+    // to whole MCUs by repeating the last column and row
+    const int plane_width = mcus_per_row * mcu_size;
+    const size_t plane_size = static_cast<size_t>(plane_width) * mcu_size;
+    planes.resize(plane_size * components);
+    float* y_plane = planes.data();
+    float* cb_plane = components == 3 ? y_plane + plane_size : nullptr;
+    float* cr_plane = components == 3 ? cb_plane + plane_size : nullptr;
+    const int channels = img.channels;
+    for (int r = 0; r < mcu_size; ++r) {
+        const unsigned char* src = img.row(std::min(row * mcu_size + r, img.height - 1));
+        const size_t offset = static_cast<size_t>(r) * plane_width;
+        if (components == 3) {
+            for (int x = 0; x < img.width; ++x) {
+                const float red = src[x * channels];
+                const float green = src[x * channels + 1];
+                const float blue = src[x * channels + 2];
+                y_plane[offset + x] = 0.29900f * red + 0.58700f * green + 0.11400f * blue - 128.0f;
+                cb_plane[offset + x] = -0.16874f * red - 0.33126f * green + 0.50000f * blue;
+                cr_plane[offset + x] = 0.50000f * red - 0.41869f * green - 0.08131f * blue;
+            }
+            std::fill(cb_plane + offset + img.width, cb_plane + offset + plane_width, cb_plane[offset + img.width - 1]);
+            std::fill(cr_plane + offset + img.width, cr_plane + offset + plane_width, cr_plane[offset + img.width - 1]);
+        } else {
+            for (int x = 0; x < img.width; ++x) {
+                y_plane[offset + x] = src[x * channels] - 128.0f;
+            }
+        }
+        std::fill(y_plane + offset + img.width, y_plane + offset + plane_width, y_plane[offset + img.width - 1]);
+    }
+
+    BitWriter bits(out);
+    int dc_y = 0;
+    int dc_cb = 0;
+    int dc_cr = 0;
+    alignas(32) float block[64];
+    auto load = [&](const float* plane, int x0, int y0) {
+        for (int y = 0; y < 8; ++y) {
+            std::copy(plane + (y0 + y) * plane_width + x0, plane + (y0 + y) * plane_width + x0 + 8, block + y * 8);
+        }
+    };
+    // Mean of each 2x2 block of a 16x16 area
+    auto load_subsampled = [&](const float* plane, int x0) {
+        for (int y = 0; y < 8; ++y) {
+            const float* a = plane + (2 * y) * plane_width + x0;
+            const float* b = a + plane_width;
+            for (int x = 0; x < 8; ++x) {
+                block[y * 8 + x] = 0.25f * (a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1]);
+            }
+        }
+    };
+    for (int mcu = 0; mcu < mcus_per_row; ++mcu) {
+        const int x0 = mcu * mcu_size;
+        for (int by = 0; by < mcu_size; by += 8) {
+            for (int bx = 0; bx < mcu_size; bx += 8) {
+                load(y_plane, x0 + bx, by);
+                encode_block(block, 0, dc_y, bits);
+            }
+        }
+        if (components == 3) {
+            if (subsample) {
+                load_subsampled(cb_plane, x0);
+                encode_block(block, 1, dc_cb, bits);
+                load_subsampled(cr_plane, x0);
+                encode_block(block, 1, dc_cr, bits);
+            } else {
+                load(cb_plane, x0, 0);
+                encode_block(block, 1, dc_cb, bits);
+                load(cr_plane, x0, 0);
+                encode_block(block, 1, dc_cr, bits);
+            }
+        }
+    }
+    bits.pad();
+}
+
+} // namespace
+
+void encode_jpeg(ConstImageView img, std::vector<unsigned char>& out, const JpegSaveOptions& options) {
+    if (img.empty()) {
+        throw std::invalid_argument("Image dimensions must be positive.");
+    }
+    if (img.width > 65535 || img.height > 65535) {
+        throw std::invalid_argument("JPEG images are at most 65535 pixels on a side.");
+    }
+    if (options.quality < 1 || options.quality > 100) {
+        throw std::invalid_argument("JPEG quality must be between 1 and 100.");
+    }
+    if (options.threads < 0) {
+        throw std::invalid_argument("JPEG encode threads must be non-negative.");
+    }
+    const Encoder encoder(img, options);
+
+    std::vector<std::vector<unsigned char>> segments(encoder.mcu_rows);
+    const int threads = options.threads == 0 ? num_threads() : options.threads;
+    const int workers = std::min(threads, encoder.mcu_rows);
+    default_thread_pool().run(workers, [&](int worker) {
+        std::vector<float> planes;
+        for (int row = worker; row < encoder.mcu_rows; row += workers) {
+            encoder.encode_row(row, planes, segments[row]);
+        }
+    });
+
+    out.clear();
+    size_t total = 1024;
+    for (const std::vector<unsigned char>& segment : segments) {
+        total += segment.size() + 2;
+    }
+    out.reserve(total);
+    encoder.write_headers(out);
+    for (int row = 0; row < encoder.mcu_rows; ++row) {
+        out.insert(out.end(), segments[row].begin(), segments[row].end());
+        if (row + 1 < encoder.mcu_rows) {
+            out.push_back(0xFF);
+            out.push_back(static_cast<unsigned char>(0xD0 + (row & 7)));
+        }
+    }
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+}
+
+void save_jpeg(ConstImageView img, const std::string& filepath, const JpegSaveOptions& options) {
+    std::vector<unsigned char> data;
+    encode_jpeg(img, data, options);
+    FILE* file = std::fopen(filepath.c_str(), "wb");
+    if (file == nullptr) {
+        throw std::runtime_error("Error saving JPG image: " + filepath);
+    }
+    const bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (std::fclose(file) != 0 || !written) {
+        std::remove(filepath.c_str());
+        throw std::runtime_error("Error saving JPG image: " + filepath);
+    }
+}
@@ -0,0 +1,687 @@
+#include "../include/lazy_image.h"
+#include "../include/buffer_pool.h"
+#include "../include/crop.h"
+#include "../include/downsample.h"
+#include "../include/profiler.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+enum class Op {
+    Source,
+    Point,
+    Grayscale,
+    Sepia,
+    Blur,
+    HighPass,
+    Otsu,
+    AdaptiveThreshold,
+    LocalContrast,
+    Normalize,
+    Resize,
+    Downsample,
+    Crop,
+    Add,
+    Subtract,
+};
+
+// Every output sample is written after the last read of the input sample at the
+// same position and of nothing else, so output and input may be one buffer
+bool in_place_safe(Op op) {
+    switch (op) {
+    case Op::Point:
+    case Op::Grayscale:
+    case Op::Sepia:
+    case Op::Otsu:               // histogram first, then a per-sample map
+    case Op::AdaptiveThreshold:  // integral image first, then per sample
+    case Op::LocalContrast:
+    case Op::Normalize:
+    case Op::Add:
+    case Op::Subtract:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Same-size operations reading a fixed neighbourhood, which can run tile by tile
+bool tileable(Op op) {
+    switch (op) {
+    case Op::Point:
+    case Op::Grayscale:
+    case Op::Sepia:
+    case Op::Blur:
+    case Op::HighPass:
+    case Op::AdaptiveThreshold:
+    case Op::LocalContrast:
+    case Op::Normalize:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Pixels read on each side of an output pixel
+int radius(Op op, int size) {
+    switch (op) {
+    case Op::Blur:
+    case Op::HighPass:
+    case Op::AdaptiveThreshold:
+    case Op::LocalContrast:
+    case Op::Normalize:
+        return size / 2;
+    default:
+        return 0;
+    }
+}
+
+// Scratch for one tile: the two buffers a chain alternates between, halo
+// included, sized to stay in L2
+constexpr size_t kTileBytes = size_t(512) << 10;
+
+// Edge of the output tiles for a chain reading halo pixels around each tile.
+// Tiles are kept at least eight halos wide, so the halo adds at most about half
+// again to the work.
+int tile_edge(int channels, int halo, int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    const int fit = static_cast<int>(std::sqrt(kTileBytes / (2.0 * channels))) - 2 * halo;
+    return std::max({fit, 8 * halo, 16});
+}
+
+// "name:arg:arg", as in pipeline specs
+std::string with_args(const char* name, std::initializer_list<double> args) {
+    std::ostringstream text;
+    text << name;
+    for (double arg : args) {
+        text << ':' << arg;
+    }
+    return text.str();
+}
+
+bool same_rect(const Rect& a, const Rect& b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+} // namespace
+
+struct LazyImage::Node {
+    Op op = Op::Source;
+    std::string name;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<std::shared_ptr<const Node>> inputs;
+
+    std::shared_ptr<const Image> source;  // Source
+    PointPipeline points;                 // Point
+    int size = 0;                         // filter, block or window size, or downsample factor
+    int offset = 0;
+    float strength = 0;
+    ResizeFilter filter = ResizeFilter::Bilinear;
+    Rect rect;                            // Crop
+};
+
+struct LazyImage::Plan {
+    // One operation; point operations carry every stage fused into them
+    struct Kernel {
+        const Node* node = nullptr;
+        PointPipeline points;
+        std::string description;
+    };
+    // Where a step's result lives: a rectangle of a buffer or of a source image
+    struct Value {
+        int buffer = -1;  // -1: source
+        const Image* source = nullptr;
+        int source_index = 0;
+        Rect rect;
+    };
+    struct Step {
+        std::vector<Kernel> kernels;  // several: a chain run tile by tile
+        int tile = 0;                 // output tile edge of a chain
+        int halo = 0;                 // context the whole chain reads around a tile
+        std::vector<int> inputs;      // step indices
+        Value out;
+        bool in_place = false;
+        int last_use = 0;             // last step reading out
+        std::vector<int> release;     // buffers no later step touches
+
+        // The last operation, which sets the result's size
+        const Node& node() const { return *kernels.back().node; }
+    };
+    struct Buffer {
+        int width;
+        int height;
+        int channels;
+    };
+
+    std::vector<Step> steps;  // in execution order; the last is the result
+    std::vector<Buffer> buffers;
+};
+
+LazyImage::LazyImage(Image source) {
+    if (source.empty()) {
+        throw std::invalid_argument("Lazy image source is empty.");
+    }
+    auto node = std::make_shared<Node>();
+    node->name = "source";
+    node->width = source.width;
+    node->height = source.height;
+    node->channels = source.channels;
+    node->source = std::make_shared<const Image>(std::move(source));
+    node_ = std::move(node);
+}
+
+LazyImage::LazyImage(std::shared_ptr<const Node> node) : node_(std::move(node)) {}
+
+int LazyImage::width() const { return node_->width; }
+int LazyImage::height() const { return node_->height; }
+int LazyImage::channels() const { return node_->channels; }
+
+// New node reading this one; the size carries over unless node sets one
+LazyImage LazyImage::then(Node node) const {
+    node.inputs.insert(node.inputs.begin(), node_);
+    if (node.width == 0) {
+        node.width = node_->width;
+        node.height = node_->height;
+        node.channels = node_->channels;
+    }
+    return LazyImage(std::make_shared<const Node>(std::move(node)));
+}
+
+LazyImage LazyImage::point(const std::string& name, const PointPipeline& points) const {
+    Node node;
+    node.op = Op::Point;
+    node.name = name;
+    node.points = points;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::brightness(int adjustment) const {
+    return point("brightness", PointPipeline().brightness(adjustment));
+}
+
+LazyImage LazyImage::contrast(float contrast_factor) const {
+    return point("contrast", PointPipeline().contrast(contrast_factor));
+}
+
+LazyImage LazyImage::threshold(unsigned char threshold) const {
+    return point("threshold", PointPipeline().threshold(threshold));
+}
+
+LazyImage LazyImage::gamma(float gamma) const {
+    return point("gamma", PointPipeline().gamma(gamma));
+}
+
+LazyImage LazyImage::invert() const {
+    return point("invert", PointPipeline().invert());
+}
+
+LazyImage LazyImage::lut(const Lut& lut) const {
+    return point("lut", PointPipeline().lut(lut));
+}
+
+LazyImage LazyImage::grayscale() const {
+    if (channels() < 3) {
+        throw std::invalid_argument("Image must have at least 3 channels for grayscale conversion.");
+    }
+    Node node;
+    node.op = Op::Grayscale;
+    node.name = "grayscale";
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::sepia() const {
+    if (channels() < 3) {
+        throw std::invalid_argument("Image must have at least 3 channels for sepia conversion.");
+    }
+    Node node;
+    node.op = Op::Sepia;
+    node.name = "sepia";
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::blur(int filter_size) const {
+    if (filter_size < 0) {
+        throw std::invalid_argument("Filter size must be non-negative.");
+    }
+    Node node;
+    node.op = Op::Blur;
+    node.name = with_args("blur", {double(filter_size)});
+    node.size = filter_size;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::high_pass(int filter_size) const {
+    // The kernel is 3x3, so the halo is one pixel
+    if (filter_size < 2 || filter_size > 3) {
+        throw std::invalid_argument("High-pass filter size must be 2 or 3.");
+    }
+    Node node;
+    node.op = Op::HighPass;
+    node.name = with_args("high_pass", {double(filter_size)});
+    node.size = filter_size;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::otsu_threshold() const {
+    Node node;
+    node.op = Op::Otsu;
+    node.name = "otsu_threshold";
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::adaptive_threshold(int block_size, int offset) const {
+    if (block_size < 1) {
+        throw std::invalid_argument("Block size must be positive.");
+    }
+    Node node;
+    node.op = Op::AdaptiveThreshold;
+    node.name = with_args("adaptive_threshold", {double(block_size), double(offset)});
+    node.size = block_size;
+    node.offset = offset;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::enhance_local_contrast(int window_size, float strength) const {
+    if (window_size < 1) {
+        throw std::invalid_argument("Window size must be positive.");
+    }
+    Node node;
+    node.op = Op::LocalContrast;
+    node.name = with_args("enhance_local_contrast", {double(window_size), strength});
+    node.size = window_size;
+    node.strength = strength;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::normalize_local_contrast(int window_size) const {
+    if (window_size < 1) {
+        throw std::invalid_argument("Window size must be positive.");
+    }
+    Node node;
+    node.op = Op::Normalize;
+    node.name = with_args("normalize_local_contrast", {double(window_size)});
+    node.size = window_size;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::resize(int width, int height, ResizeFilter filter) const {
+    if (width <= 0 || height <= 0) {
+        throw std::invalid_argument("Resize needs positive dimensions.");
+    }
+    Node node;
+    node.op = Op::Resize;
+    node.name = with_args("resize", {double(width), double(height)});
+    node.width = width;
+    node.height = height;
+    node.channels = channels();
+    node.filter = filter;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::downsample(int factor) const {
+    if (factor < 1) {
+        throw std::invalid_argument("Downsample factors must be positive.");
+    }
+    Node node;
+    node.op = Op::Downsample;
+    node.name = with_args("downsample", {double(factor)});
+    node.width = downsampled_size(width(), factor);
+    node.height = downsampled_size(height(), factor);
+    node.channels = channels();
+    node.size = factor;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::crop(const Rect& rect) const {
+    if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0 ||
+        rect.x > width() - rect.width || rect.y > height() - rect.height) {
+        throw std::invalid_argument("Crop rectangle lies outside the image.");
+    }
+    Node node;
+    node.op = Op::Crop;
+    node.name = with_args("crop", {double(rect.x), double(rect.y), double(rect.width), double(rect.height)});
+    node.width = rect.width;
+    node.height = rect.height;
+    node.channels = channels();
+    node.rect = rect;
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::add(const LazyImage& other) const {
+    if (width() != other.width() || height() != other.height() || channels() != other.channels()) {
+        throw std::invalid_argument("Images must have the same dimensions and number of channels.");
+    }
+    Node node;
+    node.op = Op::Add;
+    node.name = "add";
+    node.inputs.push_back(other.node_);
+    return then(std::move(node));
+}
+
+LazyImage LazyImage::subtract(const LazyImage& other) const {
+    if (width() != other.width() || height() != other.height() || channels() != other.channels()) {
+        throw std::invalid_argument("Images must have the same dimensions and number of channels.");
+    }
+    Node node;
+    node.op = Op::Subtract;
+    node.name = "subtract";
+    node.inputs.push_back(other.node_);
+    return then(std::move(node));
+}
+
+
+LazyImage::Plan LazyImage::make_plan(const TileOptions& tiles) const {
+    // Nodes in dependency order (iteratively, as chains can be long), and how
+    // many times each is read
+    std::vector<const Node*> order;
+    std::unordered_map<const Node*, int> readers;
+    std::vector<std::pair<const Node*, size_t>> stack{{node_.get(), 0}};
+    readers[node_.get()] = 0;
+    while (!stack.empty()) {
+        auto& [node, next] = stack.back();
+        if (next == node->inputs.size()) {
+            order.push_back(node);
+            stack.pop_back();
+            continue;
+        }
+        const Node* input = node->inputs[next++].get();
+        if (readers[input]++ == 0) {
+            stack.emplace_back(input, 0);
+        }
+    }
+
+    Plan plan;
+    std::unordered_map<const Node*, int> step_of;
+    auto kernel = [](const Node* node) {
+        return Plan::Kernel{node, node->points, node->op == Op::Point ? "lut(" + node->name + ")" : node->name};
+    };
+    auto tiled = [&](const Plan::Step& step) {
+        return std::all_of(step.kernels.begin(), step.kernels.end(),
+                           [](const Plan::Kernel& kernel) { return tileable(kernel.node->op); });
+    };
+    for (const Node* node : order) {
+        if (node->inputs.size() == 1 && readers[node->inputs[0].get()] == 1) {
+            const Node* input = node->inputs[0].get();
+            Plan::Step& step = plan.steps[step_of[input]];
+            // A point operation on a point operation that nothing else reads joins its table
+            if (node->op == Op::Point && input->op == Op::Point) {
+                Plan::Kernel& last = step.kernels.back();
+                last.node = node;
+                last.points.then(node->points);
+                last.description.insert(last.description.size() - 1, ", " + node->name);
+                step_of[node] = step_of[input];
+                continue;
+            }
+            // Likewise any tileable operation joins a tileable chain
+            const size_t bytes = static_cast<size_t>(node->width) * node->height * node->channels;
+            const bool big = tiles.tile_size > 0 ? std::max(node->width, node->height) > tiles.tile_size
+                                                 : bytes > kTileBytes;
+            if (tiles.enabled && big && tileable(node->op) && tiled(step)) {
+                step.kernels.push_back(kernel(node));
+                step_of[node] = step_of[input];
+                continue;
+            }
+        }
+        Plan::Step step;
+        step.kernels.push_back(kernel(node));
+        for (const auto& input : node->inputs) {
+            step.inputs.push_back(step_of[input.get()]);
+        }
+        step_of[node] = static_cast<int>(plan.steps.size());
+        plan.steps.push_back(std::move(step));
+    }
+
+    const int count = static_cast<int>(plan.steps.size());
+    for (int i = 0; i < count; ++i) {
+        Plan::Step& step = plan.steps[i];
+        for (int input : step.inputs) {
+            plan.steps[input].last_use = i;
+        }
+        if (step.kernels.size() > 1) {
+            for (const Plan::Kernel& kernel : step.kernels) {
+                step.halo += radius(kernel.node->op, kernel.node->size);
+            }
+            step.tile = tile_edge(step.node().channels, step.halo, tiles.tile_size);
+        }
+    }
+    plan.steps.back().last_use = count;
+
+    // Live values per buffer, and buffers whose values are all dead
+    std::vector<int> refs;
+    std::vector<int> free_buffers;
+    int sources = 0;
+    for (int i = 0; i < count; ++i) {
+        Plan::Step& step = plan.steps[i];
+        const Node& node = step.node();
+        std::vector<int> inputs = step.inputs;
+        std::sort(inputs.begin(), inputs.end());
+        inputs.erase(std::unique(inputs.begin(), inputs.end()), inputs.end());
+        int reused = -1;
+
+        if (node.op == Op::Source) {
+            step.out.source = node.source.get();
+            step.out.source_index = sources++;
+            step.out.rect = {0, 0, node.width, node.height};
+        } else if (node.op == Op::Crop) {
+            step.out = plan.steps[step.inputs[0]].out;
+            step.out.rect = {step.out.rect.x + node.rect.x, step.out.rect.y + node.rect.y, node.rect.width, node.rect.height};
+            if (step.out.buffer >= 0) {
+                ++refs[step.out.buffer];
+            }
+        } else {
+            // Tiles read their neighbours' pixels, so a chain always writes a new buffer
+            if (step.kernels.size() == 1 && in_place_safe(node.op)) {
+                for (int input : inputs) {
+                    const Plan::Value& value = plan.steps[input].out;
+                    if (value.buffer >= 0 && plan.steps[input].last_use == i && refs[value.buffer] == 1) {
+                        step.out = value;
+                        step.in_place = true;
+                        reused = input;
+                        break;
+                    }
+                }
+            }
+            if (!step.in_place) {
+                auto it = std::find_if(free_buffers.begin(), free_buffers.end(), [&](int b) {
+                    const Plan::Buffer& buffer = plan.buffers[b];
+                    return buffer.width == node.width && buffer.height == node.height && buffer.channels == node.channels;
+                });
+                if (it != free_buffers.end()) {
+                    step.out.buffer = *it;
+                    free_buffers.erase(it);
+                } else {
+                    step.out.buffer = static_cast<int>(plan.buffers.size());
+                    plan.buffers.push_back({node.width, node.height, node.channels});
+                    refs.push_back(0);
+                }
+                step.out.rect = {0, 0, node.width, node.height};
+                refs[step.out.buffer] = 1;
+            }
+        }
+
+        for (int input : inputs) {
+            const int buffer = plan.steps[input].out.buffer;
+            if (input != reused && plan.steps[input].last_use == i && buffer >= 0 && --refs[buffer] == 0) {
+                free_buffers.push_back(buffer);
+            }
+        }
+    }
+
+    // Free each buffer after the last step that touches it; the result's is handed out
+    std::vector<int> last_touch(plan.buffers.size(), -1);
+    for (int i = 0; i < count; ++i) {
+        const Plan::Step& step = plan.steps[i];
+        if (step.out.buffer >= 0) {
+            last_touch[step.out.buffer] = i;
+        }
+        for (int input : step.inputs) {
+            if (plan.steps[input].out.buffer >= 0) {
+                last_touch[plan.steps[input].out.buffer] = i;
+            }
+        }
+    }
+    for (int b = 0; b < static_cast<int>(plan.buffers.size()); ++b) {
+        if (b != plan.steps.back().out.buffer) {
+            plan.steps[last_touch[b]].release.push_back(b);
+        }
+    }
+    return plan;
+}
+
+Image LazyImage::evaluate(std::shared_ptr<ImageAllocator> allocator, const TileOptions& tiles) const {
+    const size_t pixels = static_cast<size_t>(width()) * height();
+    ProfileScope profile("LazyImage::evaluate", 0, pixels * channels(), pixels);
+    if (!allocator) {
+        allocator = default_buffer_pool();
+    }
+    const Plan plan = make_plan(tiles);
+    std::vector<std::optional<Image>> buffers(plan.buffers.size());
+
+    auto whole = [&](const Plan::Value& value) -> ConstImageView {
+        return value.buffer >= 0 ? ConstImageView(buffers[value.buffer]->view()) : value.source->view();
+    };
+
+    // One operation from in to out; target is any image to call it through
+    auto run_kernel = [](const Plan::Kernel& kernel, Image& target, const std::vector<ConstImageView>& in,
+                         ImageView out, bool in_place) {
+        const Node& node = *kernel.node;
+        // Operations that only run in place get a copy of their input first
+        const bool copy_first = !in_place && (node.op == Op::Grayscale || node.op == Op::Sepia ||
+                                              (node.op == Op::Point && !(in[0].contiguous() && out.contiguous())));
+        if (copy_first) {
+            ::crop(in[0], Rect{0, 0, in[0].width, in[0].height}, out);
+        }
+
+        switch (node.op) {
+        case Op::Point:
+            if (in_place || copy_first) {
+                kernel.points.apply(out);
+            } else {
+                kernel.points.apply(in[0].data, out.data, out.row_bytes() * out.height);
+            }
+            break;
+        case Op::Grayscale: target.convert_to_grayscale(out); break;
+        case Op::Sepia: target.convert_to_sepia(out); break;
+        case Op::Blur: target.low_pass_filter(in[0], out, node.size); break;
+        case Op::HighPass: target.high_pass_filter(in[0], out, node.size); break;
+        case Op::Otsu: target.otsu_threshold(in[0], out); break;
+        case Op::AdaptiveThreshold: target.adaptive_threshold(in[0], out, node.size, node.offset); break;
+        case Op::LocalContrast: target.enhance_local_contrast(in[0], out, node.size, node.strength); break;
+        case Op::Normalize: target.normalize_local_contrast(in[0], out, node.size); break;
+        case Op::Resize: target.resize_image(in[0], out, node.filter); break;
+        case Op::Downsample: target.downsample_image(in[0], out, node.size); break;
+        case Op::Add: target.add_images(in[0], in[1], out); break;
+        case Op::Subtract: target.subtract_images(in[0], in[1], out); break;
+        case Op::Source:
+        case Op::Crop:
+            break;
+        }
+    };
+
+    // A chain over tiles: each tile plus its halo goes through every kernel in
+    // two scratch tiles, then its own pixels are copied out
+    auto run_tiles = [&](const Plan::Step& step, ConstImageView in, ImageView out) {
+        const int halo = step.halo;
+        parallel_tiles(out.width, out.height, step.tile, step.tile, [&](int x0, int y0, int x1, int y1) {
+            const int hx0 = std::max(0, x0 - halo);
+            const int hy0 = std::max(0, y0 - halo);
+            const int w = std::min(out.width, x1 + halo) - hx0;
+            const int h = std::min(out.height, y1 + halo) - hy0;
+            Image scratch[2] = {Image::uninitialized(w, h, out.channels, allocator),
+                                Image::uninitialized(w, h, out.channels, allocator)};
+            int current = 0;
+            run_kernel(step.kernels[0], scratch[0], {in.region(hx0, hy0, w, h)}, scratch[0].view(), false);
+            for (size_t k = 1; k < step.kernels.size(); ++k) {
+                if (in_place_safe(step.kernels[k].node->op)) {
+                    run_kernel(step.kernels[k], scratch[current], {scratch[current].view()}, scratch[current].view(), true);
+                } else {
+                    run_kernel(step.kernels[k], scratch[1 - current], {scratch[current].view()}, scratch[1 - current].view(), false);
+                    current = 1 - current;
+                }
+            }
+            ::crop(scratch[current].view(), Rect{x0 - hx0, y0 - hy0, x1 - x0, y1 - y0}, out.region(x0, y0, x1 - x0, y1 - y0));
+        });
+    };
+
+    for (const Plan::Step& step : plan.steps) {
+        const Node& node = step.node();
+        if (node.op == Op::Source || node.op == Op::Crop) {
+            continue;  // views only
+        }
+        const int b = step.out.buffer;
+        if (!buffers[b]) {
+            const Plan::Buffer& size = plan.buffers[b];
+            buffers[b].emplace(Image::uninitialized(size.width, size.height, size.channels, allocator));
+        }
+        ImageView out = buffers[b]->view().region(step.out.rect);
+        std::vector<ConstImageView> in;
+        for (int input : step.inputs) {
+            const Plan::Value& value = plan.steps[input].out;
+            in.push_back(whole(value).region(value.rect));
+        }
+        if (step.kernels.size() > 1) {
+            run_tiles(step, in[0], out);
+        } else {
+            run_kernel(step.kernels[0], *buffers[b], in, out, step.in_place);
+        }
+
+        for (int released : step.release) {
+            buffers[released].reset();
+        }
+    }
+
+    // The result's own buffer goes out as it is; a view of a source or of a
+    // bigger buffer is copied
+    const Plan::Value& result = plan.steps.back().out;
+    if (result.buffer >= 0 && same_rect(result.rect, Rect{0, 0, buffers[result.buffer]->width, buffers[result.buffer]->height})) {
+        return std::move(*buffers[result.buffer]);
+    }
+    Image image = Image::uninitialized(result.rect.width, result.rect.height, node_->channels, allocator);
+    ::crop(whole(result), result.rect, image.view());
+    return image;
+}
+
+std::string LazyImage::plan(const TileOptions& tiles) const {
+    const Plan plan = make_plan(tiles);
+    auto name = [](const Plan::Value& value) {
+        return value.buffer >= 0 ? "buffer " + std::to_string(value.buffer) : "source " + std::to_string(value.source_index);
+    };
+    std::string text;
+    for (const Plan::Step& step : plan.steps) {
+        if (step.node().op == Op::Source) {
+            continue;
+        }
+        if (step.kernels.size() > 1) {
+            text += "tiles " + std::to_string(step.tile) + " halo " + std::to_string(step.halo) + " [";
+            for (size_t k = 0; k < step.kernels.size(); ++k) {
+                text += (k ? " -> " : "") + step.kernels[k].description;
+            }
+            text += "]";
+        } else {
+            text += step.kernels[0].description;
+        }
+        text += " (";
+        for (size_t i = 0; i < step.inputs.size(); ++i) {
+            text += (i ? ", " : "") + name(plan.steps[step.inputs[i]].out);
+        }
+        text += ") -> ";
+        if (step.node().op == Op::Crop) {
+            text += "view of ";
+        }
+        text += name(step.out) + (step.in_place ? ", in place" : "") + "\n";
+    }
+    return text + std::to_string(plan.buffers.size()) + " buffers";
+}
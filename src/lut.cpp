@@ -0,0 +1,82 @@
+#include "../include/lut.h"
+#include "../include/simd_kernels.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+std::array<unsigned char, 256> identity_table() {
+    std::array<unsigned char, 256> table;
+    for (int i = 0; i < 256; ++i) {
+        table[i] = static_cast<unsigned char>(i);
+    }
+    return table;
+}
+
+} // namespace
+
+Lut::Lut() : table_(identity_table()) {}
+
+Lut::Lut(const std::array<unsigned char, 256>& table) : table_(table) {}
+
+// The per-byte reference kernels define the tables, so a table gives exactly
+// what the direct operation would
+Lut Lut::brightness(int adjustment) {
+    Lut lut;
+    scalar::add_scalar_saturate(lut.table_.data(), lut.table_.data(), 256, adjustment);
+    return lut;
+}
+
+Lut Lut::contrast(float contrast_factor) {
+    Lut lut;
+    scalar::contrast_bytes(lut.table_.data(), lut.table_.data(), 256, contrast_factor);
+    return lut;
+}
+
+Lut Lut::threshold(unsigned char threshold) {
+    Lut lut;
+    scalar::threshold_bytes(lut.table_.data(), lut.table_.data(), 256, threshold);
+    return lut;
+}
+
+Lut Lut::gamma(float gamma) {
+    if (!(gamma > 0.0f)) {
+        throw std::invalid_argument("Gamma must be positive.");
+    }
+    return from_curve([gamma](int v) {
+        return static_cast<int>(std::lround(255.0 * std::pow(v / 255.0, 1.0 / gamma)));
+    });
+}
+
+Lut Lut::invert() {
+    return from_curve([](int v) { return 255 - v; });
+}
+
+Lut Lut::from_curve(const std::function<int(int)>& curve) {
+    std::array<unsigned char, 256> table;
+    for (int i = 0; i < 256; ++i) {
+        table[i] = static_cast<unsigned char>(std::clamp(curve(i), 0, 255));
+    }
+    return Lut(table);
+}
+
+Lut Lut::then(const Lut& next) const {
+    std::array<unsigned char, 256> table;
+    for (int i = 0; i < 256; ++i) {
+        table[i] = next.table_[table_[i]];
+    }
+    return Lut(table);
+}
+
+bool Lut::is_identity() const {
+    return table_ == identity_table();
+}
+
+void Lut::apply(const unsigned char* in, unsigned char* out, size_t count) const {
+    parallel_for(count, kMinChunkBytes, [&](size_t begin, size_t end) {
+        lut_bytes(in + begin, out + begin, end - begin, table_.data());
+    });
+}
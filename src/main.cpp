@@ -1,131 +1,112 @@
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 #include <string>
-#include <memory>
-#include "../include/image_utils.h"
-#
-
-// Helper function to validate image dimensions
-bool validate_dimensions(const Image& img1, const Image& img2) {
-    return img1.width == img2.width && img1.height == img2.height && img1.channels == img2.channels;
+#include "../include/batch_processor.h"
+#include "../include/image_pipeline.h"
+
+namespace {
+
+void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <pipeline> <inputs> <output dir> [options]\n"
+              << "\n"
+              << "  pipeline    steps such as \"resize:0.5,contrast:1.5,otsu\", or @file to read\n"
+              << "              them from a config file (see image_pipeline.h for the steps)\n"
+              << "  inputs      a directory, one image, or a text file listing images\n"
+              << "\n"
+              << "Options:\n"
+              << "  --format EXT        output extension: .png, .jpg, .pgm/.ppm or .raw\n"
+              << "                      (default: each input's own where it can be written)\n"
+              << "  --threads D,P,E     decode, process and encode threads (default 2,2,2)\n"
+              << "  --quality Q         JPEG quality 1-100 (default " << kDefaultJpegQuality << ")\n"
+              << "  --level L           PNG compression level 0-9 (default 3)\n"
+              << "  --profile           print time, bytes and throughput per operation\n"
+              << "  --dry-run           print the compiled pipeline and the inputs, then stop\n";
 }
 
-// Helper function to save an image with new data
-void save_image_with_data(const Image& base_image, const unsigned char* data, const std::string& filename) {
-    Image temp_image(base_image);
-   // Create a mutable copy of the data
-    std::unique_ptr<unsigned char[]> mutable_data(new unsigned char[base_image.width * base_image.height * base_image.channels]);
-    std::memcpy(mutable_data.get(), data, base_image.width * base_image.height * base_image.channels);
-
-    temp_image.data = mutable_data.get();
-    temp_image.save_as_png(filename);
-
+// "D,P,E" into the three stage thread counts
+void parse_threads(const std::string& text, BatchOptions& options) {
+    int* const counts[] = {&options.decode_threads, &options.process_threads, &options.encode_threads};
+    size_t begin = 0;
+    for (int i = 0; i < 3; ++i) {
+        size_t end = text.find(',', begin);
+        if ((end == std::string::npos) != (i == 2)) {
+            throw std::invalid_argument("--threads takes three counts, e.g. 2,4,2");
+        }
+        *counts[i] = std::stoi(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
 }
 
-int main() {
-    try {
-        // Load two images for testing
-        Image img1("/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/images/test_image1.png"); 
-        Image img2("/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/images/test_image2.png");
-
-        // Resize images if their dimensions differ
-        if (!validate_dimensions(img1, img2)) {
-            std::cout << "Resizing images to match dimensions..." << std::endl;
-
-            int new_width = std::min(img1.width, img2.width);
-            int new_height = std::min(img1.height, img2.height);
-
-            std::unique_ptr<unsigned char[]> resized_data1(new unsigned char[new_width * new_height * img1.channels]);
-            std::unique_ptr<unsigned char[]> resized_data2(new unsigned char[new_width * new_height * img2.channels]);
-
-            img1.resize_image(img1.data, resized_data1.get(), img1.width, img1.height, new_width, new_height, img1.channels);
-            img2.resize_image(img2.data, resized_data2.get(), img2.width, img2.height, new_width, new_height, img2.channels);
-
-            img1.data = resized_data1.get();
-            img1.width = new_width;
-            img1.height = new_height;
-
-            img2.data = resized_data2.get();
-            img2.width = new_width;
-            img2.height = new_height;
+int run(int argc, char** argv) {
+    if (argc < 4) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    const std::string spec = argv[1];
+    const ImagePipeline pipeline = spec[0] == '@' ? ImagePipeline::load(spec.substr(1)) : ImagePipeline::parse(spec);
+
+    BatchOptions options;
+    bool dry_run = false;
+    for (int i = 4; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "--dry-run") {
+            dry_run = true;
+            continue;
         }
+        if (option == "--profile") {
+            options.profile = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + option);
+        }
+        const std::string value = argv[++i];
+        if (option == "--format") {
+            options.output_extension = value[0] == '.' ? value : "." + value;
+        } else if (option == "--threads") {
+            parse_threads(value, options);
+        } else if (option == "--quality") {
+            options.jpeg.quality = std::stoi(value);
+        } else if (option == "--level") {
+            options.png.compression_level = std::stoi(value);
+        } else {
+            throw std::invalid_argument("Unknown option " + option);
+        }
+    }
 
-        // Convert to grayscale
-        // std::cout << "Converting to grayscale..." << std::endl;
-        // img1.convert_to_grayscale();
-        // img1.save_as_png("output_grayscale.png");
-
-        // Convert to sepia
-        // std::cout << "Converting to sepia..." << std::endl;
-        // img2.convert_to_sepia();
-        // img2.save_as_png("output_sepia.png");
-
-        // Add two images
-        // std::cout << "Adding two images..." << std::endl;
-        // std::unique_ptr<unsigned char[]> add_result(new unsigned char[img1.width * img1.height * img1.channels]);
-        // img1.add_images(img1.data, img2.data, add_result.get(), img1.width, img1.height, img1.channels, img2.width, img2.height, img2.channels);
-        // save_image_with_data(img1, add_result.get(), "/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_add.png");
-
-        // Subtract two images
-        // std::cout << "Subtracting two images..." << std::endl;
-        // std::unique_ptr<unsigned char[]> sub_result(new unsigned char[img1.width * img1.height * img1.channels]);
-        // img1.subtract_images(img1.data, img2.data, sub_result.get(), img1.width, img1.height, img1.channels, img2.width, img2.height, img2.channels);
-        // save_image_with_data(img1, sub_result.get(), "/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_subtract.png");
-
-        //Adjust brightness
-        // std::cout << "Adjusting brightness..." << std::endl;
-        // img1.adjust_brightness(img1.data, img1.width, img1.height, img1.channels, 50);
-        // img1.save_as_png("/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_brightness.png");
-
-        // // Adjust contrast
-        // std::cout << "Adjusting contrast..." << std::endl;
-        // img1.adjust_contrast(img1.data, img1.width, img1.height, img1.channels, 1.5f);
-        // img1.save_as_png("/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_contrast.png");
-
-        // // Thresholding
-        // std::cout << "Thresholding image..." << std::endl;
-        // img1.threshold_image(img1.data, img1.width, img1.height, img1.channels, 128);
-        // img1.save_as_png("/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_threshold.png");
-
-        // // Low-pass filtering
-        // std::cout << "Applying low-pass filter..." << std::endl;
-        // std::unique_ptr<unsigned char[]> lp_result(new unsigned char[img1.width * img1.height * img1.channels]);
-        // img1.low_pass_filter(img1.data, lp_result.get(), img1.width, img1.height, img1.channels, 0); // Averaging filter
-        // save_image_with_data(img1, lp_result.get(), "/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_lowpass.png");
-
-        // // High-pass filtering
-        // std::cout << "Applying high-pass filter..." << std::endl;
-        // std::unique_ptr<unsigned char[]> hp_result(new unsigned char[img1.width * img1.height * img1.channels]);
-        // img1.high_pass_filter(img1.data, hp_result.get(), img1.width, img1.height, img1.channels, 0); // Prewitt filter
-        // save_image_with_data(img1, hp_result.get(), "/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_highpass.png");
+    const std::vector<std::string> inputs = collect_inputs(argv[2]);
+    std::cout << "Pipeline: " << pipeline.describe() << "\n" << inputs.size() << " inputs" << std::endl;
+    if (dry_run) {
+        for (const std::string& input : inputs) {
+            std::cout << "  " << input << "\n";
+        }
+        return 0;
+    }
 
-        // Resizing the image
-        std::cout << "Resizing the image..." << std::endl;
-        int new_width = img1.width / 2;
-        int new_height = img1.height / 2;
-        unsigned char* resize_result = new unsigned char[new_width * new_height * img1.channels];
-        img1.resize_image(img1.data, resize_result, img1.width, img1.height, new_width, new_height, img1.channels);
-        Image resized_image("/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/images/test_image1.png");
-        resized_image.data = resize_result;
-        resized_image.width = new_width;
-        resized_image.height = new_height;
-        resized_image.save_as_png("/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_resized.png");
+    BatchReport report = process_batch(inputs, argv[3], [&pipeline](Image image) {
+        return pipeline.run(std::move(image));
+    }, options);
 
-        // // Otsu's thresholding
-        // std::cout << "Applying Otsu's thresholding..." << std::endl;
-        // std::unique_ptr<unsigned char[]> otsu_result(new unsigned char[img1.width * img1.height * img1.channels]);
-        // img1.otsu_threshold(img1.data, otsu_result.get(), img1.width, img1.height, img1.channels);
-        // save_image_with_data(img1, otsu_result.get(), "/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_otsu.png");
+    std::cout << report.succeeded << " images in " << report.seconds << " s (busy seconds: decode "
+              << report.decode_seconds << ", process " << report.process_seconds << ", encode "
+              << report.encode_seconds << ")" << std::endl;
+    if (options.profile) {
+        std::cout << "\n" << profile_report();
+    }
+    for (const BatchFailure& failure : report.failures) {
+        std::cerr << failure.path << ": " << failure.error << std::endl;
+    }
+    return report.failures.empty() ? 0 : 1;
+}
 
-        // // Hough transform
-        // std::cout << "Applying Hough transform..." << std::endl;
-        // std::unique_ptr<unsigned char[]> hough_result(new unsigned char[img1.width * img1.height * img1.channels]);
-        // img1.hough_transform(img1.data, hough_result.get(), img1.width, img1.height, img1.channels);
-        // save_image_with_data(img1, hough_result.get(), "/Users/cynthiaabi/Desktop/WorkSpace/ImageProcessing2/output/output_hough.png");
+} // namespace
 
-        std::cout << "All operations completed successfully!" << std::endl;
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
-
-    return 0;
 }
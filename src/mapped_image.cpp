@@ -0,0 +1,349 @@
+#include "../include/mapped_image.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kRawMagic[8] = {'I', 'M', 'G', 'R', 'A', 'W', '0', '1'};
+constexpr size_t kRawHeaderBytes = 64;
+// Enough of the file to hold any header we write or accept
+constexpr size_t kMaxHeaderBytes = 512;
+
+struct Header {
+    MappedFormat format = MappedFormat::Raw;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    size_t offset = 0;  // first pixel byte
+
+    size_t pixel_bytes() const { return static_cast<size_t>(width) * height * channels; }
+};
+
+uint32_t read_le32(const unsigned char* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+void write_le32(unsigned char* p, uint32_t value) {
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+    p[2] = static_cast<unsigned char>(value >> 16);
+    p[3] = static_cast<unsigned char>(value >> 24);
+}
+
+// Next decimal number of a PNM header, skipping whitespace and # comments
+bool read_pnm_number(const unsigned char* p, size_t size, size_t& pos, int& value) {
+    while (pos < size) {
+        if (p[pos] == '#') {
+            while (pos < size && p[pos] != '\n') {
+                ++pos;
+            }
+        } else if (std::isspace(p[pos])) {
+            ++pos;
+        } else {
+            break;
+        }
+    }
+    if (pos >= size || !std::isdigit(p[pos])) {
+        return false;
+    }
+    long long number = 0;
+    while (pos < size && std::isdigit(p[pos])) {
+        number = number * 10 + (p[pos++] - '0');
+        if (number > INT32_MAX) {
+            return false;
+        }
+    }
+    value = static_cast<int>(number);
+    return true;
+}
+
+// Parse the header at the start of a file (size bytes of it available)
+bool parse_header(const unsigned char* p, size_t size, Header& header) {
+    if (size >= kRawHeaderBytes && std::memcmp(p, kRawMagic, 8) == 0) {
+        header.format = MappedFormat::Raw;
+        header.width = static_cast<int>(std::min<uint32_t>(read_le32(p + 8), INT32_MAX));
+        header.height = static_cast<int>(std::min<uint32_t>(read_le32(p + 12), INT32_MAX));
+        header.channels = static_cast<int>(std::min<uint32_t>(read_le32(p + 16), INT32_MAX));
+        header.offset = kRawHeaderBytes;
+        return header.width > 0 && header.height > 0 && header.channels >= 1 && header.channels <= 4;
+    }
+    if (size < 3 || p[0] != 'P' || (p[1] != '5' && p[1] != '6')) {
+        return false;
+    }
+    header.format = p[1] == '5' ? MappedFormat::Pgm : MappedFormat::Ppm;
+    header.channels = p[1] == '5' ? 1 : 3;
+    size_t pos = 2;
+    int maxval = 0;
+    if (!read_pnm_number(p, size, pos, header.width) || !read_pnm_number(p, size, pos, header.height) ||
+        !read_pnm_number(p, size, pos, maxval)) {
+        return false;
+    }
+    // Exactly one whitespace byte separates the header from the samples.
+    // Only 8-bit samples can be used in place.
+    if (pos >= size || !std::isspace(p[pos]) || maxval != 255) {
+        return false;
+    }
+    header.offset = pos + 1;
+    return header.width > 0 && header.height > 0;
+}
+
+// Header bytes for a new file
+std::string make_header(MappedFormat format, int width, int height, int channels) {
+    if (format == MappedFormat::Raw) {
+        if (channels < 1 || channels > 4) {
+            throw std::invalid_argument("Raw images have 1 to 4 channels.");
+        }
+        std::string header(kRawHeaderBytes, '\0');
+        unsigned char* p = reinterpret_cast<unsigned char*>(&header[0]);
+        std::memcpy(p, kRawMagic, 8);
+        write_le32(p + 8, static_cast<uint32_t>(width));
+        write_le32(p + 12, static_cast<uint32_t>(height));
+        write_le32(p + 16, static_cast<uint32_t>(channels));
+        return header;
+    }
+    if (channels != (format == MappedFormat::Pgm ? 1 : 3)) {
+        throw std::invalid_argument("PGM images have 1 channel and PPM images 3.");
+    }
+    return std::string(format == MappedFormat::Pgm ? "P5\n" : "P6\n") + std::to_string(width) + " " +
+           std::to_string(height) + "\n255\n";
+}
+
+// Owns one mapping and releases it when the Image hands back the pixels that
+// live in it. Anything else (copies of the image) is allocated normally. A
+// mapping of a new file written under a temporary name is renamed to its final
+// path once unmapped if commit() was called first; otherwise, or if the rename
+// fails, the temporary file is removed.
+class MappingAllocator : public ImageAllocator {
+public:
+    MappingAllocator(void* base, size_t length, unsigned char* pixels, std::string temp_path = std::string(),
+                     std::string final_path = std::string())
+        : base_(base), length_(length), pixels_(pixels), temp_path_(std::move(temp_path)),
+          final_path_(std::move(final_path)) {}
+    ~MappingAllocator() override { unmap(); }
+
+    // Whether data is the pixels of a new file that is still mapped
+    bool writes_new_file(const unsigned char* data) const {
+        return base_ != nullptr && data == pixels_ && !temp_path_.empty();
+    }
+    void commit() { commit_ = true; }
+    bool renamed() const { return renamed_; }
+    const std::string& final_path() const { return final_path_; }
+
+    unsigned char* allocate(size_t bytes) override {
+        return default_image_allocator()->allocate(bytes);
+    }
+
+    void deallocate(unsigned char* data, size_t bytes) override {
+        if (data == pixels_) {
+            unmap();
+        } else {
+            default_image_allocator()->deallocate(data, bytes);
+        }
+    }
+
+private:
+    void* base_;
+    size_t length_;
+    unsigned char* pixels_;
+    std::string temp_path_;
+    std::string final_path_;
+    bool commit_ = false;
+    bool renamed_ = false;
+
+    void unmap() {
+        if (base_ != nullptr) {
+            munmap(base_, length_);
+            base_ = nullptr;
+            if (temp_path_.empty()) {
+                return;
+            }
+            renamed_ = commit_ && std::rename(temp_path_.c_str(), final_path_.c_str()) == 0;
+            if (!renamed_) {
+                std::remove(temp_path_.c_str());
+            }
+        }
+    }
+};
+
+// Closes a file descriptor on scope exit; the mapping outlives it
+struct FileDescriptor {
+    int fd;
+    explicit FileDescriptor(int fd) : fd(fd) {}
+    ~FileDescriptor() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+Image adopt_mapping(void* base, size_t length, const Header& header, std::string temp_path = std::string(),
+                    std::string final_path = std::string()) {
+    unsigned char* pixels = static_cast<unsigned char*>(base) + header.offset;
+    std::shared_ptr<ImageAllocator> allocator;
+    try {
+        allocator = std::make_shared<MappingAllocator>(base, length, pixels, std::move(temp_path),
+                                                       std::move(final_path));
+    } catch (...) {
+        munmap(base, length);
+        throw;
+    }
+    return Image(header.width, header.height, header.channels, pixels, std::move(allocator));
+}
+
+// A new image file mapped for writing, header filled in. It lives under a
+// temporary name in filepath's directory: opening filepath itself with O_TRUNC
+// would wipe an image still mapped from it (saving an edited image over its
+// source), and readers would see it half written.
+struct NewFile {
+    void* base = nullptr;
+    size_t length = 0;
+    Header header;
+    std::string temp_path;
+};
+
+NewFile map_new_file(const std::string& filepath, int width, int height, int channels, MappedFormat format) {
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        throw std::invalid_argument("Image dimensions must be positive.");
+    }
+    const std::string header_bytes = make_header(format, width, height, channels);
+    NewFile file;
+    file.header.format = format;
+    file.header.width = width;
+    file.header.height = height;
+    file.header.channels = channels;
+    file.header.offset = header_bytes.size();
+    file.length = file.header.offset + file.header.pixel_bytes();
+
+    std::string temp_path = filepath + ".XXXXXX";
+    FileDescriptor fd(mkstemp(&temp_path[0]));
+    if (fd.fd < 0) {
+        throw std::runtime_error("Error saving image: " + filepath);
+    }
+    if (fchmod(fd.fd, 0644) != 0 || ftruncate(fd.fd, static_cast<off_t>(file.length)) != 0 ||
+        (file.base = mmap(nullptr, file.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd.fd, 0)) == MAP_FAILED) {
+        std::remove(temp_path.c_str());
+        throw std::runtime_error("Error saving image: " + filepath);
+    }
+    std::memcpy(file.base, header_bytes.data(), header_bytes.size());
+    file.temp_path = std::move(temp_path);
+    return file;
+}
+
+} // namespace
+
+MappedFormat mapped_format_for(const std::string& filepath) {
+    std::string extension;
+    size_t dot = filepath.find_last_of('.');
+    if (dot != std::string::npos) {
+        extension = filepath.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    }
+    if (extension == "pgm") {
+        return MappedFormat::Pgm;
+    }
+    if (extension == "ppm") {
+        return MappedFormat::Ppm;
+    }
+    return MappedFormat::Raw;
+}
+
+bool is_mappable_image(const std::string& filepath) {
+    FileDescriptor file(open(filepath.c_str(), O_RDONLY));
+    if (file.fd < 0) {
+        return false;
+    }
+    unsigned char buffer[kMaxHeaderBytes];
+    ssize_t count = pread(file.fd, buffer, sizeof(buffer), 0);
+    Header header;
+    return count > 0 && parse_header(buffer, static_cast<size_t>(count), header);
+}
+
+Image map_image(const std::string& filepath) {
+    FileDescriptor file(open(filepath.c_str(), O_RDONLY));
+    struct stat info;
+    if (file.fd < 0 || fstat(file.fd, &info) != 0 || info.st_size <= 0) {
+        throw std::runtime_error("Error loading image: " + filepath);
+    }
+    const size_t length = static_cast<size_t>(info.st_size);
+    // Private and writable: stores go to copy-on-write pages, never the file
+    void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.fd, 0);
+    if (base == MAP_FAILED) {
+        throw std::runtime_error("Error loading image: " + filepath);
+    }
+    Header header;
+    if (!parse_header(static_cast<const unsigned char*>(base), std::min(length, kMaxHeaderBytes), header) ||
+        header.offset + header.pixel_bytes() > length) {
+        munmap(base, length);
+        throw std::runtime_error("Not a mappable PGM, PPM or raw image: " + filepath);
+    }
+    return adopt_mapping(base, length, header);
+}
+
+Image create_mapped_image(const std::string& filepath, int width, int height, int channels, MappedFormat format) {
+    NewFile file = map_new_file(filepath, width, height, channels, format);
+    return adopt_mapping(file.base, file.length, file.header, std::move(file.temp_path), filepath);
+}
+
+void commit_mapped_image(Image& img) {
+    std::shared_ptr<MappingAllocator> allocator = std::dynamic_pointer_cast<MappingAllocator>(img.allocator());
+    if (!allocator || !allocator->writes_new_file(img.data)) {
+        throw std::invalid_argument("Image is not an uncommitted create_mapped_image() result.");
+    }
+    allocator->commit();
+    {
+        Image released = std::move(img);
+    }
+    if (!allocator->renamed()) {
+        throw std::runtime_error("Error saving image: " + allocator->final_path());
+    }
+}
+
+void save_mapped_image(ConstImageView img, const std::string& filepath, MappedFormat format) {
+    if (img.empty()) {
+        throw std::invalid_argument("Image dimensions must be positive.");
+    }
+    NewFile file = map_new_file(filepath, img.width, img.height, img.channels, format);
+    ImageView dst(static_cast<unsigned char*>(file.base) + file.header.offset, img.width, img.height, img.channels);
+    const size_t row_bytes = img.row_bytes();
+    const int min_rows = static_cast<int>(std::max<size_t>(1, kMinChunkBytes / row_bytes));
+    try {
+        // Writing the pages is what faults them in, so spread it over the pool
+        parallel_rows(img.height, [&](int y_begin, int y_end) {
+            if (img.contiguous()) {
+                std::memcpy(dst.row(y_begin), img.row(y_begin), row_bytes * (y_end - y_begin));
+                return;
+            }
+            for (int y = y_begin; y < y_end; ++y) {
+                std::memcpy(dst.row(y), img.row(y), row_bytes);
+            }
+        }, min_rows);
+    } catch (...) {
+        munmap(file.base, file.length);
+        std::remove(file.temp_path.c_str());
+        throw;
+    }
+    munmap(file.base, file.length);
+    // Only now replace filepath, which may be the file img is mapped from
+    if (std::rename(file.temp_path.c_str(), filepath.c_str()) != 0) {
+        std::remove(file.temp_path.c_str());
+        throw std::runtime_error("Error saving image: " + filepath);
+    }
+}
+
+void save_mapped_image(ConstImageView img, const std::string& filepath) {
+    save_mapped_image(img, filepath, mapped_format_for(filepath));
+}
@@ -0,0 +1,783 @@
+#include "../include/png_stream.h"
+#include "../include/deflate.h"
+#include "../include/inflate.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "../stb_image/stb_image.h"
+
+namespace {
+
+const unsigned char kSignature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+// Compressed bytes gathered before an IDAT chunk is written
+constexpr size_t kIdatChunkBytes = 1 << 18;
+// Filtered bytes per independently compressed chunk when encoding in parallel
+constexpr size_t kParallelChunkBytes = 1 << 18;
+// DEFLATE's history window
+constexpr size_t kWindowBytes = 1 << 15;
+
+uint32_t read_u32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+uint32_t chunk_type(const char* name) {
+    return read_u32(reinterpret_cast<const unsigned char*>(name));
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// Undo the PNG filter of one row in place; prev is the previous unfiltered row
+// (zeros for the first), bpp the filter's byte distance to the left neighbour
+void unfilter(int type, unsigned char* row, const unsigned char* prev, size_t length, size_t bpp) {
+    switch (type) {
+    case 0:
+        break;
+    case 1:
+        for (size_t i = bpp; i < length; ++i) {
+            row[i] = static_cast<unsigned char>(row[i] + row[i - bpp]);
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < length; ++i) {
+            row[i] = static_cast<unsigned char>(row[i] + prev[i]);
+        }
+        break;
+    case 3:
+        for (size_t i = 0; i < bpp; ++i) {
+            row[i] = static_cast<unsigned char>(row[i] + (prev[i] >> 1));
+        }
+        for (size_t i = bpp; i < length; ++i) {
+            row[i] = static_cast<unsigned char>(row[i] + ((row[i - bpp] + prev[i]) >> 1));
+        }
+        break;
+    case 4:
+        for (size_t i = 0; i < bpp; ++i) {
+            row[i] = static_cast<unsigned char>(row[i] + prev[i]);
+        }
+        for (size_t i = bpp; i < length; ++i) {
+            row[i] = static_cast<unsigned char>(row[i] + paeth(row[i - bpp], prev[i], prev[i - bpp]));
+        }
+        break;
+    default:
+        throw std::runtime_error("Corrupt PNG: bad filter type.");
+    }
+}
+
+void write_u32(unsigned char* p, uint32_t value) {
+    p[0] = static_cast<unsigned char>(value >> 24);
+    p[1] = static_cast<unsigned char>(value >> 16);
+    p[2] = static_cast<unsigned char>(value >> 8);
+    p[3] = static_cast<unsigned char>(value);
+}
+
+// Apply PNG filter type to row into out; prev is the previous row (zeros for
+// the first)
+void filter_row(int type, const unsigned char* row, const unsigned char* prev, size_t length, size_t bpp,
+                    unsigned char* out) {
+    const size_t head = std::min(bpp, length);
+    switch (type) {
+    case 0:
+        std::memcpy(out, row, length);
+        break;
+    case 1:
+        std::memcpy(out, row, head);
+        for (size_t i = bpp; i < length; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - row[i - bpp]);
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < length; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - prev[i]);
+        }
+        break;
+    case 3:
+        for (size_t i = 0; i < head; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - (prev[i] >> 1));
+        }
+        for (size_t i = bpp; i < length; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - ((row[i - bpp] + prev[i]) >> 1));
+        }
+        break;
+    default:
+        for (size_t i = 0; i < head; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - prev[i]);
+        }
+        for (size_t i = bpp; i < length; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - paeth(row[i - bpp], prev[i], prev[i - bpp]));
+        }
+        break;
+    }
+}
+
+// Sum of the filtered bytes taken as signed: the usual estimate of how well a
+// row will compress
+uint32_t filter_cost(const unsigned char* filtered, size_t length) {
+    uint32_t cost = 0;
+    for (size_t i = 0; i < length; ++i) {
+        cost += static_cast<uint32_t>(std::abs(static_cast<signed char>(filtered[i])));
+    }
+    return cost;
+}
+
+// Filter one row into out: the filter type byte, then the filtered row. The
+// adaptive choice tries candidates in scratch (row_bytes) and out + 1.
+void filter_png_row(PngFilter filter, const unsigned char* row, const unsigned char* prev, size_t row_bytes,
+                    size_t bpp, unsigned char* out, unsigned char* scratch) {
+    if (filter != PngFilter::Adaptive) {
+        out[0] = static_cast<unsigned char>(filter);
+        filter_row(out[0], row, prev, row_bytes, bpp, out + 1);
+        return;
+    }
+    unsigned char* best = out + 1;
+    unsigned char* trial = scratch;
+    uint32_t best_cost = UINT32_MAX;
+    for (int type = 0; type < 5; ++type) {
+        filter_row(type, row, prev, row_bytes, bpp, trial);
+        uint32_t cost = filter_cost(trial, row_bytes);
+        if (cost < best_cost) {
+            best_cost = cost;
+            out[0] = static_cast<unsigned char>(type);
+            std::swap(best, trial);
+        }
+    }
+    if (best != out + 1) {
+        std::memcpy(out + 1, best, row_bytes);
+    }
+}
+
+} // namespace
+
+struct PngReader::State {
+    std::string path;
+    FILE* file = nullptr;
+
+    int width = 0;
+    int height = 0;
+    int depth = 0;
+    int color_type = 0;
+    bool interlaced = false;
+    int samples = 0;       // samples per pixel in the file
+    int out_channels = 0;
+
+    unsigned char palette[256 * 4] = {};
+    bool has_transparency = false;
+    uint16_t key[3] = {0, 0, 0};  // tRNS colour key, in file sample units
+
+    // IDAT data left in the current chunk; the chunk header is already consumed
+    uint32_t chunk_remaining = 0;
+    uint32_t chunk_crc = 0;  // of the current IDAT chunk's type and data so far
+    bool idat_done = false;
+    std::unique_ptr<Inflater> inflater;
+
+    size_t row_bytes = 0;  // filtered bytes per row, without the filter byte
+    size_t bpp = 0;
+    std::vector<unsigned char> prev;
+    std::vector<unsigned char> cur;  // filter byte, then the row
+    int next_row = 0;
+
+    // Interlaced files: the whole image from stb_image
+    unsigned char* full = nullptr;
+
+    ~State() {
+        if (file != nullptr) {
+            std::fclose(file);
+        }
+        if (full != nullptr) {
+            stbi_image_free(full);
+        }
+    }
+
+    void read_exact(unsigned char* buffer, size_t count) {
+        if (std::fread(buffer, 1, count, file) != count) {
+            throw std::runtime_error("Truncated PNG file: " + path);
+        }
+    }
+
+    // Next IDAT bytes for the inflater, crossing chunk boundaries
+    size_t fill(unsigned char* buffer, size_t capacity) {
+        while (chunk_remaining == 0) {
+            if (idat_done) {
+                return 0;
+            }
+            unsigned char header[12];  // CRC of the finished chunk, then the next header
+            read_exact(header, 12);
+            check_crc(read_u32(header), chunk_crc);
+            if (read_u32(header + 8) != chunk_type("IDAT")) {
+                idat_done = true;
+                return 0;
+            }
+            chunk_remaining = read_u32(header + 4);
+            chunk_crc = crc32(0, header + 8, 4);
+        }
+        size_t count = std::min<size_t>(capacity, chunk_remaining);
+        read_exact(buffer, count);
+        chunk_remaining -= static_cast<uint32_t>(count);
+        chunk_crc = crc32(chunk_crc, buffer, count);
+        return count;
+    }
+
+    void check_crc(uint32_t stored, uint32_t computed) const {
+        if (stored != computed) {
+            throw std::runtime_error("Corrupt PNG: chunk CRC mismatch: " + path);
+        }
+    }
+
+    // After the last row: the zlib stream must end there with a matching
+    // checksum, and the IDAT chunk it ends in with a matching CRC
+    void finish_image_data() {
+        inflater->finish();
+        if (idat_done) {
+            return;  // the inflater's read-ahead already checked the last CRC
+        }
+        unsigned char buffer[4096];
+        while (chunk_remaining > 0) {
+            // Padding after the stream, inside the chunk
+            size_t count = std::min<size_t>(sizeof(buffer), chunk_remaining);
+            read_exact(buffer, count);
+            chunk_remaining -= static_cast<uint32_t>(count);
+            chunk_crc = crc32(chunk_crc, buffer, count);
+        }
+        unsigned char crc[4];
+        read_exact(crc, 4);
+        check_crc(read_u32(crc), chunk_crc);
+        idat_done = true;
+    }
+
+    void parse_header();
+    void expand(const unsigned char* in, unsigned char* out) const;
+};
+
+// Read the chunks before the image data: IHDR, PLTE, tRNS
+void PngReader::State::parse_header() {
+    unsigned char signature[8];
+    read_exact(signature, 8);
+    if (std::memcmp(signature, kSignature, 8) != 0) {
+        throw std::runtime_error("Not a PNG file: " + path);
+    }
+
+    bool have_header = false;
+    int palette_size = 0;
+    while (true) {
+        unsigned char header[8];
+        read_exact(header, 8);
+        uint32_t length = read_u32(header);
+        uint32_t type = read_u32(header + 4);
+
+        if (type == chunk_type("IDAT")) {
+            if (!have_header || (color_type == 3 && palette_size == 0)) {
+                throw std::runtime_error("Corrupt PNG: image data before header or palette: " + path);
+            }
+            chunk_remaining = length;
+            chunk_crc = crc32(0, header + 4, 4);
+            return;
+        }
+
+        std::vector<unsigned char> data(length);
+        if (length > 0) {
+            read_exact(data.data(), length);
+        }
+        unsigned char crc[4];
+        read_exact(crc, 4);
+        check_crc(read_u32(crc), crc32(crc32(0, header + 4, 4), data.data(), length));
+
+        if (type == chunk_type("IHDR")) {
+            if (length != 13) {
+                throw std::runtime_error("Corrupt PNG: bad header: " + path);
+            }
+            width = static_cast<int>(read_u32(data.data()));
+            height = static_cast<int>(read_u32(data.data() + 4));
+            depth = data[8];
+            color_type = data[9];
+            interlaced = data[12] != 0;
+            if (width <= 0 || height <= 0 || data[10] != 0 || data[11] != 0 || data[12] > 1) {
+                throw std::runtime_error("Corrupt PNG: bad header: " + path);
+            }
+            switch (color_type) {
+            case 0: samples = 1; break;
+            case 2: samples = 3; break;
+            case 3: samples = 1; break;
+            case 4: samples = 2; break;
+            case 6: samples = 4; break;
+            default: throw std::runtime_error("Corrupt PNG: bad colour type: " + path);
+            }
+            bool depth_ok = depth == 8 || (depth == 16 && color_type != 3) ||
+                            ((depth == 1 || depth == 2 || depth == 4) && (color_type == 0 || color_type == 3));
+            if (!depth_ok) {
+                throw std::runtime_error("Corrupt PNG: bad bit depth: " + path);
+            }
+            have_header = true;
+        } else if (type == chunk_type("PLTE")) {
+            if (length % 3 != 0 || length / 3 > 256 || length == 0) {
+                throw std::runtime_error("Corrupt PNG: bad palette: " + path);
+            }
+            palette_size = static_cast<int>(length / 3);
+            for (int i = 0; i < palette_size; ++i) {
+                palette[i * 4 + 0] = data[i * 3 + 0];
+                palette[i * 4 + 1] = data[i * 3 + 1];
+                palette[i * 4 + 2] = data[i * 3 + 2];
+                palette[i * 4 + 3] = 255;
+            }
+        } else if (type == chunk_type("tRNS")) {
+            if (color_type == 3) {
+                if (length > static_cast<uint32_t>(palette_size)) {
+                    throw std::runtime_error("Corrupt PNG: bad transparency: " + path);
+                }
+                for (uint32_t i = 0; i < length; ++i) {
+                    palette[i * 4 + 3] = data[i];
+                }
+            } else {
+                if (length != static_cast<uint32_t>(samples) * 2) {
+                    throw std::runtime_error("Corrupt PNG: bad transparency: " + path);
+                }
+                for (int k = 0; k < samples; ++k) {
+                    key[k] = static_cast<uint16_t>((data[k * 2] << 8) | data[k * 2 + 1]);
+                }
+            }
+            has_transparency = true;
+        } else if (type == chunk_type("IEND")) {
+            throw std::runtime_error("Corrupt PNG: no image data: " + path);
+        } else if ((header[4] & 32) == 0) {
+            throw std::runtime_error("Unsupported PNG chunk in " + path);
+        }
+        // Other ancillary chunks are skipped
+    }
+}
+
+// One unfiltered row to 8-bit output samples
+void PngReader::State::expand(const unsigned char* in, unsigned char* out) const {
+    if (color_type == 3) {
+        const int channels = out_channels;
+        for (int x = 0; x < width; ++x) {
+            int index;
+            if (depth == 8) {
+                index = in[x];
+            } else {
+                int per_byte = 8 / depth;
+                int shift = 8 - depth * (x % per_byte + 1);
+                index = (in[x / per_byte] >> shift) & ((1 << depth) - 1);
+            }
+            std::memcpy(out + x * channels, palette + index * 4, channels);
+        }
+        return;
+    }
+
+    if (depth < 8) {
+        // Gray only: widen to 0..255 by repeating the bit pattern
+        const int scale = 255 / ((1 << depth) - 1);
+        const int per_byte = 8 / depth;
+        const int key_value = key[0] * scale;
+        for (int x = 0; x < width; ++x) {
+            int shift = 8 - depth * (x % per_byte + 1);
+            int value = ((in[x / per_byte] >> shift) & ((1 << depth) - 1)) * scale;
+            if (has_transparency) {
+                out[x * 2] = static_cast<unsigned char>(value);
+                out[x * 2 + 1] = value == key_value ? 0 : 255;
+            } else {
+                out[x] = static_cast<unsigned char>(value);
+            }
+        }
+        return;
+    }
+
+    if (!has_transparency) {
+        if (depth == 8) {
+            std::memcpy(out, in, static_cast<size_t>(width) * samples);
+        } else {
+            for (size_t i = 0; i < static_cast<size_t>(width) * samples; ++i) {
+                out[i] = in[i * 2];
+            }
+        }
+        return;
+    }
+
+    // Colour key: opaque unless every sample matches
+    for (int x = 0; x < width; ++x) {
+        bool match = true;
+        for (int k = 0; k < samples; ++k) {
+            int i = x * samples + k;
+            int value = depth == 8 ? in[i] : (in[i * 2] << 8) | in[i * 2 + 1];
+            match = match && value == key[k];
+            out[x * out_channels + k] = depth == 8 ? in[i] : in[i * 2];
+        }
+        out[x * out_channels + samples] = match ? 0 : 255;
+    }
+}
+
+PngReader::PngReader(const std::string& filepath) : state_(std::make_unique<State>()) {
+    State& s = *state_;
+    s.path = filepath;
+    s.file = std::fopen(filepath.c_str(), "rb");
+    if (s.file == nullptr) {
+        throw std::runtime_error("Error loading image: " + filepath);
+    }
+    s.parse_header();
+
+    bool alpha_from_key = s.has_transparency && (s.color_type == 0 || s.color_type == 2);
+    if (s.color_type == 3) {
+        s.out_channels = s.has_transparency ? 4 : 3;
+    } else {
+        s.out_channels = s.samples + (alpha_from_key ? 1 : 0);
+    }
+
+    if (s.interlaced) {
+        std::fclose(s.file);
+        s.file = nullptr;
+        int w, h, n;
+        s.full = stbi_load(filepath.c_str(), &w, &h, &n, s.out_channels);
+        if (s.full == nullptr) {
+            throw std::runtime_error("Error loading image: " + filepath);
+        }
+        return;
+    }
+
+    s.row_bytes = (static_cast<size_t>(s.width) * s.samples * s.depth + 7) / 8;
+    s.bpp = std::max<size_t>(1, static_cast<size_t>(s.samples) * s.depth / 8);
+    s.prev.assign(s.row_bytes, 0);
+    s.cur.resize(s.row_bytes + 1);
+    s.inflater = std::make_unique<Inflater>([&s](unsigned char* buffer, size_t capacity) {
+        return s.fill(buffer, capacity);
+    });
+}
+
+PngReader::~PngReader() = default;
+
+int PngReader::width() const { return state_->width; }
+int PngReader::height() const { return state_->height; }
+int PngReader::channels() const { return state_->out_channels; }
+bool PngReader::interlaced() const { return state_->interlaced; }
+int PngReader::rows_read() const { return state_->next_row; }
+
+int PngReader::read_rows(unsigned char* dst, std::ptrdiff_t stride, int max_rows) {
+    State& s = *state_;
+    int rows = std::min(max_rows, s.height - s.next_row);
+    if (rows <= 0) {
+        return 0;
+    }
+
+    if (s.full != nullptr) {
+        size_t row_bytes = static_cast<size_t>(s.width) * s.out_channels;
+        for (int i = 0; i < rows; ++i) {
+            std::memcpy(dst + i * stride, s.full + (s.next_row + i) * row_bytes, row_bytes);
+        }
+        s.next_row += rows;
+        return rows;
+    }
+
+    for (int i = 0; i < rows; ++i) {
+        s.inflater->read(s.cur.data(), s.cur.size());
+        unsigned char* row = s.cur.data() + 1;
+        unfilter(s.cur[0], row, s.prev.data(), s.row_bytes, s.bpp);
+        s.expand(row, dst + i * stride);
+        std::memcpy(s.prev.data(), row, s.row_bytes);
+    }
+    s.next_row += rows;
+    if (s.next_row == s.height) {
+        s.finish_image_data();
+    }
+    return rows;
+}
+
+struct PngWriter::State {
+    std::string path;
+    FILE* file = nullptr;
+    Sink sink;  // instead of a file
+    bool done = false;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    int next_row = 0;
+    PngSaveOptions options;
+    int threads = 1;
+
+    size_t row_bytes = 0;
+    std::vector<unsigned char> prev;  // last row written, unfiltered
+    std::vector<unsigned char> idat;  // compressed data not yet written out
+
+    // Serial: one Deflater fed a row at a time
+    std::vector<unsigned char> filtered;  // filter byte, then the row
+    std::vector<unsigned char> scratch;
+    std::unique_ptr<Deflater> deflater;
+
+    // Parallel: rows gathered into batches of whole chunks
+    int chunk_rows = 0;
+    int batch_rows = 0;
+    std::vector<unsigned char> pending;  // unfiltered rows of the batch
+    int pending_rows = 0;
+    std::vector<unsigned char> stream;   // the previous batch's last 32 KiB, then this batch filtered
+    size_t history = 0;
+    uint32_t adler = 1;
+
+    ~State() {
+        if (file != nullptr) {
+            // Unfinished: the partial file is no use to anyone
+            std::fclose(file);
+            std::remove(path.c_str());
+        }
+    }
+
+    void write_bytes(const unsigned char* data, size_t size) {
+        if (sink) {
+            sink(data, size);
+        } else if (size > 0 && std::fwrite(data, 1, size, file) != size) {
+            throw std::runtime_error("Error saving PNG image: " + path);
+        }
+    }
+
+    void write_chunk(const char* type, const unsigned char* data, size_t size) {
+        unsigned char header[8];
+        write_u32(header, static_cast<uint32_t>(size));
+        std::memcpy(header + 4, type, 4);
+        uint32_t crc = crc32(crc32(0, header + 4, 4), data, size);
+        unsigned char trailer[4];
+        write_u32(trailer, crc);
+        write_bytes(header, 8);
+        write_bytes(data, size);
+        write_bytes(trailer, 4);
+    }
+
+    void append_idat(const unsigned char* data, size_t size) {
+        idat.insert(idat.end(), data, data + size);
+        if (idat.size() >= kIdatChunkBytes) {
+            flush_idat();
+        }
+    }
+
+    void flush_idat() {
+        if (!idat.empty()) {
+            write_chunk("IDAT", idat.data(), idat.size());
+            idat.clear();
+        }
+    }
+
+    void start(int width, int height, int channels, const PngSaveOptions& options);
+    void write_header();
+    void encode_batch(bool last);
+};
+
+// Filter the pending rows, then deflate each chunk of them as a separate raw
+// stream primed with the 32 KiB of filtered data before it. Every chunk but the
+// image's last ends in a sync flush, so the pieces concatenate into one zlib
+// stream, and chunk boundaries do not depend on the number of threads.
+void PngWriter::State::encode_batch(bool last) {
+    const int rows = pending_rows;
+    const size_t filtered_row = row_bytes + 1;
+    stream.resize(history + rows * filtered_row);
+    parallel_rows(rows, [&](int y_begin, int y_end) {
+        std::vector<unsigned char> candidate(row_bytes);
+        for (int y = y_begin; y < y_end; ++y) {
+            const unsigned char* row = pending.data() + y * row_bytes;
+            const unsigned char* above = y == 0 ? prev.data() : row - row_bytes;
+            filter_png_row(options.filter, row, above, row_bytes, channels,
+                           stream.data() + history + y * filtered_row, candidate.data());
+        }
+    }, static_cast<int>(std::max<size_t>(1, kMinChunkBytes / filtered_row)));
+    std::memcpy(prev.data(), pending.data() + (rows - 1) * row_bytes, row_bytes);
+
+    const int chunks = (rows + chunk_rows - 1) / chunk_rows;
+    std::vector<std::vector<unsigned char>> outputs(chunks);
+    std::vector<uint32_t> adlers(chunks);
+    const int workers = std::min(threads, chunks);
+    default_thread_pool().run(workers, [&](int worker) {
+        for (int c = worker; c < chunks; c += workers) {
+            const size_t begin = history + c * chunk_rows * filtered_row;
+            const size_t end = history + std::min(rows, (c + 1) * chunk_rows) * filtered_row;
+            std::vector<unsigned char>& out = outputs[c];
+            Deflater deflater(options.compression_level, [&out](const unsigned char* data, size_t size) {
+                out.insert(out.end(), data, data + size);
+            }, false);
+            const size_t dictionary = std::min(begin, kWindowBytes);
+            deflater.set_dictionary(stream.data() + begin - dictionary, dictionary);
+            deflater.write(stream.data() + begin, end - begin);
+            if (last && c == chunks - 1) {
+                deflater.finish();
+            } else {
+                deflater.sync_flush();
+            }
+            adlers[c] = deflater.adler();
+        }
+    });
+
+    for (int c = 0; c < chunks; ++c) {
+        const size_t size = (std::min(rows, (c + 1) * chunk_rows) - c * chunk_rows) * filtered_row;
+        adler = adler32_combine(adler, adlers[c], size);
+        append_idat(outputs[c].data(), outputs[c].size());
+    }
+    if (last) {
+        unsigned char trailer[4];
+        write_u32(trailer, adler);
+        append_idat(trailer, 4);
+    }
+
+    // The tail of this batch primes the first chunk of the next
+    const size_t keep = std::min(stream.size(), kWindowBytes);
+    std::memmove(stream.data(), stream.data() + stream.size() - keep, keep);
+    history = keep;
+    pending_rows = 0;
+}
+
+// Everything but the output, after checking the arguments
+void PngWriter::State::start(int w, int h, int c, const PngSaveOptions& save_options) {
+    if (w <= 0 || h <= 0) {
+        throw std::invalid_argument("Image dimensions must be positive.");
+    }
+    if (c < 1 || c > 4) {
+        throw std::invalid_argument("PNG images have 1 to 4 channels.");
+    }
+    if (save_options.threads < 0) {
+        throw std::invalid_argument("PNG encode threads must be non-negative.");
+    }
+    width = w;
+    height = h;
+    channels = c;
+    options = save_options;
+    row_bytes = static_cast<size_t>(width) * channels;
+    prev.assign(row_bytes, 0);
+
+    chunk_rows = static_cast<int>(std::max<size_t>(1, kParallelChunkBytes / (row_bytes + 1)));
+    threads = options.threads == 0 ? num_threads() : options.threads;
+    if (height <= chunk_rows) {
+        threads = 1;  // a single chunk: nothing to split
+    }
+    if (threads > 1) {
+        // Two chunks per thread keeps every thread busy while the slowest finishes
+        batch_rows = std::min(height, chunk_rows * threads * 2);
+        pending.resize(batch_rows * row_bytes);
+        unsigned char header[2];
+        zlib_header(options.compression_level, header);
+        idat.assign(header, header + 2);
+    } else {
+        filtered.resize(row_bytes + 1);
+        scratch.resize(row_bytes);
+    }
+    // Also validates the level
+    deflater = std::make_unique<Deflater>(options.compression_level, [this](const unsigned char* data, size_t size) {
+        append_idat(data, size);
+    });
+}
+
+void PngWriter::State::write_header() {
+    static const int kColorTypes[5] = {0, 0, 4, 2, 6};
+    unsigned char header[13];
+    write_u32(header, static_cast<uint32_t>(width));
+    write_u32(header + 4, static_cast<uint32_t>(height));
+    header[8] = 8;
+    header[9] = static_cast<unsigned char>(kColorTypes[channels]);
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    write_bytes(kSignature, 8);
+    write_chunk("IHDR", header, 13);
+}
+
+PngWriter::PngWriter(const std::string& filepath, int width, int height, int channels,
+                     const PngSaveOptions& options)
+    : state_(std::make_unique<State>()) {
+    State& s = *state_;
+    s.path = filepath;
+    s.start(width, height, channels, options);
+    s.file = std::fopen(filepath.c_str(), "wb");
+    if (s.file == nullptr) {
+        throw std::runtime_error("Error saving PNG image: " + filepath);
+    }
+    s.write_header();
+}
+
+PngWriter::PngWriter(Sink sink, int width, int height, int channels, const PngSaveOptions& options)
+    : state_(std::make_unique<State>()) {
+    if (!sink) {
+        throw std::invalid_argument("PngWriter needs a sink.");
+    }
+    State& s = *state_;
+    s.sink = std::move(sink);
+    s.start(width, height, channels, options);
+    s.write_header();
+}
+
+PngWriter::~PngWriter() = default;
+
+int PngWriter::width() const { return state_->width; }
+int PngWriter::height() const { return state_->height; }
+int PngWriter::channels() const { return state_->channels; }
+int PngWriter::rows_written() const { return state_->next_row; }
+
+void PngWriter::write_rows(const unsigned char* src, std::ptrdiff_t stride, int count) {
+    State& s = *state_;
+    if (count < 0 || count > s.height - s.next_row) {
+        throw std::invalid_argument("More rows written than the PNG image has.");
+    }
+    if (s.threads > 1) {
+        for (int i = 0; i < count; ++i) {
+            std::memcpy(s.pending.data() + s.pending_rows * s.row_bytes, src + i * stride, s.row_bytes);
+            ++s.next_row;
+            if (++s.pending_rows == s.batch_rows || s.next_row == s.height) {
+                s.encode_batch(s.next_row == s.height);
+            }
+        }
+    } else {
+        for (int i = 0; i < count; ++i) {
+            const unsigned char* row = src + i * stride;
+            filter_png_row(s.options.filter, row, s.prev.data(), s.row_bytes, s.channels, s.filtered.data(),
+                           s.scratch.data());
+            s.deflater->write(s.filtered.data(), s.filtered.size());
+            std::memcpy(s.prev.data(), row, s.row_bytes);
+        }
+        s.next_row += count;
+        if (s.next_row == s.height && !s.done) {
+            s.deflater->finish();
+        }
+    }
+
+    if (s.next_row == s.height && !s.done) {
+        s.done = true;
+        s.flush_idat();
+        s.write_chunk("IEND", nullptr, 0);
+        if (s.file != nullptr) {
+            FILE* file = s.file;
+            s.file = nullptr;
+            if (std::fclose(file) != 0) {
+                throw std::runtime_error("Error saving PNG image: " + s.path);
+            }
+        }
+    }
+}
+
+void PngWriter::write_rows(ConstImageView rows) {
+    if (rows.width != state_->width || rows.channels != state_->channels) {
+        throw std::invalid_argument("Rows must match the PNG image's width and channels.");
+    }
+    write_rows(rows.data, rows.stride, rows.height);
+}
+
+void decode_png_bands(const std::string& filepath, int band_rows,
+                      const std::function<void(ConstImageView band, int y)>& fn) {
+    if (band_rows <= 0) {
+        throw std::invalid_argument("Band height must be positive.");
+    }
+    PngReader reader(filepath);
+    band_rows = std::min(band_rows, reader.height());
+    const std::ptrdiff_t stride = static_cast<std::ptrdiff_t>(reader.width()) * reader.channels();
+    std::vector<unsigned char> band(static_cast<size_t>(stride) * band_rows);
+    while (true) {
+        int y = reader.rows_read();
+        int rows = reader.read_rows(band.data(), stride, band_rows);
+        if (rows == 0) {
+            break;
+        }
+        fn(ConstImageView(band.data(), reader.width(), rows, reader.channels(), stride), y);
+    }
+}
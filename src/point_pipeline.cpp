@@ -0,0 +1,73 @@
+#include "../include/point_pipeline.h"
+#include "../include/image_utils.h"
+#include "../include/profiler.h"
+#include "../include/simd_kernels.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+
+PointPipeline& PointPipeline::brightness(int adjustment) {
+    return lut(Lut::brightness(adjustment));
+}
+
+PointPipeline& PointPipeline::contrast(float contrast_factor) {
+    return lut(Lut::contrast(contrast_factor));
+}
+
+PointPipeline& PointPipeline::threshold(unsigned char threshold) {
+    return lut(Lut::threshold(threshold));
+}
+
+PointPipeline& PointPipeline::gamma(float gamma) {
+    return lut(Lut::gamma(gamma));
+}
+
+PointPipeline& PointPipeline::invert() {
+    return lut(Lut::invert());
+}
+
+PointPipeline& PointPipeline::curve(const std::function<int(int)>& curve) {
+    return lut(Lut::from_curve(curve));
+}
+
+PointPipeline& PointPipeline::lut(const Lut& lut) {
+    lut_ = lut_.then(lut);
+    ++stages_;
+    return *this;
+}
+
+PointPipeline& PointPipeline::then(const PointPipeline& next) {
+    lut_ = lut_.then(next.lut_);
+    stages_ += next.stages_;
+    return *this;
+}
+
+void PointPipeline::apply(const unsigned char* in, unsigned char* out, size_t count) const {
+    ProfileScope profile("PointPipeline::apply", count, count);
+    // Stages that cancel out (or none at all) leave nothing to do in place
+    if (in == out && lut_.is_identity()) {
+        return;
+    }
+    lut_.apply(in, out, count);
+}
+
+void PointPipeline::apply(Image& image) const {
+    apply(image.data, static_cast<size_t>(image.width) * image.height * image.channels);
+}
+
+void PointPipeline::apply(ImageView view) const {
+    if (view.contiguous()) {
+        apply(view.data, view.row_bytes() * view.height);
+        return;
+    }
+    if (lut_.is_identity()) {
+        return;
+    }
+    ProfileScope profile("PointPipeline::apply", view.row_bytes() * view.height, view.row_bytes() * view.height);
+    int min_rows = static_cast<int>(std::max<size_t>(1, (1 << 16) / std::max<size_t>(1, view.row_bytes())));
+    parallel_rows(view.height, [&](int y_begin, int y_end) {
+        for (int y = y_begin; y < y_end; ++y) {
+            lut_bytes(view.row(y), view.row(y), view.row_bytes(), lut_.data());
+        }
+    }, min_rows);
+}
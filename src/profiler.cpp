@@ -0,0 +1,100 @@
+#include "../include/profiler.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+namespace {
+
+std::atomic<bool> enabled{false};
+
+std::mutex totals_mutex;
+std::map<std::string, ProfileEntry, std::less<>> totals;
+
+} // namespace
+
+void set_profiling(bool on) {
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+bool profiling_enabled() {
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void reset_profile() {
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    totals.clear();
+}
+
+std::vector<ProfileEntry> profile_entries() {
+    std::vector<ProfileEntry> entries;
+    {
+        std::lock_guard<std::mutex> lock(totals_mutex);
+        for (const auto& [name, entry] : totals) {
+            entries.push_back(entry);
+        }
+    }
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const ProfileEntry& a, const ProfileEntry& b) { return a.seconds > b.seconds; });
+    return entries;
+}
+
+std::string profile_report() {
+    const std::vector<ProfileEntry> entries = profile_entries();
+    if (entries.empty()) {
+        return "No operations profiled.\n";
+    }
+    std::string text;
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-26s %7s %10s %9s %11s %11s %8s %6s\n", "operation", "calls", "total ms",
+                  "mean ms", "MB read", "MB written", "MP/s", "busy");
+    text += line;
+    for (const ProfileEntry& entry : entries) {
+        char rate[16] = "-";
+        if (entry.pixels > 0) {
+            std::snprintf(rate, sizeof(rate), "%.1f", entry.megapixels_per_second());
+        }
+        std::snprintf(line, sizeof(line), "%-26s %7zu %10.2f %9.3f %11.2f %11.2f %8s %5.0f%%\n", entry.name.c_str(),
+                      entry.calls, entry.seconds * 1e3, entry.seconds * 1e3 / entry.calls, entry.bytes_read / 1e6,
+                      entry.bytes_written / 1e6, rate, entry.utilisation() * 100);
+        text += line;
+    }
+    return text;
+}
+
+#if IMAGE_PROFILING
+
+void ProfileScope::start(const char* name, size_t bytes_read, size_t bytes_written, size_t pixels) {
+    name_ = name;
+    bytes_read_ = bytes_read;
+    bytes_written_ = bytes_written;
+    pixels_ = pixels;
+    cpu_start_ = std::clock();
+    start_ = std::chrono::steady_clock::now();
+}
+
+void ProfileScope::finish() {
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    const double cpu_seconds = static_cast<double>(std::clock() - cpu_start_) / CLOCKS_PER_SEC;
+    const int threads = num_threads();
+
+    std::lock_guard<std::mutex> lock(totals_mutex);
+    auto it = totals.find(name_);
+    if (it == totals.end()) {
+        it = totals.emplace(name_, ProfileEntry()).first;
+        it->second.name = name_;
+    }
+    ProfileEntry& entry = it->second;
+    ++entry.calls;
+    entry.seconds += seconds;
+    entry.cpu_seconds += cpu_seconds;
+    entry.bytes_read += bytes_read_;
+    entry.bytes_written += bytes_written_;
+    entry.pixels += pixels_;
+    entry.threads = threads;
+}
+
+#endif // IMAGE_PROFILING
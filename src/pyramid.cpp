@@ -0,0 +1,99 @@
+#include "../include/pyramid.h"
+#include "../include/downsample.h"
+#include "../include/image_utils.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// [1 2 1] / 4 in both directions, borders clamped, rounded once at the end
+void binomial_blur(const unsigned char* src, unsigned char* dst, int width, int height, int channels) {
+    const size_t row_len = static_cast<size_t>(width) * channels;
+    parallel_rows(height, [&](int y_begin, int y_end) {
+        std::vector<uint16_t> column(row_len);
+        for (int y = y_begin; y < y_end; ++y) {
+            const unsigned char* above = src + std::max(y - 1, 0) * row_len;
+            const unsigned char* here = src + y * row_len;
+            const unsigned char* below = src + std::min(y + 1, height - 1) * row_len;
+            for (size_t i = 0; i < row_len; ++i) {
+                column[i] = static_cast<uint16_t>(above[i] + 2 * here[i] + below[i]);
+            }
+            unsigned char* out = dst + y * row_len;
+            for (int x = 0; x < width; ++x) {
+                const uint16_t* left = column.data() + std::max(x - 1, 0) * channels;
+                const uint16_t* centre = column.data() + x * channels;
+                const uint16_t* right = column.data() + std::min(x + 1, width - 1) * channels;
+                for (int c = 0; c < channels; ++c) {
+                    out[x * channels + c] = static_cast<unsigned char>((left[c] + 2 * centre[c] + right[c] + 8) >> 4);
+                }
+            }
+        }
+    }, std::max(1, static_cast<int>((1 << 16) / row_len)));
+}
+
+} // namespace
+
+Pyramid::Pyramid(const unsigned char* img, int width, int height, int channels, int max_levels, bool gaussian)
+    : channels_(channels) {
+    if (width <= 0 || height <= 0 || channels <= 0) {
+        throw std::invalid_argument("Pyramid needs positive dimensions.");
+    }
+
+    // Lay out every level first so the storage is allocated once
+    std::vector<size_t> offsets;
+    size_t total = 0;
+    int w = width;
+    int h = height;
+    while (true) {
+        offsets.push_back(total);
+        levels_.push_back({w, h, nullptr});
+        total += static_cast<size_t>(w) * h * channels;
+        if ((w == 1 && h == 1) || (max_levels > 0 && levels() == max_levels)) {
+            break;
+        }
+        w = downsampled_size(w, 2);
+        h = downsampled_size(h, 2);
+    }
+    storage_.resize(total);
+    for (size_t i = 0; i < levels_.size(); ++i) {
+        levels_[i].data = storage_.data() + offsets[i];
+    }
+
+    std::memcpy(levels_[0].data, img, static_cast<size_t>(width) * height * channels);
+
+    std::vector<unsigned char> smoothed;
+    if (gaussian && levels() > 1) {
+        smoothed.resize(static_cast<size_t>(width) * height * channels);
+    }
+    for (int i = 1; i < levels(); ++i) {
+        const Level& prev = levels_[i - 1];
+        const unsigned char* from = prev.data;
+        if (gaussian) {
+            binomial_blur(prev.data, smoothed.data(), prev.width, prev.height, channels);
+            from = smoothed.data();
+        }
+        downsample(from, prev.width, prev.height, static_cast<std::ptrdiff_t>(prev.width) * channels,
+                   levels_[i].data, static_cast<std::ptrdiff_t>(levels_[i].width) * channels, channels, 2, 2);
+    }
+}
+
+Pyramid::Pyramid(const Image& image, int max_levels, bool gaussian)
+    : Pyramid(image.data, image.width, image.height, image.channels, max_levels, gaussian) {}
+
+int Pyramid::nearest_level(int width, int height) const {
+    int index = 0;
+    while (index + 1 < levels() && levels_[index + 1].width >= width && levels_[index + 1].height >= height) {
+        ++index;
+    }
+    return index;
+}
+
+void Pyramid::resize(unsigned char* dst, int width, int height, std::ptrdiff_t dst_stride, ResizeFilter filter) const {
+    const Level& from = levels_[nearest_level(width, height)];
+    ::resize(from.data, from.width, from.height, static_cast<std::ptrdiff_t>(from.width) * channels_,
+             dst, width, height, dst_stride, channels_, filter);
+}
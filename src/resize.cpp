@@ -0,0 +1,175 @@
+#include "../include/resize.h"
+#include "../include/downsample.h"
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include "../stb_image/stb_image_resize2.h"
+
+namespace {
+
+// Lanczos-3: sinc(x) * sinc(x / 3) inside |x| < 3
+float lanczos3_kernel(float x, float scale, void* user_data) {
+    (void)scale;
+    (void)user_data;
+    const float pi = 3.14159265358979f;
+    x = std::fabs(x);
+    if (x < 1e-6f) {
+        return 1.0f;
+    }
+    if (x >= 3.0f) {
+        return 0.0f;
+    }
+    float px = pi * x;
+    return 3.0f * std::sin(px) * std::sin(px / 3.0f) / (px * px);
+}
+
+float lanczos3_support(float scale, void* user_data) {
+    (void)scale;
+    (void)user_data;
+    return 3.0f;
+}
+
+stbir_pixel_layout layout_for(int channels) {
+    switch (channels) {
+    case 1: return STBIR_1CHANNEL;
+    case 2: return STBIR_RA;
+    case 3: return STBIR_RGB;
+    case 4: return STBIR_RGBA;
+    default: throw std::invalid_argument("Filtered resize supports 1 to 4 channels.");
+    }
+}
+
+stbir_filter stb_filter(ResizeFilter filter) {
+    switch (filter) {
+    case ResizeFilter::Bilinear: return STBIR_FILTER_TRIANGLE;
+    case ResizeFilter::Bicubic: return STBIR_FILTER_CATMULLROM;
+    case ResizeFilter::Area: return STBIR_FILTER_BOX;
+    default: return STBIR_FILTER_DEFAULT;
+    }
+}
+
+} // namespace
+
+struct Resizer::State {
+    int src_width;
+    int src_height;
+    int dst_width;
+    int dst_height;
+    int channels;
+    ResizeFilter filter;
+
+    // Nearest neighbour: source column / row of every output column / row
+    std::vector<int> src_x;
+    std::vector<int> src_y;
+
+    // Area shrink by whole factors on both axes: integer box downsample
+    int factor_x = 0;
+    int factor_y = 0;
+
+    // Everything else: stb_image_resize2 with prebuilt samplers
+    STBIR_RESIZE stb;
+    int splits = 0;
+};
+
+Resizer::Resizer(int src_width, int src_height, int dst_width, int dst_height, int channels, ResizeFilter filter)
+    : state_(std::make_unique<State>()) {
+    if (src_width <= 0 || src_height <= 0 || dst_width <= 0 || dst_height <= 0 || channels <= 0) {
+        throw std::invalid_argument("Resize needs positive dimensions.");
+    }
+    State& s = *state_;
+    s.src_width = src_width;
+    s.src_height = src_height;
+    s.dst_width = dst_width;
+    s.dst_height = dst_height;
+    s.channels = channels;
+    s.filter = filter;
+
+    if (filter == ResizeFilter::Nearest) {
+        // Same float mapping as the original per-pixel loop, computed once per axis
+        s.src_x.resize(dst_width);
+        s.src_y.resize(dst_height);
+        for (int x = 0; x < dst_width; ++x) {
+            s.src_x[x] = static_cast<int>((x / static_cast<float>(dst_width)) * src_width);
+        }
+        for (int y = 0; y < dst_height; ++y) {
+            s.src_y[y] = static_cast<int>((y / static_cast<float>(dst_height)) * src_height);
+        }
+        return;
+    }
+
+    if (filter == ResizeFilter::Area && src_width % dst_width == 0 && src_height % dst_height == 0) {
+        s.factor_x = src_width / dst_width;
+        s.factor_y = src_height / dst_height;
+        return;
+    }
+
+    stbir_resize_init(&s.stb, nullptr, src_width, src_height, 0, nullptr, dst_width, dst_height, 0,
+                      layout_for(channels), STBIR_TYPE_UINT8);
+    stbir_set_edgemodes(&s.stb, STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP);
+    if (filter == ResizeFilter::Lanczos) {
+        stbir_set_filter_callbacks(&s.stb, lanczos3_kernel, lanczos3_support, lanczos3_kernel, lanczos3_support);
+    } else {
+        stbir_set_filters(&s.stb, stb_filter(filter), stb_filter(filter));
+    }
+    s.splits = stbir_build_samplers_with_splits(&s.stb, num_threads());
+    if (s.splits <= 0) {
+        throw std::runtime_error("Error building resize samplers.");
+    }
+}
+
+Resizer::~Resizer() {
+    if (state_ && state_->splits > 0) {
+        stbir_free_samplers(&state_->stb);
+    }
+}
+
+void Resizer::resize(const unsigned char* src, std::ptrdiff_t src_stride, unsigned char* dst, std::ptrdiff_t dst_stride) {
+    State& s = *state_;
+
+    if (s.filter == ResizeFilter::Nearest) {
+        const int channels = s.channels;
+        const int min_rows = static_cast<int>(std::max<size_t>(1, kMinChunkBytes / (size_t(s.dst_width) * channels)));
+        parallel_rows(s.dst_height, [&](int y_begin, int y_end) {
+            for (int y = y_begin; y < y_end; ++y) {
+                const unsigned char* in = src + s.src_y[y] * src_stride;
+                unsigned char* out = dst + y * dst_stride;
+                for (int x = 0; x < s.dst_width; ++x) {
+                    const unsigned char* pixel = in + s.src_x[x] * channels;
+                    for (int c = 0; c < channels; ++c) {
+                        out[x * channels + c] = pixel[c];
+                    }
+                }
+            }
+        }, min_rows);
+        return;
+    }
+
+    if (s.factor_x > 0) {
+        downsample(src, s.src_width, s.src_height, src_stride, dst, dst_stride, s.channels, s.factor_x, s.factor_y);
+        return;
+    }
+
+    stbir_set_buffer_ptrs(&s.stb, src, static_cast<int>(src_stride), dst, static_cast<int>(dst_stride));
+    std::atomic<bool> ok{true};
+    default_thread_pool().run(s.splits, [&](int split) {
+        if (!stbir_resize_extended_split(&s.stb, split, 1)) {
+            ok = false;
+        }
+    });
+    if (!ok) {
+        throw std::runtime_error("Error resizing image.");
+    }
+}
+
+void resize(const unsigned char* src, int src_width, int src_height, std::ptrdiff_t src_stride,
+            unsigned char* dst, int dst_width, int dst_height, std::ptrdiff_t dst_stride,
+            int channels, ResizeFilter filter) {
+    Resizer resizer(src_width, src_height, dst_width, dst_height, channels, filter);
+    resizer.resize(src, src_stride, dst, dst_stride);
+}
@@ -0,0 +1,649 @@
+#include "../include/simd_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace scalar {
+
+void add_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = std::clamp(a[i] + b[i], 0, 255);
+    }
+}
+
+void subtract_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = std::clamp(a[i] - b[i], 0, 255);
+    }
+}
+
+void add_scalar_saturate(const unsigned char* in, unsigned char* out, size_t count, int value) {
+    // Same result for every in-range sum, and in + value can no longer overflow
+    value = std::clamp(value, -255, 255);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = std::clamp(static_cast<int>(in[i]) + value, 0, 255);
+    }
+}
+
+void contrast_bytes(const unsigned char* in, unsigned char* out, size_t count, float factor) {
+    const float midpoint = 127.5f;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = std::clamp(static_cast<int>((in[i] - midpoint) * factor + midpoint), 0, 255);
+    }
+}
+
+void threshold_bytes(const unsigned char* in, unsigned char* out, size_t count, unsigned char threshold) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = (in[i] >= threshold) ? 255 : 0;
+    }
+}
+
+void lut_bytes(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* table) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = table[in[i]];
+    }
+}
+
+void downsample2x_row(const unsigned char* row0, const unsigned char* row1, unsigned char* out, size_t out_pixels, int channels) {
+    for (size_t x = 0; x < out_pixels; ++x) {
+        const unsigned char* a = row0 + 2 * x * channels;
+        const unsigned char* b = row1 + 2 * x * channels;
+        for (int c = 0; c < channels; ++c) {
+            out[x * channels + c] = static_cast<unsigned char>((a[c] + a[c + channels] + b[c] + b[c + channels] + 2) >> 2);
+        }
+    }
+}
+
+void stream_copy(const unsigned char* in, unsigned char* out, size_t count) {
+    std::memcpy(out, in, count);
+}
+
+} // namespace scalar
+
+namespace {
+
+// Brightness offsets beyond +-255 saturate every byte, so they behave like +-255
+unsigned char brightness_magnitude(int value) {
+    int clamped = std::clamp(value, -255, 255);
+    return static_cast<unsigned char>(clamped >= 0 ? clamped : -clamped);
+}
+
+#if defined(SIMD_X86)
+
+// ---- SSE4.1: 16 bytes per step ----
+
+SIMD_TARGET("sse4.1")
+void add_sse41(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_adds_epu8(va, vb));
+    }
+    scalar::add_saturate(a + i, b + i, out + i, count - i);
+}
+
+SIMD_TARGET("sse4.1")
+void subtract_sse41(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_subs_epu8(va, vb));
+    }
+    scalar::subtract_saturate(a + i, b + i, out + i, count - i);
+}
+
+SIMD_TARGET("sse4.1")
+void add_scalar_sse41(const unsigned char* in, unsigned char* out, size_t count, int value) {
+    const __m128i amount = _mm_set1_epi8(static_cast<char>(brightness_magnitude(value)));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        v = value >= 0 ? _mm_adds_epu8(v, amount) : _mm_subs_epu8(v, amount);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+    }
+    scalar::add_scalar_saturate(in + i, out + i, count - i, value);
+}
+
+SIMD_TARGET("sse4.1")
+__m128i contrast4_sse41(__m128i bytes, __m128 midpoint, __m128 factor) {
+    __m128 v = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes));
+    v = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v, midpoint), factor), midpoint);
+    return _mm_cvttps_epi32(v);
+}
+
+SIMD_TARGET("sse4.1")
+void contrast_sse41(const unsigned char* in, unsigned char* out, size_t count, float factor) {
+    const __m128 midpoint = _mm_set1_ps(127.5f);
+    const __m128 vfactor = _mm_set1_ps(factor);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i r0 = contrast4_sse41(v, midpoint, vfactor);
+        __m128i r1 = contrast4_sse41(_mm_srli_si128(v, 4), midpoint, vfactor);
+        __m128i r2 = contrast4_sse41(_mm_srli_si128(v, 8), midpoint, vfactor);
+        __m128i r3 = contrast4_sse41(_mm_srli_si128(v, 12), midpoint, vfactor);
+        // Signed then unsigned saturation is the clamp to [0, 255]
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    scalar::contrast_bytes(in + i, out + i, count - i, factor);
+}
+
+SIMD_TARGET("sse4.1")
+void threshold_sse41(const unsigned char* in, unsigned char* out, size_t count, unsigned char threshold) {
+    const __m128i t = _mm_set1_epi8(static_cast<char>(threshold));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        // v >= t exactly when max(v, t) == v
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_cmpeq_epi8(_mm_max_epu8(v, t), v));
+    }
+    scalar::threshold_bytes(in + i, out + i, count - i, threshold);
+}
+
+// 256-entry lookup built from 16-entry shuffles. Step k looks up table bytes
+// 16k..16k+15: subtracting 16k moves group k's inputs to 0..15, and the
+// saturating add of 0x70 sets bit 7 on every other input so the shuffle zeroes
+// it. Two vectors per step keep the table registers busy.
+SIMD_TARGET("sse4.1")
+void lut_sse41(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* table) {
+    __m128i groups[16];
+    for (int k = 0; k < 16; ++k) {
+        groups[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + 16 * k));
+    }
+    const __m128i bias = _mm_set1_epi8(0x70);
+    const __m128i step = _mm_set1_epi8(16);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16));
+        __m128i result_a = _mm_setzero_si128();
+        __m128i result_b = _mm_setzero_si128();
+        for (int k = 0; k < 16; ++k) {
+            result_a = _mm_or_si128(result_a, _mm_shuffle_epi8(groups[k], _mm_adds_epu8(a, bias)));
+            result_b = _mm_or_si128(result_b, _mm_shuffle_epi8(groups[k], _mm_adds_epu8(b, bias)));
+            a = _mm_sub_epi8(a, step);
+            b = _mm_sub_epi8(b, step);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result_a);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 16), result_b);
+    }
+    scalar::lut_bytes(in + i, out + i, count - i, table);
+}
+
+// 2x2 box average. The shuffle puts the two horizontal neighbours of every
+// channel next to each other, and maddubs against ones adds them into 16 bits.
+// Only 1, 2 and 4 channels tile a 16-byte register evenly.
+SIMD_TARGET("sse4.1")
+__m128i pair_shuffle_sse41(int channels) {
+    switch (channels) {
+    case 2: return _mm_setr_epi8(0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15);
+    case 4: return _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    default: return _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    }
+}
+
+SIMD_TARGET("sse4.1")
+void downsample2x_sse41(const unsigned char* row0, const unsigned char* row1, unsigned char* out, size_t out_pixels, int channels) {
+    if (channels != 1 && channels != 2 && channels != 4) {
+        scalar::downsample2x_row(row0, row1, out, out_pixels, channels);
+        return;
+    }
+    const __m128i order = pair_shuffle_sse41(channels);
+    const __m128i ones = _mm_set1_epi8(1);
+    const __m128i round = _mm_set1_epi16(2);
+    const size_t out_bytes = out_pixels * channels;
+    size_t i = 0;
+    for (; i + 16 <= out_bytes; i += 16) {
+        __m128i sums[2];
+        for (int half = 0; half < 2; ++half) {
+            size_t offset = 2 * i + 16 * half;
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + offset)), order);
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + offset)), order);
+            __m128i sum = _mm_add_epi16(_mm_maddubs_epi16(a, ones), _mm_maddubs_epi16(b, ones));
+            sums[half] = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(sums[0], sums[1]));
+    }
+    scalar::downsample2x_row(row0 + 2 * i, row1 + 2 * i, out + i, (out_bytes - i) / channels, channels);
+}
+
+// Non-temporal stores need an aligned destination: copy up to the boundary first.
+// The fence makes the stores visible before whoever consumes the buffer reads it.
+SIMD_TARGET("sse4.1")
+void stream_copy_sse41(const unsigned char* in, unsigned char* out, size_t count) {
+    size_t head = std::min(count, (16 - reinterpret_cast<uintptr_t>(out) % 16) % 16);
+    std::memcpy(out, in, head);
+    size_t i = head;
+    for (; i + 64 <= count; i += 64) {
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16 * k));
+            _mm_stream_si128(reinterpret_cast<__m128i*>(out + i + 16 * k), v);
+        }
+    }
+    std::memcpy(out + i, in + i, count - i);
+    _mm_sfence();
+}
+
+// ---- AVX2: 32 bytes per step ----
+
+SIMD_TARGET("avx2")
+void add_avx2(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_adds_epu8(va, vb));
+    }
+    add_sse41(a + i, b + i, out + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+void subtract_avx2(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_subs_epu8(va, vb));
+    }
+    subtract_sse41(a + i, b + i, out + i, count - i);
+}
+
+SIMD_TARGET("avx2")
+void add_scalar_avx2(const unsigned char* in, unsigned char* out, size_t count, int value) {
+    const __m256i amount = _mm256_set1_epi8(static_cast<char>(brightness_magnitude(value)));
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        v = value >= 0 ? _mm256_adds_epu8(v, amount) : _mm256_subs_epu8(v, amount);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+    }
+    add_scalar_sse41(in + i, out + i, count - i, value);
+}
+
+SIMD_TARGET("avx2")
+__m256i contrast8_avx2(__m128i bytes, __m256 midpoint, __m256 factor) {
+    __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    v = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(v, midpoint), factor), midpoint);
+    return _mm256_cvttps_epi32(v);
+}
+
+SIMD_TARGET("avx2")
+void contrast_avx2(const unsigned char* in, unsigned char* out, size_t count, float factor) {
+    const __m256 midpoint = _mm256_set1_ps(127.5f);
+    const __m256 vfactor = _mm256_set1_ps(factor);
+    // The packs work per 128-bit lane; this puts the 32 results back in order
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 16));
+        __m256i r0 = contrast8_avx2(lo, midpoint, vfactor);
+        __m256i r1 = contrast8_avx2(_mm_srli_si128(lo, 8), midpoint, vfactor);
+        __m256i r2 = contrast8_avx2(hi, midpoint, vfactor);
+        __m256i r3 = contrast8_avx2(_mm_srli_si128(hi, 8), midpoint, vfactor);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(r0, r1), _mm256_packs_epi32(r2, r3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+    contrast_sse41(in + i, out + i, count - i, factor);
+}
+
+SIMD_TARGET("avx2")
+void threshold_avx2(const unsigned char* in, unsigned char* out, size_t count, unsigned char threshold) {
+    const __m256i t = _mm256_set1_epi8(static_cast<char>(threshold));
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_cmpeq_epi8(_mm256_max_epu8(v, t), v));
+    }
+    threshold_sse41(in + i, out + i, count - i, threshold);
+}
+
+SIMD_TARGET("avx2")
+void lut_avx2(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* table) {
+    __m256i groups[16];
+    for (int k = 0; k < 16; ++k) {
+        groups[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(table + 16 * k)));
+    }
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const __m256i step = _mm256_set1_epi8(16);
+    size_t i = 0;
+    for (; i + 64 <= count; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 32));
+        __m256i result_a = _mm256_setzero_si256();
+        __m256i result_b = _mm256_setzero_si256();
+        for (int k = 0; k < 16; ++k) {
+            result_a = _mm256_or_si256(result_a, _mm256_shuffle_epi8(groups[k], _mm256_adds_epu8(a, bias)));
+            result_b = _mm256_or_si256(result_b, _mm256_shuffle_epi8(groups[k], _mm256_adds_epu8(b, bias)));
+            a = _mm256_sub_epi8(a, step);
+            b = _mm256_sub_epi8(b, step);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result_a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 32), result_b);
+    }
+    lut_sse41(in + i, out + i, count - i, table);
+}
+
+SIMD_TARGET("avx2")
+void downsample2x_avx2(const unsigned char* row0, const unsigned char* row1, unsigned char* out, size_t out_pixels, int channels) {
+    if (channels != 1 && channels != 2 && channels != 4) {
+        scalar::downsample2x_row(row0, row1, out, out_pixels, channels);
+        return;
+    }
+    const __m256i order = _mm256_broadcastsi128_si256(pair_shuffle_sse41(channels));
+    const __m256i ones = _mm256_set1_epi8(1);
+    const __m256i round = _mm256_set1_epi16(2);
+    const size_t out_bytes = out_pixels * channels;
+    size_t i = 0;
+    for (; i + 32 <= out_bytes; i += 32) {
+        __m256i sums[2];
+        for (int half = 0; half < 2; ++half) {
+            size_t offset = 2 * i + 32 * half;
+            __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + offset)), order);
+            __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + offset)), order);
+            __m256i sum = _mm256_add_epi16(_mm256_maddubs_epi16(a, ones), _mm256_maddubs_epi16(b, ones));
+            sums[half] = _mm256_srli_epi16(_mm256_add_epi16(sum, round), 2);
+        }
+        // packus interleaves the 128-bit lanes; put them back in order
+        __m256i packed = _mm256_packus_epi16(sums[0], sums[1]);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    downsample2x_sse41(row0 + 2 * i, row1 + 2 * i, out + i, (out_bytes - i) / channels, channels);
+}
+
+SIMD_TARGET("avx2")
+void stream_copy_avx2(const unsigned char* in, unsigned char* out, size_t count) {
+    size_t head = std::min(count, (32 - reinterpret_cast<uintptr_t>(out) % 32) % 32);
+    std::memcpy(out, in, head);
+    size_t i = head;
+    for (; i + 128 <= count; i += 128) {
+        for (int k = 0; k < 4; ++k) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 32 * k));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(out + i + 32 * k), v);
+        }
+    }
+    std::memcpy(out + i, in + i, count - i);
+    _mm_sfence();
+}
+
+#elif defined(SIMD_NEON)
+
+// ---- NEON: 16 bytes per step ----
+
+void add_neon(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u8(out + i, vqaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    }
+    scalar::add_saturate(a + i, b + i, out + i, count - i);
+}
+
+void subtract_neon(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u8(out + i, vqsubq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    }
+    scalar::subtract_saturate(a + i, b + i, out + i, count - i);
+}
+
+void add_scalar_neon(const unsigned char* in, unsigned char* out, size_t count, int value) {
+    const uint8x16_t amount = vdupq_n_u8(brightness_magnitude(value));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        vst1q_u8(out + i, value >= 0 ? vqaddq_u8(v, amount) : vqsubq_u8(v, amount));
+    }
+    scalar::add_scalar_saturate(in + i, out + i, count - i, value);
+}
+
+void threshold_neon(const unsigned char* in, unsigned char* out, size_t count, unsigned char threshold) {
+    const uint8x16_t t = vdupq_n_u8(threshold);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        vst1q_u8(out + i, vcgeq_u8(vld1q_u8(in + i), t));
+    }
+    scalar::threshold_bytes(in + i, out + i, count - i, threshold);
+}
+
+void lut_neon(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* table) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+    // Four 64-byte table lookups; indices past a table's end leave the byte untouched
+    const uint8x16x4_t t0 = vld1q_u8_x4(table);
+    const uint8x16x4_t t1 = vld1q_u8_x4(table + 64);
+    const uint8x16x4_t t2 = vld1q_u8_x4(table + 128);
+    const uint8x16x4_t t3 = vld1q_u8_x4(table + 192);
+    const uint8x16_t step = vdupq_n_u8(64);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(in + i);
+        uint8x16_t result = vqtbl4q_u8(t0, v);
+        v = vsubq_u8(v, step);
+        result = vqtbx4q_u8(result, t1, v);
+        v = vsubq_u8(v, step);
+        result = vqtbx4q_u8(result, t2, v);
+        v = vsubq_u8(v, step);
+        result = vqtbx4q_u8(result, t3, v);
+        vst1q_u8(out + i, result);
+    }
+    scalar::lut_bytes(in + i, out + i, count - i, table);
+#else
+    scalar::lut_bytes(in, out, count, table);
+#endif
+}
+
+// 2x2 box average: de-interleave channels, add neighbouring pairs into 16 bits,
+// then a rounding narrow shift divides by 4
+void downsample2x_neon(const unsigned char* row0, const unsigned char* row1, unsigned char* out, size_t out_pixels, int channels) {
+    size_t x = 0;
+    if (channels == 1) {
+        for (; x + 8 <= out_pixels; x += 8) {
+            uint16x8_t sum = vaddq_u16(vpaddlq_u8(vld1q_u8(row0 + 2 * x)), vpaddlq_u8(vld1q_u8(row1 + 2 * x)));
+            vst1_u8(out + x, vrshrn_n_u16(sum, 2));
+        }
+    } else if (channels == 2) {
+        for (; x + 8 <= out_pixels; x += 8) {
+            uint8x16x2_t a = vld2q_u8(row0 + 4 * x);
+            uint8x16x2_t b = vld2q_u8(row1 + 4 * x);
+            uint8x8x2_t result;
+            for (int c = 0; c < 2; ++c) {
+                result.val[c] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+            }
+            vst2_u8(out + 2 * x, result);
+        }
+    } else if (channels == 4) {
+        for (; x + 8 <= out_pixels; x += 8) {
+            uint8x16x4_t a = vld4q_u8(row0 + 8 * x);
+            uint8x16x4_t b = vld4q_u8(row1 + 8 * x);
+            uint8x8x4_t result;
+            for (int c = 0; c < 4; ++c) {
+                result.val[c] = vrshrn_n_u16(vaddq_u16(vpaddlq_u8(a.val[c]), vpaddlq_u8(b.val[c])), 2);
+            }
+            vst4_u8(out + 4 * x, result);
+        }
+    }
+    size_t offset = 2 * x * channels;
+    scalar::downsample2x_row(row0 + offset, row1 + offset, out + x * channels, out_pixels - x, channels);
+}
+
+#endif
+
+// Contrast through a 256-entry table built with the reference formula; cheaper
+// than per-byte float math wherever the lookup kernel beats the arithmetic one
+template <void (*Lookup)(const unsigned char*, unsigned char*, size_t, const unsigned char*)>
+void contrast_via_lut(const unsigned char* in, unsigned char* out, size_t count, float factor) {
+    if (count < 256) {
+        scalar::contrast_bytes(in, out, count, factor);
+        return;
+    }
+    unsigned char identity[256];
+    unsigned char table[256];
+    for (int i = 0; i < 256; ++i) {
+        identity[i] = static_cast<unsigned char>(i);
+    }
+    scalar::contrast_bytes(identity, table, 256, factor);
+    Lookup(in, out, count, table);
+}
+
+struct Kernels {
+    void (*add)(const unsigned char*, const unsigned char*, unsigned char*, size_t);
+    void (*subtract)(const unsigned char*, const unsigned char*, unsigned char*, size_t);
+    void (*add_scalar)(const unsigned char*, unsigned char*, size_t, int);
+    void (*contrast)(const unsigned char*, unsigned char*, size_t, float);
+    void (*threshold)(const unsigned char*, unsigned char*, size_t, unsigned char);
+    void (*lut)(const unsigned char*, unsigned char*, size_t, const unsigned char*);
+    void (*downsample2x)(const unsigned char*, const unsigned char*, unsigned char*, size_t, int);
+    void (*stream_copy)(const unsigned char*, unsigned char*, size_t);
+};
+
+const Kernels scalar_kernels = {scalar::add_saturate, scalar::subtract_saturate, scalar::add_scalar_saturate,
+                                contrast_via_lut<scalar::lut_bytes>, scalar::threshold_bytes, scalar::lut_bytes,
+                                scalar::downsample2x_row, scalar::stream_copy};
+#if defined(SIMD_X86)
+const Kernels sse41_kernels = {add_sse41, subtract_sse41, add_scalar_sse41, contrast_sse41, threshold_sse41, lut_sse41,
+                               downsample2x_sse41, stream_copy_sse41};
+const Kernels avx2_kernels = {add_avx2, subtract_avx2, add_scalar_avx2, contrast_avx2, threshold_avx2, lut_avx2,
+                              downsample2x_avx2, stream_copy_avx2};
+#elif defined(SIMD_NEON)
+const Kernels neon_kernels = {add_neon, subtract_neon, add_scalar_neon, contrast_via_lut<lut_neon>, threshold_neon, lut_neon,
+                              downsample2x_neon, scalar::stream_copy};
+#endif
+
+SimdLevel detect() {
+#if defined(SIMD_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) return SimdLevel::AVX2;
+    if (sse41) return SimdLevel::SSE41;
+    return SimdLevel::Scalar;
+#elif defined(SIMD_NEON)
+    return SimdLevel::NEON;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+std::atomic<const Kernels*> active_kernels{nullptr};
+std::atomic<SimdLevel> active_level{SimdLevel::Scalar};
+
+bool supported(SimdLevel level, SimdLevel detected) {
+    switch (level) {
+    case SimdLevel::Scalar: return true;
+    case SimdLevel::SSE41: return detected == SimdLevel::SSE41 || detected == SimdLevel::AVX2;
+    case SimdLevel::AVX2: return detected == SimdLevel::AVX2;
+    case SimdLevel::NEON: return detected == SimdLevel::NEON;
+    }
+    return false;
+}
+
+const Kernels* kernels_for(SimdLevel level) {
+    switch (level) {
+#if defined(SIMD_X86)
+    case SimdLevel::AVX2: return &avx2_kernels;
+    case SimdLevel::SSE41: return &sse41_kernels;
+#elif defined(SIMD_NEON)
+    case SimdLevel::NEON: return &neon_kernels;
+#endif
+    default: return &scalar_kernels;
+    }
+}
+
+const Kernels& kernels() {
+    const Kernels* k = active_kernels.load(std::memory_order_acquire);
+    if (k == nullptr) {
+        set_simd_level(detected_simd_level());
+        k = active_kernels.load(std::memory_order_acquire);
+    }
+    return *k;
+}
+
+} // namespace
+
+SimdLevel detected_simd_level() {
+    static const SimdLevel level = detect();
+    return level;
+}
+
+SimdLevel simd_level() {
+    kernels();
+    return active_level;
+}
+
+void set_simd_level(SimdLevel level) {
+    SimdLevel detected = detected_simd_level();
+    if (!supported(level, detected)) {
+        level = detected;
+    }
+    active_level = level;
+    active_kernels.store(kernels_for(level), std::memory_order_release);
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar: return "scalar";
+    case SimdLevel::SSE41: return "SSE4.1";
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::NEON: return "NEON";
+    }
+    return "unknown";
+}
+
+void add_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    kernels().add(a, b, out, count);
+}
+
+void subtract_saturate(const unsigned char* a, const unsigned char* b, unsigned char* out, size_t count) {
+    kernels().subtract(a, b, out, count);
+}
+
+void add_scalar_saturate(const unsigned char* in, unsigned char* out, size_t count, int value) {
+    kernels().add_scalar(in, out, count, value);
+}
+
+void contrast_bytes(const unsigned char* in, unsigned char* out, size_t count, float factor) {
+    kernels().contrast(in, out, count, factor);
+}
+
+void threshold_bytes(const unsigned char* in, unsigned char* out, size_t count, unsigned char threshold) {
+    kernels().threshold(in, out, count, threshold);
+}
+
+void lut_bytes(const unsigned char* in, unsigned char* out, size_t count, const unsigned char* table) {
+    kernels().lut(in, out, count, table);
+}
+
+void downsample2x_row(const unsigned char* row0, const unsigned char* row1, unsigned char* out, size_t out_pixels, int channels) {
+    kernels().downsample2x(row0, row1, out, out_pixels, channels);
+}
+
+void stream_copy(const unsigned char* in, unsigned char* out, size_t count) {
+    kernels().stream_copy(in, out, count);
+}
@@ -0,0 +1,235 @@
+#include "../include/thread_pool.h"
+
+#include <algorithm>
+#include <exception>
+
+namespace {
+
+// Which pool (and which of its queues) the current thread works for
+thread_local const ThreadPool* tls_pool = nullptr;
+thread_local int tls_queue = -1;
+
+// Tasks per thread the schedulers aim for, so uneven bands still balance out
+constexpr int kTasksPerThread = 4;
+
+std::mutex settings_mutex;
+int requested_threads = 0;
+std::atomic<int> requested_tile_rows{0};
+std::unique_ptr<ThreadPool> shared_pool;
+
+} // namespace
+
+ThreadPool::ThreadPool(int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < num_threads - 1; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < num_threads - 1; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::push(int queue, std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+    queues_[queue]->tasks.push_back(std::move(task));
+    ++pending_;
+}
+
+// Pop from our own queue (newest first), otherwise steal the oldest task of another
+bool ThreadPool::run_one(int self) {
+    std::function<void()> task;
+    const int count = static_cast<int>(queues_.size());
+
+    if (self >= 0) {
+        std::lock_guard<std::mutex> lock(queues_[self]->mutex);
+        if (!queues_[self]->tasks.empty()) {
+            task = std::move(queues_[self]->tasks.back());
+            queues_[self]->tasks.pop_back();
+        }
+    }
+    for (int k = 1; !task && k <= count; ++k) {
+        int victim = (std::max(self, 0) + k) % count;
+        std::lock_guard<std::mutex> lock(queues_[victim]->mutex);
+        if (!queues_[victim]->tasks.empty()) {
+            task = std::move(queues_[victim]->tasks.front());
+            queues_[victim]->tasks.pop_front();
+        }
+    }
+    if (!task) {
+        return false;
+    }
+    --pending_;
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(int index) {
+    tls_pool = this;
+    tls_queue = index;
+    while (true) {
+        if (run_one(index)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_.wait(lock, [this] { return stopping_ || pending_ > 0; });
+        if (stopping_ && pending_ == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::run(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) {
+        return;
+    }
+    if (count == 1 || workers_.empty()) {
+        for (int i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    struct Batch {
+        std::atomic<int> remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+    auto batch = std::make_shared<Batch>();
+    batch->remaining = count;
+
+    // A worker keeps nested batches in its own queue; other callers spread them out
+    const int self = (tls_pool == this) ? tls_queue : -1;
+    for (int i = 0; i < count; ++i) {
+        int queue = self >= 0 ? self : static_cast<int>(next_queue_++ % queues_.size());
+        push(queue, [batch, &fn, i] {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                if (!batch->error) {
+                    batch->error = std::current_exception();
+                }
+            }
+            if (batch->remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(batch->mutex);
+                batch->done.notify_all();
+            }
+        });
+    }
+    {
+        // Taking the lock orders the new tasks before any worker goes back to sleep
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_.notify_all();
+
+    // Help out until the batch is finished, then wait for tasks still in flight
+    while (batch->remaining > 0) {
+        if (!run_one(self)) {
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->done.wait(lock, [&] { return batch->remaining == 0; });
+        }
+    }
+    if (batch->error) {
+        std::rethrow_exception(batch->error);
+    }
+}
+
+void set_num_threads(int num_threads) {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    if (num_threads != requested_threads) {
+        requested_threads = num_threads;
+        shared_pool.reset();
+    }
+}
+
+int num_threads() {
+    return default_thread_pool().size();
+}
+
+void set_tile_rows(int rows) {
+    requested_tile_rows = std::max(0, rows);
+}
+
+int tile_rows() {
+    return requested_tile_rows;
+}
+
+ThreadPool& default_thread_pool() {
+    std::lock_guard<std::mutex> lock(settings_mutex);
+    if (!shared_pool) {
+        shared_pool = std::make_unique<ThreadPool>(requested_threads);
+    }
+    return *shared_pool;
+}
+
+void parallel_rows(int height, const std::function<void(int, int)>& fn, int min_rows) {
+    if (height <= 0) {
+        return;
+    }
+    ThreadPool& pool = default_thread_pool();
+    int band = tile_rows();
+    if (band <= 0) {
+        band = (height + pool.size() * kTasksPerThread - 1) / (pool.size() * kTasksPerThread);
+    }
+    band = std::max({band, min_rows, 1});
+
+    int bands = (height + band - 1) / band;
+    if (bands == 1) {
+        fn(0, height);
+        return;
+    }
+    pool.run(bands, [&](int i) {
+        int y_begin = i * band;
+        fn(y_begin, std::min(height, y_begin + band));
+    });
+}
+
+void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    ThreadPool& pool = default_thread_pool();
+    size_t tasks = static_cast<size_t>(pool.size()) * kTasksPerThread;
+    size_t chunk = std::max({(count + tasks - 1) / tasks, grain, size_t(1)});
+
+    size_t chunks = (count + chunk - 1) / chunk;
+    if (chunks == 1) {
+        fn(0, count);
+        return;
+    }
+    pool.run(static_cast<int>(chunks), [&](int i) {
+        size_t begin = static_cast<size_t>(i) * chunk;
+        fn(begin, std::min(count, begin + chunk));
+    });
+}
+
+void parallel_tiles(int width, int height, int tile_width, int tile_height,
+                    const std::function<void(int, int, int, int)>& fn) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    tile_width = std::max(1, tile_width);
+    tile_height = std::max(1, tile_height);
+    int tiles_x = (width + tile_width - 1) / tile_width;
+    int tiles_y = (height + tile_height - 1) / tile_height;
+
+    default_thread_pool().run(tiles_x * tiles_y, [&](int i) {
+        int x_begin = (i % tiles_x) * tile_width;
+        int y_begin = (i / tiles_x) * tile_height;
+        fn(x_begin, y_begin, std::min(width, x_begin + tile_width), std::min(height, y_begin + tile_height));
+    });
+}
@@ -0,0 +1,339 @@
+// Checks LazyImage against the eager Image operations: random small graphs
+// (chains, shared intermediates, diamonds through add and subtract, crops and
+// resizes) must evaluate to exactly the bytes the same operations give when run
+// one by one, untiled and tiled with the default, a 16-pixel and an odd 37-pixel
+// tile. Also checks the planner's fusion, in-place steps, buffer reuse and tiled
+// chains through plan(). Prints each failure and exits non-zero if there was
+// any.
+//
+// Build from the repository root and run:
+//   g++ -std=c++17 -O2 -pthread -Iinclude tests/lazy_image_test.cpp $(ls src/*.cpp | grep -v main.cpp) -x c src/helpers.c -o lazy_image_test
+//   ./lazy_image_test
+
+#include "../include/downsample.h"
+#include "../include/lazy_image.h"
+#include "../include/lut.h"
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+std::mt19937 random_numbers(5);
+
+void fail(const std::string& what) {
+    std::printf("FAIL %s\n", what.c_str());
+    ++failures;
+}
+
+int random_int(int low, int high) {
+    return low + static_cast<int>(random_numbers() % static_cast<unsigned>(high - low + 1));
+}
+
+Image random_image(int width, int height, int channels) {
+    Image image = Image::uninitialized(width, height, channels);
+    for (int y = 0; y < height; ++y) {
+        unsigned char* row = image.view().row(y);
+        for (int x = 0; x < width * channels; ++x) {
+            // Smooth with some noise, so thresholds and filters have work to do
+            row[x] = static_cast<unsigned char>((x * 2 + y * 3) % 256 / 2 + random_numbers() % 64);
+        }
+    }
+    return image;
+}
+
+bool same_pixels(const Image& a, const Image& b) {
+    return a.width == b.width && a.height == b.height && a.channels == b.channels &&
+           std::memcmp(a.data, b.data, a.size()) == 0;
+}
+
+// One node of a test graph: the lazy handle, the eager result it must match and
+// how it was made
+struct Value {
+    LazyImage lazy;
+    Image eager;
+    std::string description;
+};
+
+// The result of a filter run eagerly from src into a new image of its size
+template <typename Run>
+Image eager_filter(const Image& src, Run run) {
+    Image out = Image::uninitialized(src.width, src.height, src.channels);
+    Image& target = const_cast<Image&>(src);
+    run(target, src.view(), out.view());
+    return out;
+}
+
+// Apply one random operation to in, eagerly and lazily. other is a candidate
+// second input for add and subtract.
+Value random_step(const Value& in, const Value& other) {
+    Image copy = in.eager;
+    const Image& src = in.eager;
+    switch (random_int(0, 17)) {
+    case 0: {
+        const int adjustment = random_int(-80, 80);
+        copy.adjust_brightness(copy.view(), adjustment);
+        return {in.lazy.brightness(adjustment), std::move(copy), "brightness " + std::to_string(adjustment)};
+    }
+    case 1: {
+        const float factor = random_int(2, 30) / 10.0f;
+        copy.adjust_contrast(copy.view(), factor);
+        return {in.lazy.contrast(factor), std::move(copy), "contrast " + std::to_string(factor)};
+    }
+    case 2: {
+        const unsigned char threshold = static_cast<unsigned char>(random_int(30, 220));
+        copy.threshold_image(copy.view(), threshold);
+        return {in.lazy.threshold(threshold), std::move(copy), "threshold " + std::to_string(threshold)};
+    }
+    case 3: {
+        const float gamma = random_int(3, 25) / 10.0f;
+        copy.adjust_gamma(copy.view(), gamma);
+        return {in.lazy.gamma(gamma), std::move(copy), "gamma " + std::to_string(gamma)};
+    }
+    case 4:
+        copy.invert_image(copy.view());
+        return {in.lazy.invert(), std::move(copy), "invert"};
+    case 5: {
+        std::array<unsigned char, 256> table;
+        for (unsigned char& entry : table) {
+            entry = static_cast<unsigned char>(random_numbers());
+        }
+        const Lut lut(table);
+        copy.apply_lut(copy.view(), lut);
+        return {in.lazy.lut(lut), std::move(copy), "lut"};
+    }
+    case 6:
+        if (src.channels >= 3) {
+            if (random_int(0, 1) == 0) {
+                copy.convert_to_grayscale(copy.view());
+                return {in.lazy.grayscale(), std::move(copy), "grayscale"};
+            }
+            copy.convert_to_sepia(copy.view());
+            return {in.lazy.sepia(), std::move(copy), "sepia"};
+        }
+        copy.invert_image(copy.view());
+        return {in.lazy.invert(), std::move(copy), "invert"};
+    case 7:
+    case 8: {
+        const int size = random_int(1, 7);
+        return {in.lazy.blur(size),
+                eager_filter(src, [size](Image& t, ConstImageView i, ImageView o) { t.low_pass_filter(i, o, size); }),
+                "blur " + std::to_string(size)};
+    }
+    case 9: {
+        const int size = random_int(2, 3);
+        return {in.lazy.high_pass(size),
+                eager_filter(src, [size](Image& t, ConstImageView i, ImageView o) { t.high_pass_filter(i, o, size); }),
+                "high_pass " + std::to_string(size)};
+    }
+    case 10:
+        return {in.lazy.otsu_threshold(),
+                eager_filter(src, [](Image& t, ConstImageView i, ImageView o) { t.otsu_threshold(i, o); }), "otsu"};
+    case 11: {
+        const int block = random_int(1, 15);
+        const int offset = random_int(-10, 10);
+        return {in.lazy.adaptive_threshold(block, offset),
+                eager_filter(src, [=](Image& t, ConstImageView i, ImageView o) { t.adaptive_threshold(i, o, block, offset); }),
+                "adaptive_threshold " + std::to_string(block)};
+    }
+    case 12: {
+        const int window = random_int(1, 11);
+        const float strength = random_int(5, 25) / 10.0f;
+        return {in.lazy.enhance_local_contrast(window, strength),
+                eager_filter(src, [=](Image& t, ConstImageView i, ImageView o) {
+                    t.enhance_local_contrast(i, o, window, strength);
+                }),
+                "enhance_local_contrast " + std::to_string(window)};
+    }
+    case 13: {
+        const int window = random_int(1, 11);
+        return {in.lazy.normalize_local_contrast(window),
+                eager_filter(src, [=](Image& t, ConstImageView i, ImageView o) { t.normalize_local_contrast(i, o, window); }),
+                "normalize_local_contrast " + std::to_string(window)};
+    }
+    case 14: {
+        const int width = random_int(20, 130);
+        const int height = random_int(20, 130);
+        const ResizeFilter filter = random_int(0, 1) == 0 ? ResizeFilter::Bilinear : ResizeFilter::Nearest;
+        Image out(width, height, src.channels);
+        copy.resize_image(src.view(), out.view(), filter);
+        return {in.lazy.resize(width, height, filter), std::move(out),
+                "resize " + std::to_string(width) + "x" + std::to_string(height)};
+    }
+    case 15: {
+        if (src.width < 40 || src.height < 40) {
+            break;
+        }
+        const int factor = random_int(2, 3);
+        Image out(downsampled_size(src.width, factor), downsampled_size(src.height, factor), src.channels);
+        copy.downsample_image(src.view(), out.view(), factor);
+        return {in.lazy.downsample(factor), std::move(out), "downsample " + std::to_string(factor)};
+    }
+    case 16: {
+        if (src.width < 30 || src.height < 30) {
+            break;
+        }
+        Rect rect;
+        rect.width = random_int(20, src.width);
+        rect.height = random_int(20, src.height);
+        rect.x = random_int(0, src.width - rect.width);
+        rect.y = random_int(0, src.height - rect.height);
+        return {in.lazy.crop(rect), src.crop(rect), "crop"};
+    }
+    case 17: {
+        if (other.eager.width != src.width || other.eager.height != src.height ||
+            other.eager.channels != src.channels) {
+            break;
+        }
+        Image out(src.width, src.height, src.channels);
+        if (random_int(0, 1) == 0) {
+            copy.add_images(src.view(), other.eager.view(), out.view());
+            return {in.lazy.add(other.lazy), std::move(out), "add (" + other.description + ")"};
+        }
+        copy.subtract_images(src.view(), other.eager.view(), out.view());
+        return {in.lazy.subtract(other.lazy), std::move(out), "subtract (" + other.description + ")"};
+    }
+    }
+    copy.invert_image(copy.view());
+    return {in.lazy.invert(), std::move(copy), "invert"};
+}
+
+// Evaluate value with every tiling setting and compare with its eager result
+void check_value(const std::string& graph, const Value& value, const std::vector<TileOptions>& settings) {
+    for (const TileOptions& tiles : settings) {
+        const std::string what = graph + " -> " + value.description + " tiles " +
+                                 (tiles.enabled ? std::to_string(tiles.tile_size) : std::string("off"));
+        try {
+            if (!same_pixels(value.lazy.evaluate(nullptr, tiles), value.eager)) {
+                fail(what + ": differs from the eager result\n" + value.lazy.plan(tiles));
+            }
+        } catch (const std::exception& e) {
+            fail(what + ": " + e.what());
+        }
+    }
+}
+
+void check_random_graphs(const std::vector<TileOptions>& settings) {
+    for (int graph = 0; graph < 150; ++graph) {
+        const int channels = graph % 3 == 0 ? 1 : graph % 3 == 1 ? 3 : 4;
+        Image source = random_image(random_int(60, 110), random_int(60, 110), channels);
+        std::vector<Value> values;
+        values.push_back({LazyImage(source), source, "source"});
+        const int steps = random_int(3, 12);
+        for (int i = 0; i < steps; ++i) {
+            // Mostly extend the newest value (chains); sometimes branch off an
+            // older one, so intermediates get several readers
+            const size_t from = random_int(0, 3) == 0 ? random_int(0, static_cast<int>(values.size()) - 1) : values.size() - 1;
+            const Value& other = values[random_int(0, static_cast<int>(values.size()) - 1)];
+            Value next = random_step(values[from], other);
+            next.description = values[from].description + ", " + next.description;
+            values.push_back(std::move(next));
+        }
+        const std::string name = "graph " + std::to_string(graph);
+        check_value(name, values.back(), settings);
+        // An intermediate too: its graph is a prefix of the final one
+        check_value(name, values[random_int(1, static_cast<int>(values.size()) - 1)], settings);
+    }
+}
+
+// Number of buffers on the last line of a plan
+int plan_buffers(const std::string& plan) {
+    return std::atoi(plan.c_str() + plan.rfind('\n') + 1);
+}
+
+int count_of(const std::string& text, const std::string& part) {
+    int count = 0;
+    for (size_t pos = text.find(part); pos != std::string::npos; pos = text.find(part, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+void check_plans() {
+    TileOptions untiled;
+    untiled.enabled = false;
+    const LazyImage source(random_image(48, 40, 3));
+
+    // A long chain alternating operations that need a fresh buffer with ones
+    // that run in place needs two buffers, whatever its length
+    LazyImage chain = source;
+    for (int i = 0; i < 100; ++i) {
+        chain = chain.brightness(1).blur(3).grayscale().contrast(1.01f).high_pass(3).invert();
+    }
+    const std::string chain_plan = chain.plan(untiled);
+    if (plan_buffers(chain_plan) != 2) {
+        fail("plan of a 600-step chain uses " + std::to_string(plan_buffers(chain_plan)) + " buffers, not 2");
+    }
+    // Neighbouring point operations fuse: blur, grayscale, lut(contrast),
+    // high_pass and lut(invert, next brightness) per round, after the first
+    // brightness
+    if (count_of(chain_plan, "\n") != 501) {
+        fail("plan of a 600-step chain has " + std::to_string(count_of(chain_plan, "\n")) + " steps, not 501");
+    }
+
+    // Only the first of a run of in-place operations, which reads the source,
+    // needs a buffer
+    LazyImage in_place = source.brightness(10);
+    for (int i = 0; i < 50; ++i) {
+        in_place = in_place.grayscale().adaptive_threshold(5, 2).enhance_local_contrast(3, 1.5f).invert();
+    }
+    const std::string in_place_plan = in_place.plan(untiled);
+    if (plan_buffers(in_place_plan) != 1 || count_of(in_place_plan, ", in place") != 200) {
+        fail("in-place chain plan:\n" + in_place_plan);
+    }
+
+    // A result read twice gets its own buffer for the first reader and is
+    // reused in place by the last one; a crop is a view
+    const LazyImage shared = source.blur(3);
+    const LazyImage diamond = shared.invert().add(shared.crop(Rect{0, 0, 48, 40}).threshold(100));
+    const std::string diamond_plan = diamond.plan(untiled);
+    if (count_of(diamond_plan, "view of") != 1 || count_of(diamond_plan, "lut(invert) (buffer 0) -> buffer 1\n") != 1 ||
+        plan_buffers(diamond_plan) != 2) {
+        fail("diamond plan:\n" + diamond_plan);
+    }
+
+    // Same-size neighbourhood chains on an image bigger than a tile run as one
+    // tiled step whose halo is the sum of the kernels' radii: 2 + 1 + 3 + 0
+    TileOptions tiled;
+    tiled.tile_size = 37;
+    const LazyImage large(random_image(150, 120, 3));
+    const LazyImage filters = large.blur(5).high_pass(3).adaptive_threshold(7, 3).invert().grayscale();
+    const std::string tiled_plan = filters.plan(tiled);
+    if (count_of(tiled_plan, "\n") != 1 || count_of(tiled_plan, "tiles 37 halo 6 [") != 1 ||
+        plan_buffers(tiled_plan) != 1) {
+        fail("tiled chain plan:\n" + tiled_plan);
+    }
+    // Otsu needs the whole image, so it splits the chain
+    const std::string split_plan = large.blur(3).otsu_threshold().blur(3).plan(tiled);
+    if (count_of(split_plan, "otsu_threshold (") != 1) {
+        fail("chain through otsu_threshold plan:\n" + split_plan);
+    }
+}
+
+} // namespace
+
+int main() {
+    TileOptions untiled;
+    untiled.enabled = false;
+    std::vector<TileOptions> settings{untiled};
+    for (int tile_size : {0, 16, 37}) {
+        TileOptions tiled;
+        tiled.tile_size = tile_size;
+        settings.push_back(tiled);
+    }
+    check_random_graphs(settings);
+    check_plans();
+
+    if (failures > 0) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+    std::printf("All LazyImage checks passed.\n");
+    return 0;
+}
@@ -0,0 +1,509 @@
+// Checks the PNG codec:
+// - PngReader against stbi_load on hand-built files of every colour type and
+//   bit depth, palettes and tRNS included, with the image data split into IDAT
+//   chunks of several sizes, and that corrupt or truncated files throw;
+// - Deflater and Inflater round trips at every level, zlib and raw, with sync
+//   flushes, on data that makes stored, fixed and dynamic blocks;
+// - PngWriter round trips through PngReader and stbi_load for levels 0, 1, 6
+//   and 9, every filter and 1-4 channels, serial and parallel, and that the
+//   parallel encoder's output does not depend on the thread count.
+// Prints each failure and exits non-zero if there was any.
+//
+// Build from the repository root and run:
+//   g++ -std=c++17 -O2 -pthread -Iinclude tests/png_codec_test.cpp $(ls src/*.cpp | grep -v main.cpp) -x c src/helpers.c -o png_codec_test
+//   ./png_codec_test
+
+#include "../include/deflate.h"
+#include "../include/inflate.h"
+#include "../include/png_stream.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../stb_image/stb_image.h"
+
+namespace {
+
+int failures = 0;
+std::mt19937 random_bytes(11);
+std::string scratch_path;
+
+void fail(const std::string& what) {
+    std::printf("FAIL %s\n", what.c_str());
+    ++failures;
+}
+
+void write_file(const std::string& path, const std::vector<unsigned char>& bytes) {
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+void put_u32(std::vector<unsigned char>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<unsigned char>(value >> shift));
+    }
+}
+
+void put_chunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data) {
+    put_u32(out, static_cast<uint32_t>(data.size()));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    put_u32(out, crc32(0, out.data() + start, out.size() - start));
+}
+
+std::vector<unsigned char> zlib_compress(const std::vector<unsigned char>& data, int level) {
+    std::vector<unsigned char> out;
+    Deflater deflater(level, [&out](const unsigned char* bytes, size_t size) { out.insert(out.end(), bytes, bytes + size); });
+    deflater.write(data.data(), data.size());
+    deflater.finish();
+    return out;
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+// A PNG file as an encoder would write it, from the packed rows of samples.
+// Rows cycle through the five filter types so every unfilter path runs.
+struct PngSpec {
+    int width = 0;
+    int height = 0;
+    int depth = 8;
+    int color_type = 0;
+    std::vector<unsigned char> palette;  // RGB triples
+    std::vector<unsigned char> trns;
+    size_t idat_bytes = 0;               // per IDAT chunk; 0: one chunk
+};
+
+int samples_of(int color_type) {
+    switch (color_type) {
+    case 2: return 3;
+    case 4: return 2;
+    case 6: return 4;
+    default: return 1;
+    }
+}
+
+std::vector<unsigned char> build_png(const PngSpec& spec, const std::vector<unsigned char>& rows) {
+    const size_t row_bytes = (static_cast<size_t>(spec.width) * samples_of(spec.color_type) * spec.depth + 7) / 8;
+    const size_t bpp = std::max(1, samples_of(spec.color_type) * spec.depth / 8);
+    std::vector<unsigned char> filtered;
+    std::vector<unsigned char> zero(row_bytes, 0);
+    for (int y = 0; y < spec.height; ++y) {
+        const unsigned char* row = rows.data() + y * row_bytes;
+        const unsigned char* prev = y > 0 ? row - row_bytes : zero.data();
+        const int type = y % 5;
+        filtered.push_back(static_cast<unsigned char>(type));
+        for (size_t i = 0; i < row_bytes; ++i) {
+            const int a = i >= bpp ? row[i - bpp] : 0;
+            const int b = prev[i];
+            const int c = i >= bpp ? prev[i - bpp] : 0;
+            const int predictor = type == 0 ? 0 : type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : paeth(a, b, c);
+            filtered.push_back(static_cast<unsigned char>(row[i] - predictor));
+        }
+    }
+    const std::vector<unsigned char> compressed = zlib_compress(filtered, 6);
+
+    std::vector<unsigned char> file = {137, 80, 78, 71, 13, 10, 26, 10};
+    std::vector<unsigned char> header;
+    put_u32(header, static_cast<uint32_t>(spec.width));
+    put_u32(header, static_cast<uint32_t>(spec.height));
+    header.insert(header.end(), {static_cast<unsigned char>(spec.depth), static_cast<unsigned char>(spec.color_type), 0, 0, 0});
+    put_chunk(file, "IHDR", header);
+    put_chunk(file, "tEXt", std::vector<unsigned char>{'C', 'o', 'm', 'm', 'e', 'n', 't', 0, 'x'});
+    if (!spec.palette.empty()) {
+        put_chunk(file, "PLTE", spec.palette);
+    }
+    if (!spec.trns.empty()) {
+        put_chunk(file, "tRNS", spec.trns);
+    }
+    const size_t piece = spec.idat_bytes > 0 ? spec.idat_bytes : compressed.size();
+    for (size_t pos = 0; pos < compressed.size(); pos += piece) {
+        const size_t end = std::min(compressed.size(), pos + piece);
+        put_chunk(file, "IDAT", std::vector<unsigned char>(compressed.begin() + pos, compressed.begin() + end));
+    }
+    put_chunk(file, "IEND", {});
+    return file;
+}
+
+// Decode path with PngReader in bands of 5 rows; throws what PngReader throws
+std::vector<unsigned char> read_png(const std::string& path, int& width, int& height, int& channels) {
+    PngReader reader(path);
+    width = reader.width();
+    height = reader.height();
+    channels = reader.channels();
+    const size_t row_bytes = static_cast<size_t>(width) * channels;
+    std::vector<unsigned char> pixels(row_bytes * height);
+    int y = 0;
+    while (int rows = reader.read_rows(pixels.data() + y * row_bytes, static_cast<std::ptrdiff_t>(row_bytes), 5)) {
+        y += rows;
+    }
+    if (y != height) {
+        throw std::runtime_error("short read");
+    }
+    return pixels;
+}
+
+// PngReader's output for path must equal stbi_load's
+void check_against_stb(const std::string& what, const std::string& path) {
+    int width = 0, height = 0, channels = 0;
+    std::vector<unsigned char> pixels;
+    try {
+        pixels = read_png(path, width, height, channels);
+    } catch (const std::exception& e) {
+        fail(what + ": " + e.what());
+        return;
+    }
+    int w, h, n;
+    unsigned char* expected = stbi_load(path.c_str(), &w, &h, &n, channels);
+    if (expected == nullptr || w != width || h != height) {
+        fail(what + ": stb_image disagrees on the size");
+    } else if (std::memcmp(expected, pixels.data(), pixels.size()) != 0) {
+        fail(what + ": pixels differ from stbi_load");
+    }
+    stbi_image_free(expected);
+}
+
+void expect_throw(const std::string& what, const std::string& path) {
+    try {
+        int width, height, channels;
+        read_png(path, width, height, channels);
+        fail(what + ": decoded without an error");
+    } catch (const std::runtime_error&) {
+    }
+}
+
+void check_reader() {
+    struct Format {
+        int color_type;
+        int depth;
+        bool trns;
+    };
+    const Format formats[] = {
+        {0, 1, false}, {0, 2, false}, {0, 4, false}, {0, 8, false}, {0, 16, false}, {0, 2, true}, {0, 8, true},
+        {0, 16, true}, {2, 8, false}, {2, 16, false}, {2, 8, true},   {2, 16, true}, {3, 1, false}, {3, 2, true},
+        {3, 4, false}, {3, 8, false}, {3, 8, true},   {4, 8, false}, {4, 16, false}, {6, 8, false}, {6, 16, false},
+    };
+    for (const Format& format : formats) {
+        for (size_t idat_bytes : {size_t(0), size_t(1), size_t(13)}) {
+            PngSpec spec;
+            spec.width = 37;
+            spec.height = 23;
+            spec.color_type = format.color_type;
+            spec.depth = format.depth;
+            spec.idat_bytes = idat_bytes;
+            const size_t row_bytes = (static_cast<size_t>(spec.width) * samples_of(spec.color_type) * spec.depth + 7) / 8;
+            std::vector<unsigned char> rows(row_bytes * spec.height);
+            for (unsigned char& byte : rows) {
+                byte = static_cast<unsigned char>(random_bytes());
+            }
+            if (spec.color_type == 3) {
+                // Indices past the palette are an error; a full palette has none
+                const int entries = 1 << spec.depth;
+                for (int i = 0; i < entries * 3; ++i) {
+                    spec.palette.push_back(static_cast<unsigned char>(random_bytes()));
+                }
+                if (format.trns) {
+                    spec.trns = {0, 128, 255};
+                }
+            } else if (format.trns) {
+                // Key on the first pixel's samples, so it matches somewhere
+                const int samples = samples_of(spec.color_type);
+                for (int k = 0; k < samples; ++k) {
+                    int value;
+                    if (spec.depth == 16) {
+                        value = (rows[k * 2] << 8) | rows[k * 2 + 1];
+                    } else if (spec.depth < 8) {
+                        value = rows[0] >> (8 - spec.depth);
+                    } else {
+                        value = rows[k];
+                    }
+                    spec.trns.push_back(static_cast<unsigned char>(value >> 8));
+                    spec.trns.push_back(static_cast<unsigned char>(value));
+                }
+            }
+            write_file(scratch_path, build_png(spec, rows));
+            check_against_stb("reader colour type " + std::to_string(format.color_type) + " depth " +
+                                  std::to_string(format.depth) + (format.trns ? " tRNS" : "") + " IDAT chunks of " +
+                                  (idat_bytes == 0 ? std::string("all") : std::to_string(idat_bytes)),
+                              scratch_path);
+        }
+    }
+
+    // Damage: a flipped data byte with the CRC left alone, the same with the CRC
+    // fixed up (so the zlib checksum or the codes must catch it), a truncated
+    // file and a missing zlib trailer
+    PngSpec spec;
+    spec.width = 64;
+    spec.height = 48;
+    spec.color_type = 2;
+    std::vector<unsigned char> rows(static_cast<size_t>(64) * 48 * 3);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i] = static_cast<unsigned char>(i / 7);
+    }
+    const std::vector<unsigned char> good = build_png(spec, rows);
+    write_file(scratch_path, good);
+    check_against_stb("reader undamaged", scratch_path);
+
+    size_t idat = 8;
+    while (std::memcmp(good.data() + idat + 4, "IDAT", 4) != 0) {
+        idat += 12 + ((good[idat] << 24) | (good[idat + 1] << 16) | (good[idat + 2] << 8) | good[idat + 3]);
+    }
+    const size_t length = (good[idat] << 24) | (good[idat + 1] << 16) | (good[idat + 2] << 8) | good[idat + 3];
+    std::vector<unsigned char> bad = good;
+    bad[idat + 8 + length - 6] ^= 0x01;
+    write_file(scratch_path, bad);
+    expect_throw("reader flipped byte", scratch_path);
+
+    const uint32_t crc = crc32(0, bad.data() + idat + 4, length + 4);
+    for (int i = 0; i < 4; ++i) {
+        bad[idat + 8 + length + i] = static_cast<unsigned char>(crc >> (24 - 8 * i));
+    }
+    write_file(scratch_path, bad);
+    expect_throw("reader flipped byte, CRC fixed", scratch_path);
+
+    write_file(scratch_path, std::vector<unsigned char>(good.begin(), good.begin() + idat + 8 + length / 2));
+    expect_throw("reader truncated", scratch_path);
+
+    // Drop the Adler-32 trailer from the zlib stream, keeping the file well formed
+    std::vector<unsigned char> short_stream(good.begin(), good.begin() + idat);
+    put_chunk(short_stream, "IDAT", std::vector<unsigned char>(good.begin() + idat + 8, good.begin() + idat + 8 + length - 4));
+    put_chunk(short_stream, "IEND", {});
+    write_file(scratch_path, short_stream);
+    expect_throw("reader without zlib trailer", scratch_path);
+}
+
+// Test data of one kind: incompressible bytes (stored blocks), a short text
+// (fixed codes), a longer one, runs and repeats far back in the window
+std::vector<unsigned char> sample_data(int kind, size_t size) {
+    std::vector<unsigned char> data(size);
+    const char* words[] = {"pixel ", "row ", "band ", "filter ", "chunk ", "tile "};
+    size_t i = 0;
+    while (i < size) {
+        switch (kind) {
+        case 0:
+            data[i++] = static_cast<unsigned char>(random_bytes());
+            break;
+        case 1:
+        case 2:
+            for (const char* c = words[random_bytes() % 6]; *c != 0 && i < size; ++c) {
+                data[i++] = static_cast<unsigned char>(*c);
+            }
+            break;
+        case 3:
+            data[i] = static_cast<unsigned char>(i / 1000);
+            ++i;
+            break;
+        default:
+            // Copies of earlier data at distances up to the whole window
+            if (i > 40000 && random_bytes() % 2 == 0) {
+                const size_t distance = 1 + random_bytes() % 32768;
+                for (size_t n = 3 + random_bytes() % 300; n > 0 && i < size; --n, ++i) {
+                    data[i] = data[i - distance];
+                }
+            } else {
+                data[i++] = static_cast<unsigned char>(random_bytes() % 16);
+            }
+        }
+    }
+    return data;
+}
+
+void check_deflate() {
+    const struct {
+        const char* name;
+        int kind;
+        size_t size;
+    } inputs[] = {{"empty", 1, 0},      {"random", 0, 70000}, {"short text", 1, 40},
+                  {"text", 2, 100000}, {"runs", 3, 200000},  {"far repeats", 4, 300000}};
+    bool block_types[3] = {false, false, false};
+    for (const auto& input : inputs) {
+        const std::vector<unsigned char> data = sample_data(input.kind, input.size);
+        for (int level = 0; level <= 9; ++level) {
+            for (bool zlib : {true, false}) {
+                for (bool flush : {false, true}) {
+                    const std::string what = std::string("deflate ") + input.name + " level " + std::to_string(level) +
+                                             (zlib ? " zlib" : " raw") + (flush ? " sync flush" : "");
+                    std::vector<unsigned char> compressed;
+                    Deflater deflater(level, [&compressed](const unsigned char* bytes, size_t size) {
+                        compressed.insert(compressed.end(), bytes, bytes + size);
+                    }, zlib);
+                    // Odd-sized writes, with a sync flush a third of the way in
+                    size_t pos = 0;
+                    bool flushed = false;
+                    while (pos < data.size()) {
+                        const size_t n = std::min<size_t>(data.size() - pos, 1 + random_bytes() % 9000);
+                        deflater.write(data.data() + pos, n);
+                        pos += n;
+                        if (flush && !flushed && pos >= data.size() / 3) {
+                            deflater.sync_flush();
+                            flushed = true;
+                        }
+                    }
+                    deflater.finish();
+                    if (zlib && deflater.adler() != adler32(1, data.data(), data.size())) {
+                        fail(what + ": adler() is wrong");
+                    }
+                    if (!compressed.empty()) {
+                        const unsigned char first = compressed[zlib ? 2 : 0];
+                        block_types[std::min((first >> 1) & 3, 2)] = true;
+                    }
+
+                    // Read back in odd-sized pieces, from a source that hands out
+                    // fewer bytes than asked for
+                    size_t in_pos = 0;
+                    Inflater inflater([&](unsigned char* buffer, size_t capacity) {
+                        const size_t n = std::min({capacity, compressed.size() - in_pos, size_t(777)});
+                        std::memcpy(buffer, compressed.data() + in_pos, n);
+                        in_pos += n;
+                        return n;
+                    }, zlib);
+                    std::vector<unsigned char> out(data.size() + 1);
+                    try {
+                        size_t out_pos = 0;
+                        while (out_pos < data.size()) {
+                            const size_t n = std::min<size_t>(data.size() - out_pos, 1 + random_bytes() % 5000);
+                            inflater.read(out.data() + out_pos, n);
+                            out_pos += n;
+                        }
+                        inflater.finish();
+                        if (!std::equal(data.begin(), data.end(), out.begin())) {
+                            fail(what + ": inflated data differs");
+                        }
+                    } catch (const std::exception& e) {
+                        fail(what + ": " + e.what());
+                    }
+                }
+            }
+        }
+    }
+    if (!block_types[0] || !block_types[1] || !block_types[2]) {
+        fail("deflate: not every block type (stored, fixed, dynamic) was produced");
+    }
+}
+
+// Photo-like content: gradients, noise and flat areas
+std::vector<unsigned char> sample_image(int width, int height, int channels) {
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                int value = x < width / 4 ? 200 : (x * (c + 1) + y * 2) / 3 + static_cast<int>(random_bytes() % 12);
+                pixels[(static_cast<size_t>(y) * width + x) * channels + c] = static_cast<unsigned char>(value);
+            }
+        }
+    }
+    return pixels;
+}
+
+// Encode pixels with options, in batches of 7 rows, to memory
+std::vector<unsigned char> encode_png(const std::vector<unsigned char>& pixels, int width, int height, int channels,
+                                      const PngSaveOptions& options) {
+    std::vector<unsigned char> encoded;
+    PngWriter writer([&encoded](const unsigned char* bytes, size_t size) {
+        encoded.insert(encoded.end(), bytes, bytes + size);
+    }, width, height, channels, options);
+    const size_t row_bytes = static_cast<size_t>(width) * channels;
+    for (int y = 0; y < height; y += 7) {
+        writer.write_rows(pixels.data() + y * row_bytes, static_cast<std::ptrdiff_t>(row_bytes), std::min(7, height - y));
+    }
+    return encoded;
+}
+
+// The file must decode to pixels with both PngReader and stbi_load
+void check_decodes_to(const std::string& what, const std::vector<unsigned char>& encoded,
+                      const std::vector<unsigned char>& pixels, int channels) {
+    write_file(scratch_path, encoded);
+    int width = 0, height = 0, read_channels = 0;
+    try {
+        if (read_png(scratch_path, width, height, read_channels) != pixels || read_channels != channels) {
+            fail(what + ": PngReader gives different pixels");
+        }
+    } catch (const std::exception& e) {
+        fail(what + ": " + e.what());
+    }
+    int w, h, n;
+    unsigned char* decoded = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &w, &h, &n, channels);
+    if (decoded == nullptr || n != channels || std::memcmp(decoded, pixels.data(), pixels.size()) != 0) {
+        fail(what + ": stbi_load gives different pixels");
+    }
+    stbi_image_free(decoded);
+}
+
+const char* filter_name(PngFilter filter) {
+    switch (filter) {
+    case PngFilter::None: return "none";
+    case PngFilter::Sub: return "sub";
+    case PngFilter::Up: return "up";
+    case PngFilter::Average: return "average";
+    case PngFilter::Paeth: return "paeth";
+    case PngFilter::Adaptive: return "adaptive";
+    }
+    return "?";
+}
+
+void check_writer(const std::vector<int>& thread_counts) {
+    // Over 256 KiB of filtered data at 3 and 4 channels, so the parallel
+    // encoder splits it into several chunks
+    const int width = 331;
+    const int height = 293;
+    for (int channels = 1; channels <= 4; ++channels) {
+        const std::vector<unsigned char> pixels = sample_image(width, height, channels);
+        for (int level : {0, 1, 6, 9}) {
+            for (PngFilter filter : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Average,
+                                     PngFilter::Paeth, PngFilter::Adaptive}) {
+                std::vector<unsigned char> parallel;  // first output with more than one thread
+                for (int threads : thread_counts) {
+                    PngSaveOptions options;
+                    options.compression_level = level;
+                    options.filter = filter;
+                    options.threads = threads;
+                    const std::string what = "writer " + std::to_string(channels) + " channels level " +
+                                             std::to_string(level) + " filter " + filter_name(filter) + " threads " +
+                                             std::to_string(threads);
+                    const std::vector<unsigned char> encoded = encode_png(pixels, width, height, channels, options);
+                    check_decodes_to(what, encoded, pixels, channels);
+                    if (threads > 1) {
+                        if (parallel.empty()) {
+                            parallel = encoded;
+                        } else if (encoded != parallel) {
+                            fail(what + ": output depends on the thread count");
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+int main() {
+    scratch_path = (std::filesystem::temp_directory_path() / "png_codec_test.png").string();
+    check_reader();
+    check_deflate();
+    check_writer({1, 2, 3, 8});
+    std::remove(scratch_path.c_str());
+
+    if (failures > 0) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+    std::printf("All PNG codec checks passed.\n");
+    return 0;
+}